@@ -0,0 +1,686 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <openssl/rand.h>
+#include "aes256.hpp"
+#include "aesgcm.hpp"
+#include "chunkedfile.hpp"
+#include "commonhash.hpp"
+#include "commonrand.hpp"
+#include "ed25519.hpp"
+#include "encoders.hpp"
+#include "keypool.hpp"
+#include "keystore.hpp"
+#include "mediastore.hpp"
+#include "memdecrypt.hpp"
+#include "secretcache.hpp"
+#include "x25519.hpp"
+#include "yap.hpp"
+
+/**
+ * Benchmarks for the hot paths of the shared crypto library.
+ *
+ * Every benchmark reports bytes_per_second and items_per_second (operations
+ * per second). Build with -DCMAKE_BUILD_TYPE=Release before trusting the
+ * numbers, and compare runs with tools/compare.py from Google Benchmark.
+ */
+
+namespace
+{
+  const int64_t KB = 1024;
+  const int64_t MB = 1024 * KB;
+
+  std::vector<unsigned char> random_bytes(std::size_t length)
+  {
+    std::vector<unsigned char> bytes(length);
+    RAND_bytes(bytes.data(), bytes.size());
+    return bytes;
+  }
+
+  std::string temp_path(const std::string &name)
+  {
+    return "/tmp/crypto_bench_" + name;
+  }
+
+  void write_file(const std::string &path, const std::vector<unsigned char> &contents)
+  {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+  }
+
+  /// @brief remove the plain, cipher and decrypted files of a file benchmark
+  void remove_files(const std::string &prefix)
+  {
+    for (const char *suffix : {"_plain", "_cipher", "_decrypted"})
+      std::remove(temp_path(prefix + suffix).c_str());
+  }
+
+  void report(benchmark::State &state, int64_t bytes_per_op)
+  {
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * bytes_per_op);
+  }
+}
+
+/*******************
+ * Encoders        *
+ *******************/
+
+static void BM_HexEncode(benchmark::State &state)
+{
+  auto data = random_bytes(state.range(0));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(encoders::binary_to_hex(data.data(), data.size()));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_HexEncode)->Arg(32)->Arg(KB)->Arg(MB);
+
+static void BM_HexDecode(benchmark::State &state)
+{
+  auto data = random_bytes(state.range(0));
+  std::string hex = encoders::binary_to_hex(data.data(), data.size());
+  for (auto _ : state)
+    benchmark::DoNotOptimize(encoders::hex_to_binary(hex));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_HexDecode)->Arg(32)->Arg(KB)->Arg(MB);
+
+static void BM_Base64Encode(benchmark::State &state)
+{
+  auto data = random_bytes(state.range(0));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(encoders::base64_encode(data));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Base64Encode)->Arg(32)->Arg(KB)->Arg(MB);
+
+static void BM_Base64Decode(benchmark::State &state)
+{
+  std::string b64 = encoders::base64_encode(random_bytes(state.range(0)));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(encoders::base64_decode(b64));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Base64Decode)->Arg(32)->Arg(KB)->Arg(MB);
+
+// The caller buffer variants skip the allocation
+static void BM_HexEncodeInto(benchmark::State &state)
+{
+  auto data = random_bytes(state.range(0));
+  std::vector<char> out(encoders::hex_encoded_length(data.size()));
+  for (auto _ : state)
+  {
+    encoders::binary_to_hex(data.data(), data.size(), out.data());
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_HexEncodeInto)->Arg(32)->Arg(KB)->Arg(MB);
+
+static void BM_HexDecodeInto(benchmark::State &state)
+{
+  auto data = random_bytes(state.range(0));
+  std::string hex = encoders::binary_to_hex(data.data(), data.size());
+  for (auto _ : state)
+  {
+    encoders::hex_to_binary(hex.data(), hex.size(), data.data());
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_HexDecodeInto)->Arg(32)->Arg(KB)->Arg(MB);
+
+static void BM_Base64EncodeInto(benchmark::State &state)
+{
+  auto data = random_bytes(state.range(0));
+  std::vector<char> out(encoders::base64_encoded_length(data.size()));
+  for (auto _ : state)
+  {
+    encoders::base64_encode(data.data(), data.size(), out.data());
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Base64EncodeInto)->Arg(32)->Arg(KB)->Arg(MB);
+
+static void BM_Base64DecodeInto(benchmark::State &state)
+{
+  std::string b64 = encoders::base64_encode(random_bytes(state.range(0)));
+  std::vector<unsigned char> out(encoders::base64_decoded_max_length(b64.size()));
+  for (auto _ : state)
+  {
+    encoders::base64_decode(b64.data(), b64.size(), out.data());
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Base64DecodeInto)->Arg(32)->Arg(KB)->Arg(MB);
+
+/*******************
+ * Messages        *
+ *******************/
+
+static void BM_Aes256Encrypt(benchmark::State &state)
+{
+  auto key = random_bytes(aes256::KEY_LENGTH);
+  auto plaintext = random_bytes(state.range(0));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(aes256::encrypt(plaintext.data(), plaintext.size(), key.data()));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Aes256Encrypt)->Arg(64)->Arg(KB)->Arg(MB);
+
+static void BM_Aes256Decrypt(benchmark::State &state)
+{
+  auto key = random_bytes(aes256::KEY_LENGTH);
+  auto plaintext = random_bytes(state.range(0));
+  auto ciphertext = aes256::encrypt(plaintext.data(), plaintext.size(), key.data());
+  for (auto _ : state)
+    benchmark::DoNotOptimize(aes256::decrypt(ciphertext.data(), ciphertext.size(), key.data()));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Aes256Decrypt)->Arg(64)->Arg(KB)->Arg(MB);
+
+// The hex key and base64 string path that JS messages take
+static void BM_Aes256EncryptString(benchmark::State &state)
+{
+  std::string key = commonrand::hex(aes256::KEY_LENGTH);
+  auto bytes = random_bytes(state.range(0));
+  std::string plaintext(bytes.begin(), bytes.end());
+  for (auto _ : state)
+    benchmark::DoNotOptimize(aes256::encrypt(plaintext, key));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Aes256EncryptString)->Arg(64)->Arg(KB)->Arg(MB);
+
+static void BM_AesGcmSeal(benchmark::State &state)
+{
+  auto key = random_bytes(aesgcm::KEY_LENGTH);
+  auto iv = random_bytes(aesgcm::IV_LENGTH);
+  auto plaintext = random_bytes(state.range(0));
+  std::vector<unsigned char> ciphertext(plaintext.size());
+  unsigned char tag[aesgcm::TAG_LENGTH];
+  for (auto _ : state)
+  {
+    aesgcm::seal(key.data(), iv.data(), nullptr, 0, plaintext.data(), plaintext.size(), ciphertext.data(), tag);
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_AesGcmSeal)->Arg(64)->Arg(KB)->Arg(MB);
+
+static void BM_AesGcmOpen(benchmark::State &state)
+{
+  auto key = random_bytes(aesgcm::KEY_LENGTH);
+  auto iv = random_bytes(aesgcm::IV_LENGTH);
+  auto plaintext = random_bytes(state.range(0));
+  std::vector<unsigned char> ciphertext(plaintext.size());
+  unsigned char tag[aesgcm::TAG_LENGTH];
+  aesgcm::seal(key.data(), iv.data(), nullptr, 0, plaintext.data(), plaintext.size(), ciphertext.data(), tag);
+  for (auto _ : state)
+  {
+    if (!aesgcm::open(key.data(), iv.data(), nullptr, 0, ciphertext.data(), ciphertext.size(), tag, plaintext.data()))
+      state.SkipWithError("Authentication failed");
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_AesGcmOpen)->Arg(64)->Arg(KB)->Arg(MB);
+
+static void BM_YapV1Encrypt(benchmark::State &state)
+{
+  auto shared_secret = random_bytes(32);
+  auto peer = x25519::generate_keypair();
+  auto plaintext = random_bytes(state.range(0));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(yap::v1::encrypt(shared_secret, peer->public_key, plaintext));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_YapV1Encrypt)->Arg(64)->Arg(KB)->Arg(MB);
+
+static void BM_YapV1Decrypt(benchmark::State &state)
+{
+  auto shared_secret = random_bytes(32);
+  auto peer = x25519::generate_keypair();
+  auto ciphertext = yap::v1::encrypt(shared_secret, peer->public_key, random_bytes(state.range(0)));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(yap::v1::decrypt(shared_secret, peer->private_key, ciphertext));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_YapV1Decrypt)->Arg(64)->Arg(KB)->Arg(MB);
+
+static void BM_YapV1EncryptInto(benchmark::State &state)
+{
+  x25519::fixed_key shared_secret, peer_private, peer_public;
+  x25519::generate_keypair(peer_private, peer_public);
+  x25519::derive_secret(peer_private.data(), peer_public.data(), shared_secret.data());
+  auto plaintext = random_bytes(state.range(0));
+  std::vector<unsigned char> ciphertext(yap::v1::OVERHEAD + plaintext.size());
+  for (auto _ : state)
+  {
+    yap::v1::encrypt(shared_secret, peer_public, plaintext.data(), plaintext.size(), ciphertext.data());
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_YapV1EncryptInto)->Arg(64)->Arg(KB)->Arg(MB);
+
+static void BM_YapV1DecryptInto(benchmark::State &state)
+{
+  x25519::fixed_key shared_secret, peer_private, peer_public;
+  x25519::generate_keypair(peer_private, peer_public);
+  x25519::derive_secret(peer_private.data(), peer_public.data(), shared_secret.data());
+  auto plaintext = random_bytes(state.range(0));
+  std::vector<unsigned char> ciphertext(yap::v1::OVERHEAD + plaintext.size());
+  yap::v1::encrypt(shared_secret, peer_public, plaintext.data(), plaintext.size(), ciphertext.data());
+  for (auto _ : state)
+  {
+    yap::v1::decrypt(shared_secret, peer_private, ciphertext.data(), ciphertext.size(), plaintext.data());
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_YapV1DecryptInto)->Arg(64)->Arg(KB)->Arg(MB);
+
+// Send latency when the ephemeral key pool has keys ready, refilling it outside the timed region
+static void BM_YapV1EncryptPooled(benchmark::State &state)
+{
+  x25519::fixed_key shared_secret, peer_private, peer_public;
+  x25519::generate_keypair(peer_private, peer_public);
+  x25519::derive_secret(peer_private.data(), peer_public.data(), shared_secret.data());
+  auto plaintext = random_bytes(state.range(0));
+  std::vector<unsigned char> ciphertext(yap::v1::OVERHEAD + plaintext.size());
+  keypool::shared().fill();
+  for (auto _ : state)
+  {
+    if (keypool::shared().available() <= keypool::DEFAULT_LOW_WATERMARK)
+    {
+      state.PauseTiming();
+      keypool::shared().fill();
+      state.ResumeTiming();
+    }
+    yap::v1::encrypt(shared_secret, peer_public, plaintext.data(), plaintext.size(), ciphertext.data());
+    benchmark::ClobberMemory();
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_YapV1EncryptPooled)->Arg(64)->Arg(KB);
+
+// Catching up on a queue of short messages, each from a different peer
+static void BM_YapV1DecryptMany(benchmark::State &state)
+{
+  auto own = x25519::generate_keypair();
+  std::vector<yap::v1::EncodedMessage> messages;
+  for (int i = 0; i < state.range(0); i++)
+  {
+    auto peer = x25519::generate_keypair();
+    auto shared_secret = x25519::derive_secret(peer->private_key, own->public_key);
+    messages.push_back({encoders::binary_to_hex(shared_secret.data(), shared_secret.size()),
+                        encoders::binary_to_hex(own->private_key.data(), own->private_key.size()),
+                        encoders::base64_encode(yap::v1::encrypt(shared_secret, own->public_key, random_bytes(256)))});
+  }
+  for (auto _ : state)
+    benchmark::DoNotOptimize(yap::v1::decrypt_many(messages));
+  report(state, state.range(0) * 256);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_YapV1DecryptMany)->Arg(1)->Arg(100)->UseRealTime();
+
+// Rejecting a tampered 64 byte message, by exception (0) and by status (1)
+static void BM_AesGcmReject(benchmark::State &state)
+{
+  aesgcm::fixed_key key;
+  auto key_bytes = random_bytes(aesgcm::KEY_LENGTH);
+  std::copy(key_bytes.begin(), key_bytes.end(), key.begin());
+  auto plaintext = random_bytes(64);
+  std::vector<unsigned char> iv(aesgcm::IV_LENGTH), tag(aesgcm::TAG_LENGTH), ciphertext(64), out(64);
+  aesgcm::encrypt(key, plaintext.data(), plaintext.size(), iv.data(), tag.data(), ciphertext.data());
+  tag[0] ^= 1;
+  for (auto _ : state)
+  {
+    if (state.range(0) == 0)
+    {
+      try
+      {
+        aesgcm::decrypt(key, iv.data(), tag.data(), ciphertext.data(), ciphertext.size(), out.data());
+      }
+      catch (const std::exception &e)
+      {
+        benchmark::DoNotOptimize(e.what());
+      }
+    }
+    else
+    {
+      benchmark::DoNotOptimize(aesgcm::try_decrypt(key, iv.data(), tag.data(), ciphertext.data(), ciphertext.size(), out.data()));
+    }
+  }
+  report(state, 64);
+}
+BENCHMARK(BM_AesGcmReject)->Arg(0)->Arg(1);
+
+/*******************
+ * Hashing         *
+ *******************/
+
+static void BM_HashSHA256(benchmark::State &state)
+{
+  auto bytes = random_bytes(state.range(0));
+  std::string input(bytes.begin(), bytes.end());
+  for (auto _ : state)
+    benchmark::DoNotOptimize(hash::hashSHA256(input));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_HashSHA256)->Arg(32)->Arg(MB);
+
+// A thousand identifiers, one at a time and as one batch
+static void BM_HashSHA256Loop(benchmark::State &state)
+{
+  std::vector<std::string> inputs;
+  for (int i = 0; i < 1000; i++)
+    inputs.push_back("identifier " + std::to_string(i));
+  for (auto _ : state)
+    for (auto &input : inputs)
+      benchmark::DoNotOptimize(hash::hashSHA256(input));
+  state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+BENCHMARK(BM_HashSHA256Loop)->UseRealTime();
+
+static void BM_HashSHA256Many(benchmark::State &state)
+{
+  std::vector<std::string> inputs;
+  for (int i = 0; i < 1000; i++)
+    inputs.push_back("identifier " + std::to_string(i));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(hash::hash_many(inputs));
+  state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+BENCHMARK(BM_HashSHA256Many)->UseRealTime();
+
+/*******************
+ * Randomness      *
+ *******************/
+
+// IV sized draws, the way messages consume randomness
+static void BM_RandBytes(benchmark::State &state)
+{
+  std::vector<unsigned char> out(state.range(0));
+  for (auto _ : state)
+  {
+    commonrand::bytes(out.data(), out.size());
+    benchmark::DoNotOptimize(out.data());
+  }
+  report(state, state.range(0));
+}
+BENCHMARK(BM_RandBytes)->Arg(12)->Arg(32)->Arg(KB);
+
+// The hex round trip the callers used before
+static void BM_RandHexToBinary(benchmark::State &state)
+{
+  for (auto _ : state)
+    benchmark::DoNotOptimize(encoders::hex_to_binary(commonrand::hex(state.range(0))));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_RandHexToBinary)->Arg(12)->Arg(32)->Arg(KB);
+
+/*******************
+ * Keys            *
+ *******************/
+
+static void BM_X25519DeriveSecret(benchmark::State &state)
+{
+  auto ours = x25519::generate_keypair();
+  auto theirs = x25519::generate_keypair();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(x25519::derive_secret(ours->private_key, theirs->public_key));
+  report(state, x25519::PUBLIC_KEY_LENGTH);
+}
+BENCHMARK(BM_X25519DeriveSecret);
+
+// The same with a private key parsed once into the keystore
+static void BM_X25519DeriveSecretStored(benchmark::State &state)
+{
+  x25519::fixed_key public_key, secret;
+  auto ours = keystore::generate_x25519(public_key);
+  auto theirs = x25519::generate_keypair();
+  for (auto _ : state)
+  {
+    x25519::derive_secret(keystore::get(ours, keystore::Kind::x25519_private_key)->pkey(), theirs->public_key.data(), secret.data());
+    benchmark::ClobberMemory();
+  }
+  keystore::remove(ours);
+  report(state, x25519::PUBLIC_KEY_LENGTH);
+}
+BENCHMARK(BM_X25519DeriveSecretStored);
+
+// Deriving the secret for a chat that was derived before
+static void BM_X25519DeriveSecretCached(benchmark::State &state)
+{
+  secretcache::Cache cache;
+  auto ours = x25519::generate_keypair();
+  auto theirs = x25519::generate_keypair();
+  x25519::fixed_key secret;
+  for (auto _ : state)
+  {
+    cache.derive(ours->private_key.data(), theirs->public_key.data(), secret.data());
+    benchmark::ClobberMemory();
+  }
+  report(state, x25519::PUBLIC_KEY_LENGTH);
+}
+BENCHMARK(BM_X25519DeriveSecretCached);
+
+static void BM_Ed25519Sign(benchmark::State &state)
+{
+  std::string private_key_b64 = encoders::base64_encode(random_bytes(32));
+  auto bytes = random_bytes(state.range(0));
+  std::string message(bytes.begin(), bytes.end());
+  for (auto _ : state)
+    benchmark::DoNotOptimize(ed25519::sign_message(message, private_key_b64));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Ed25519Sign)->Arg(64)->Arg(KB);
+
+static void BM_Ed25519Verify(benchmark::State &state)
+{
+  auto keys = ed25519::generate_keys_json();
+  auto field = [&keys](const std::string &name)
+  {
+    auto start = keys.find("\"" + name + "\":\"") + name.size() + 4;
+    return keys.substr(start, keys.find('"', start) - start);
+  };
+  auto bytes = random_bytes(state.range(0));
+  std::string message(bytes.begin(), bytes.end());
+  auto signature = ed25519::sign_message(message, field("privateKey"));
+  auto public_key = field("publicKey");
+  for (auto _ : state)
+    benchmark::DoNotOptimize(ed25519::verify(message, signature, public_key));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Ed25519Verify)->Arg(64)->Arg(KB);
+
+// Signing with a key that was parsed once
+static void BM_Ed25519Signer(benchmark::State &state)
+{
+  ed25519::Signer signer(encoders::base64_encode(random_bytes(32)));
+  auto bytes = random_bytes(state.range(0));
+  std::string message(bytes.begin(), bytes.end());
+  for (auto _ : state)
+    benchmark::DoNotOptimize(signer.sign(message));
+  report(state, state.range(0));
+}
+BENCHMARK(BM_Ed25519Signer)->Arg(64)->Arg(KB);
+
+/*******************
+ * Files           *
+ *******************/
+
+static void BM_FileEncryptV1(benchmark::State &state)
+{
+  write_file(temp_path("v1_plain"), random_bytes(state.range(0)));
+  unsigned char key[EVP_MAX_KEY_LENGTH], iv[EVP_MAX_IV_LENGTH];
+  aes256::generate_random_key(key);
+  aes256::generate_random_iv(iv);
+  for (auto _ : state)
+  {
+    std::ifstream in(temp_path("v1_plain"), std::ios::binary);
+    std::ofstream out(temp_path("v1_cipher"), std::ios::binary);
+    aes256::encrypt_file(in, out, key, iv);
+  }
+  remove_files("v1");
+  report(state, state.range(0));
+}
+BENCHMARK(BM_FileEncryptV1)->Arg(KB)->Arg(MB)->Arg(100 * MB)->Unit(benchmark::kMillisecond);
+
+// Encrypt and get both digests, by hashing the two files afterwards (0) or in the same pass (1)
+static void BM_FileEncryptV1Hashed(benchmark::State &state)
+{
+  write_file(temp_path("v1_plain"), random_bytes(state.range(0)));
+  unsigned char key[EVP_MAX_KEY_LENGTH], iv[EVP_MAX_IV_LENGTH];
+  aes256::generate_random_key(key);
+  aes256::generate_random_iv(iv);
+  for (auto _ : state)
+  {
+    if (state.range(1))
+    {
+      std::ifstream in(temp_path("v1_plain"), std::ios::binary);
+      std::ofstream out(temp_path("v1_cipher"), std::ios::binary);
+      aes256::FileDigests digests;
+      aes256::encrypt_file(in, out, key, iv, digests);
+      benchmark::DoNotOptimize(digests);
+    }
+    else
+    {
+      {
+        std::ifstream in(temp_path("v1_plain"), std::ios::binary);
+        std::ofstream out(temp_path("v1_cipher"), std::ios::binary);
+        aes256::encrypt_file(in, out, key, iv);
+      }
+      benchmark::DoNotOptimize(hash::hash_file(temp_path("v1_plain")));
+      benchmark::DoNotOptimize(hash::hash_file(temp_path("v1_cipher")));
+    }
+  }
+  remove_files("v1");
+  report(state, state.range(0));
+}
+BENCHMARK(BM_FileEncryptV1Hashed)->Args({MB, 0})->Args({MB, 1})->Args({100 * MB, 0})->Args({100 * MB, 1})->Unit(benchmark::kMillisecond);
+
+static void BM_FileDecryptV1(benchmark::State &state)
+{
+  write_file(temp_path("v1_plain"), random_bytes(state.range(0)));
+  unsigned char key[EVP_MAX_KEY_LENGTH], iv[EVP_MAX_IV_LENGTH];
+  aes256::generate_random_key(key);
+  aes256::generate_random_iv(iv);
+  {
+    std::ifstream in(temp_path("v1_plain"), std::ios::binary);
+    std::ofstream out(temp_path("v1_cipher"), std::ios::binary);
+    aes256::encrypt_file(in, out, key, iv);
+  }
+  std::string key_str(reinterpret_cast<char *>(key), sizeof(key)), iv_str(reinterpret_cast<char *>(iv), sizeof(iv));
+  for (auto _ : state)
+  {
+    std::ifstream in(temp_path("v1_cipher"), std::ios::binary);
+    std::ofstream out(temp_path("v1_decrypted"), std::ios::binary);
+    aes256::decrypt_file(in, out, key_str, iv_str);
+  }
+  remove_files("v1");
+  report(state, state.range(0));
+}
+BENCHMARK(BM_FileDecryptV1)->Arg(KB)->Arg(MB)->Arg(100 * MB)->Unit(benchmark::kMillisecond);
+
+static void BM_FileEncryptV2(benchmark::State &state)
+{
+  write_file(temp_path("v2_plain"), random_bytes(state.range(0)));
+  auto key = random_bytes(aes256::KEY_LENGTH);
+  auto iv = random_bytes(aes256::IV_LENGTH);
+  for (auto _ : state)
+    chunkedfile::encrypt_file(temp_path("v2_plain"), temp_path("v2_cipher"), key.data(), iv.data());
+  remove_files("v2");
+  report(state, state.range(0));
+}
+BENCHMARK(BM_FileEncryptV2)->Arg(KB)->Arg(MB)->Arg(100 * MB)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_FileDecryptV2(benchmark::State &state)
+{
+  write_file(temp_path("v2_plain"), random_bytes(state.range(0)));
+  auto key = random_bytes(aes256::KEY_LENGTH);
+  auto iv = random_bytes(aes256::IV_LENGTH);
+  chunkedfile::encrypt_file(temp_path("v2_plain"), temp_path("v2_cipher"), key.data(), iv.data());
+  for (auto _ : state)
+    chunkedfile::decrypt_file(temp_path("v2_cipher"), temp_path("v2_decrypted"), key.data(), iv.data());
+  remove_files("v2");
+  report(state, state.range(0));
+}
+BENCHMARK(BM_FileDecryptV2)->Arg(KB)->Arg(MB)->Arg(100 * MB)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Sending the same file again, the way forwards do, and a new file every time
+static void BM_MediaStorePut(benchmark::State &state)
+{
+  bool forward = state.range(1);
+  write_file(temp_path("media_plain"), random_bytes(state.range(0)));
+  mediastore::Store store(temp_path("media_store"));
+  if (forward)
+    store.release(store.put(temp_path("media_plain")).digest);
+  for (auto _ : state)
+  {
+    if (!forward)
+    {
+      state.PauseTiming();
+      store.clear();
+      state.ResumeTiming();
+    }
+    auto stored = store.put(temp_path("media_plain"));
+    store.release(stored.digest);
+  }
+  remove_files("media");
+  report(state, state.range(0));
+}
+BENCHMARK(BM_MediaStorePut)->Args({MB, 0})->Args({MB, 1})->Args({100 * MB, 0})->Args({100 * MB, 1})->Unit(benchmark::kMillisecond);
+
+// A screen of 40 KB thumbnails, decrypted to temp files that are read back and deleted (0) or into memory (1)
+static void BM_FileDecryptThumbnails(benchmark::State &state)
+{
+  const std::size_t count = 30;
+  write_file(temp_path("thumb_plain"), random_bytes(40 * KB));
+  std::vector<memdecrypt::File> files;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    unsigned char key[EVP_MAX_KEY_LENGTH], iv[EVP_MAX_IV_LENGTH];
+    aes256::generate_random_key(key);
+    aes256::generate_random_iv(iv);
+    std::ifstream in(temp_path("thumb_plain"), std::ios::binary);
+    std::ofstream out(temp_path("thumb_cipher" + std::to_string(i)), std::ios::binary);
+    aes256::encrypt_file(in, out, key, iv);
+    files.push_back({temp_path("thumb_cipher" + std::to_string(i)), aes256::combine_key_and_iv(key, iv)});
+  }
+  for (auto _ : state)
+  {
+    if (state.range(0))
+    {
+      benchmark::DoNotOptimize(memdecrypt::decrypt_many(files));
+      continue;
+    }
+    for (const auto &file : files)
+    {
+      std::string key, iv;
+      aes256::split_key_and_iv(file.key_and_iv, key, iv);
+      {
+        std::ifstream in(file.path, std::ios::binary);
+        std::ofstream out(temp_path("thumb_decrypted"), std::ios::binary);
+        aes256::decrypt_file(in, out, key, iv);
+      }
+      std::ifstream in(temp_path("thumb_decrypted"), std::ios::binary);
+      std::vector<unsigned char> plaintext(40 * KB);
+      in.read(reinterpret_cast<char *>(plaintext.data()), plaintext.size());
+      benchmark::DoNotOptimize(plaintext);
+      std::remove(temp_path("thumb_decrypted").c_str());
+    }
+  }
+  for (const auto &file : files)
+    std::remove(file.path.c_str());
+  remove_files("thumb");
+  report(state, count * 40 * KB);
+}
+BENCHMARK(BM_FileDecryptThumbnails)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -3,14 +3,21 @@
 #include <AppSpecsJSI.h>
 
 #include <memory>
+#include <optional>
 #include <string>
 
+#include "workpool.hpp"
+
 namespace facebook::react
 {
 
   class NativeCryptoModule : public NativeCryptoModuleCxxSpec<NativeCryptoModule>
   {
   public:
+    /// @brief What a promise resolves with. Work runs off the JS thread, so it hands back
+    /// a function that builds the JS value once we are back on the JS thread.
+    using PromiseResult = std::function<jsi::Value(jsi::Runtime &)>;
+
     NativeCryptoModule(std::shared_ptr<CallInvoker> jsInvoker);
 
     std::string reverseString(jsi::Runtime &rt, std::string input);
@@ -19,22 +26,101 @@ namespace facebook::react
     /// @param input the string to hash
     /// @return hash of input
     std::string hashSHA256(jsi::Runtime &rt, std::string input);
+    /// @brief hash many strings in one call
+    jsi::Array hashSHA256Many(jsi::Runtime &rt, jsi::Array inputs);
+    /// @brief hash a file without passing its contents through JS
+    jsi::Object hashSHA256File(jsi::Runtime &rt, std::string path_to_file);
     std::string randHex(jsi::Runtime &rt, double size);
     std::string generateEd25519Keypair(jsi::Runtime &rt);
     std::string ed25519SignMessage(jsi::Runtime &rt, std::string message, std::string private_key);
+    jsi::Array ed25519SignMany(jsi::Runtime &rt, jsi::Array messages, std::string private_key);
+    bool ed25519VerifyMessage(jsi::Runtime &rt, std::string message, std::string signature, std::string public_key);
+    jsi::Object ed25519VerifyMany(jsi::Runtime &rt, jsi::Array messages);
     std::string generateX25519Keypair(jsi::Runtime &rt);
     std::string deriveX25519Secret(jsi::Runtime &rt, std::string private_key, std::string public_key);
     std::string aes256Encrypt(jsi::Runtime &rt, std::string plaintext, std::string secret);
     std::string aes256Decrypt(jsi::Runtime &rt, std::string ciphertext, std::string secret);
+    /// @brief like aes256Decrypt, but returns {plaintext} or {error, code} with code naming the failure
+    jsi::Object aes256DecryptResult(jsi::Runtime &rt, std::string ciphertext, std::string secret);
+    /// @brief encrypt plaintext for every [tag, secret] pair at once. Returns {tag: ciphertext}.
+    jsi::Object aes256EncryptMulti(jsi::Runtime &rt, std::string plaintext, jsi::Array tagged_secrets);
+    /// @brief encrypt plaintext once and wrap its key for every [tag, secret] pair. Returns {payload, keys: {tag: wrapped key}}.
+    jsi::Object envelopeSeal(jsi::Runtime &rt, std::string plaintext, jsi::Array tagged_secrets);
+    /// @brief open an envelope with this member's wrapped key. Returns "error" on failure.
+    std::string envelopeOpen(jsi::Runtime &rt, std::string payload, std::string wrapped_key, std::string secret);
+    /// @brief like envelopeOpen, but returns {plaintext} or {error, code}
+    jsi::Object envelopeOpenResult(jsi::Runtime &rt, std::string payload, std::string wrapped_key, std::string secret);
+    /// @brief encrypt a file, hashing the plaintext and the ciphertext in the same pass
+    /// @return a promise for {key, plaintextDigest, ciphertextDigest}, the digests are hex SHA-256
     jsi::Object aes256FileEncrypt(jsi::Runtime &rt, std::string path_to_input, std::string path_to_output);
+    /// @brief encrypt a file into the chunked version 2 format. Chunks are encrypted in parallel.
+    /// The returned key and iv string is interchangeable with the key from aes256FileEncrypt.
+    jsi::Object aes256FileEncryptV2(jsi::Runtime &rt, std::string path_to_input, std::string path_to_output);
+    /// @brief decrypt a file produced by either aes256FileEncrypt or aes256FileEncryptV2
+    /// @brief decrypt length bytes of a version 2 file starting at offset, without decrypting the rest of it
+    /// @param offset,length non-negative integers, length at most 16 MiB
+    /// @return a promise for {bytes: ArrayBuffer, totalSize: number}, where totalSize is the size of the whole plaintext
+    jsi::Object aes256FileReadRange(jsi::Runtime &rt, std::string path_to_input, std::string key_and_iv, double offset, double length);
     jsi::Object aes256FileDecrypt(jsi::Runtime &rt, std::string path_to_input, std::string path_to_output, std::string key_and_iv);
-    jsi::Object pbEncrypt(jsi::Runtime &rt, std::string password, std::string metadata, std::string path_to_db, std::string path_to_destination);
-    jsi::Object pbDecrypt(jsi::Runtime &rt, std::string password, std::string path_to_backup, std::string path_to_db_destination);
+    /// @brief decrypt a file of either version into memory, without writing anything to disk
+    /// @param max_bytes files with a longer plaintext are refused, memdecrypt::DEFAULT_MAX_SIZE if not given
+    /// @return a promise for the plaintext as an ArrayBuffer
+    jsi::Object aes256FileDecryptToMemory(jsi::Runtime &rt, std::string path_to_input, std::string key_and_iv, std::optional<double> max_bytes);
+    /// @brief decrypt many files into memory in one call, eg. the thumbnails of a gallery
+    /// @param files [path, keyAndIV] pairs
+    /// @return a promise for an array of {bytes: ArrayBuffer} or {error}, in the order of files
+    jsi::Object aes256FileDecryptManyToMemory(jsi::Runtime &rt, jsi::Array files, std::optional<double> max_bytes);
+    /// @brief encrypt a database snapshot into a backup, deflating it first if compress is set.
+    /// on_progress is called with (bytes processed, total bytes).
+    jsi::Object pbEncrypt(jsi::Runtime &rt, std::string password, std::string metadata, std::string path_to_db, std::string path_to_destination, std::optional<bool> compress, std::optional<AsyncCallback<double, double>> on_progress);
+    /// @brief restore a database snapshot from a backup. on_progress is called with (bytes processed, total bytes).
+    jsi::Object pbDecrypt(jsi::Runtime &rt, std::string password, std::string path_to_backup, std::string path_to_db_destination, std::optional<AsyncCallback<double, double>> on_progress);
+    /// @brief make a full backup that starts a chain of incremental backups, and the manifest for its first delta
+    jsi::Object pbEncryptBase(jsi::Runtime &rt, std::string password, std::string metadata, std::string path_to_db, std::string path_to_destination, std::string path_to_manifest, std::optional<AsyncCallback<double, double>> on_progress);
+    /// @brief back up only the page groups that changed since the manifest. Resolves to the number of changed groups.
+    jsi::Object pbEncryptDelta(jsi::Runtime &rt, std::string password, std::string metadata, std::string path_to_db, std::string path_to_manifest, std::string path_to_destination, std::string path_to_next_manifest);
+    /// @brief restore a full backup followed by its deltas, oldest first. Resolves to the latest metadata.
+    jsi::Object pbRestoreIncremental(jsi::Runtime &rt, std::string password, std::string path_to_base, jsi::Array paths_to_deltas, std::string path_to_db_destination);
     std::string yapV1Encrypt(jsi::Runtime &rt, std::string shared_secret_hex, std::string peer_public_key_hex, std::string plaintext);
-    std::string yapV1Decrypt(jsi::Runtime &rt, std::string shared_secret_hex, std::string private_key_hex, std::string plaintext);
+    std::string yapV1Decrypt(jsi::Runtime &rt, std::string shared_secret_hex, std::string private_key_hex, std::string ciphertext);
+    /// @brief like yapV1Decrypt, but returns {plaintext} or {error, code}
+    jsi::Object yapV1DecryptResult(jsi::Runtime &rt, std::string shared_secret_hex, std::string private_key_hex, std::string ciphertext);
+    jsi::Object yapV1DecryptMany(jsi::Runtime &rt, jsi::Array messages);
+    /**
+     * Binary variants of the methods above. Keys, plaintexts and ciphertexts are ArrayBuffers or Uint8Arrays
+     * instead of hex/base64 strings. Inputs are read in place and outputs are ArrayBuffers over native memory,
+     * so payloads cross the bridge without being encoded or copied.
+     */
+    jsi::Object deriveX25519SecretBytes(jsi::Runtime &rt, jsi::Object private_key, jsi::Object public_key);
+    jsi::Object aes256EncryptBytes(jsi::Runtime &rt, jsi::Object plaintext, jsi::Object secret);
+    jsi::Object aes256DecryptBytes(jsi::Runtime &rt, jsi::Object ciphertext, jsi::Object secret);
+    jsi::Object yapV1EncryptBytes(jsi::Runtime &rt, jsi::Object shared_secret, jsi::Object peer_public_key, jsi::Object plaintext);
+    jsi::Object yapV1DecryptBytes(jsi::Runtime &rt, jsi::Object shared_secret, jsi::Object private_key, jsi::Object ciphertext);
+    /// @brief queue depth and wait time counters for the native worker pool
+    double keystoreAddSecret(jsi::Runtime &rt, std::string secret_hex);
+    double keystoreAddX25519PrivateKey(jsi::Runtime &rt, std::string private_key_hex);
+    jsi::Object keystoreGenerateX25519(jsi::Runtime &rt);
+    double keystoreDeriveX25519Secret(jsi::Runtime &rt, double private_key, std::string peer_public_key_hex);
+    void keystoreRemove(jsi::Runtime &rt, double handle);
+    void keystoreClear(jsi::Runtime &rt);
+    std::string aes256EncryptWithKey(jsi::Runtime &rt, std::string plaintext, double secret);
+    std::string aes256DecryptWithKey(jsi::Runtime &rt, std::string ciphertext, double secret);
+    std::string yapV1EncryptWithKey(jsi::Runtime &rt, double shared_secret, std::string peer_public_key_hex, std::string plaintext);
+    std::string yapV1DecryptWithKey(jsi::Runtime &rt, double shared_secret, double private_key, std::string ciphertext);
+    jsi::Object secretCacheStats(jsi::Runtime &rt);
+    void secretCacheClear(jsi::Runtime &rt);
+    /// @brief open the store of encrypted media in directory, or change its budget if it is open already
+    void mediaStoreOpen(jsi::Runtime &rt, std::string directory, double budget_bytes);
+    /// @brief encrypt a file into the media store, or find the copy it already has.
+    /// @return a promise for {key, path, digest, hit}. The entry stays pinned until mediaStoreRelease(digest).
+    jsi::Object mediaStorePut(jsi::Runtime &rt, std::string path_to_input);
+    void mediaStoreRelease(jsi::Runtime &rt, std::string digest);
+    jsi::Object mediaStoreStats(jsi::Runtime &rt);
+    void mediaStoreClear(jsi::Runtime &rt);
+    jsi::Object workerPoolStats(jsi::Runtime &rt);
 
   private:
-    jsi::Object make_promise(jsi::Runtime &rt, std::function<jsi::Value()> func);
+    jsi::Object make_promise(jsi::Runtime &rt, workpool::Lane lane, std::function<PromiseResult()> func);
   };
 
 } // namespace facebook::react
@@ -1,17 +1,56 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <openssl/evp.h>
 
+#include "decryption.hpp"
+#include "workpool.hpp"
+
 namespace aes256
 {
+  const unsigned int KEY_LENGTH = 32;
+  const unsigned int IV_LENGTH = 16;
+  /// @brief length of the hex string from combine_key_and_iv
+  const std::size_t KEY_AND_IV_HEX_LENGTH = 2 * (EVP_MAX_IV_LENGTH + EVP_MAX_KEY_LENGTH);
   void generate_random_key(unsigned char *buffer);
   void generate_random_iv(unsigned char *buffer);
   std::string combine_key_and_iv(unsigned char *key, unsigned char *iv);
   // TODO: change this to return a pair instead of requiring buffers.
+  /// @brief Throws unless key_and_iv is KEY_AND_IV_HEX_LENGTH hex characters
   void split_key_and_iv(std::string key_and_iv, std::string &key_buf, std::string &iv_buf);
   std::string encrypt(std::string &plaintext, std::string &key);
   std::string decrypt(std::string &ciphertext, std::string &key);
+  /// @brief encrypt one plaintext for many recipients, spread over the worker pool
+  /// @param keys_hex one hex key per recipient, like the key of encrypt
+  /// @return base64 ciphertexts in the order of keys_hex, each the same as encrypt would return
+  std::vector<std::string> encrypt_many(const std::string &plaintext, const std::vector<std::string> &keys_hex,
+                                        workpool::Lane lane = workpool::Lane::interactive);
+  /// @brief encrypt raw bytes with a binary key
+  /// @return IV(16) | ciphertext
+  std::vector<unsigned char> encrypt(const unsigned char *plaintext, std::size_t plaintext_length, const unsigned char *key);
+  /// @brief decrypt the output of encrypt. Throws if the input is malformed or the padding is bad.
+  std::vector<unsigned char> decrypt(const unsigned char *iv_ciphertext, std::size_t length, const unsigned char *key);
+  /// @brief decrypt without throwing on malformed input or bad padding
+  /// @param plaintext receives the plaintext if the status is ok
+  decryption::Status try_decrypt(const unsigned char *iv_ciphertext, std::size_t length, const unsigned char *key,
+                                 std::vector<unsigned char> &plaintext);
+  /// @brief the same with a hex key and base64 ciphertext, like decrypt
+  decryption::Status try_decrypt(const std::string &ciphertext_b64, const std::string &key_hex, std::string &plaintext);
   void encrypt_file(std::ifstream &in_stream, std::ofstream &out_stream, unsigned char *key, unsigned char *iv);
+
+  /// @brief SHA-256 of both sides of an encrypted file
+  struct FileDigests
+  {
+    std::array<unsigned char, 32> plaintext;
+    std::array<unsigned char, 32> ciphertext;
+  };
+  /// @brief encrypt_file, hashing the plaintext and the ciphertext in the same pass over the file
+  /// @return the number of ciphertext bytes written
+  std::uint64_t encrypt_file(std::ifstream &in_stream, std::ofstream &out_stream, unsigned char *key, unsigned char *iv,
+                             FileDigests &digests);
   void decrypt_file(std::ifstream &in_file, std::ofstream &out_file, const std::string key, const std::string iv);
 }
\ No newline at end of file
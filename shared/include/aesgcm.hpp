@@ -4,22 +4,74 @@
  * providing the basis for AEAD in Port.
  */
 
+#include <array>
+#include <cstddef>
 #include <vector>
 
+#include "decryption.hpp"
+
 namespace aesgcm
 {
   typedef std::vector<unsigned char> key;
+  const unsigned int KEY_LENGTH = 32;
   const unsigned int IV_LENGTH = 12;
   const unsigned int TAG_LENGTH = 16;
   typedef std::vector<unsigned char> data;
-  void encrypt(key secret,
-               data plaintext,
+  /// @brief a key that lives on the stack
+  typedef std::array<unsigned char, KEY_LENGTH> fixed_key;
+  void encrypt(const key &secret,
+               const data &plaintext,
                unsigned char *iv_buf,
                unsigned char *tag_buf,
                unsigned char *ciphertext_buf);
-  data decrypt(key secret,
+  data decrypt(const key &secret,
                unsigned char *iv_buf,
                unsigned char *tag_buf,
                unsigned char *ciphertext_buf,
                size_t ciphertext_length);
+
+  /// @brief encrypt with a random IV into caller owned buffers, without allocating
+  /// @param ciphertext_buf length bytes. May be the same buffer as plaintext.
+  void encrypt(const fixed_key &secret,
+               const unsigned char *plaintext, size_t length,
+               unsigned char *iv_buf,
+               unsigned char *tag_buf,
+               unsigned char *ciphertext_buf);
+  /// @brief decrypt into a caller owned buffer of ciphertext_length bytes, without allocating.
+  /// Throws if the message can't be verified.
+  void decrypt(const fixed_key &secret,
+               const unsigned char *iv_buf,
+               const unsigned char *tag_buf,
+               const unsigned char *ciphertext_buf,
+               size_t ciphertext_length,
+               unsigned char *plaintext_buf);
+  /// @brief decrypt without throwing on a bad tag
+  /// @return bad_tag if the message can't be verified. plaintext_buf must not be used in that case.
+  decryption::Status try_decrypt(const fixed_key &secret,
+                                 const unsigned char *iv_buf,
+                                 const unsigned char *tag_buf,
+                                 const unsigned char *ciphertext_buf,
+                                 size_t ciphertext_length,
+                                 unsigned char *plaintext_buf);
+
+  /// @brief encrypt with a caller chosen IV and additional authenticated data.
+  /// Never reuse an IV with the same key.
+  /// @param key KEY_LENGTH bytes
+  /// @param iv IV_LENGTH bytes
+  /// @param ciphertext_buf length bytes. May be the same buffer as plaintext.
+  /// @param tag_buf receives TAG_LENGTH bytes
+  void seal(const unsigned char *key,
+            const unsigned char *iv,
+            const unsigned char *aad, size_t aad_length,
+            const unsigned char *plaintext, size_t length,
+            unsigned char *ciphertext_buf,
+            unsigned char *tag_buf);
+  /// @brief decrypt and verify the output of seal
+  /// @return false if the tag does not match. The plaintext buffer must not be used in that case.
+  bool open(const unsigned char *key,
+            const unsigned char *iv,
+            const unsigned char *aad, size_t aad_length,
+            const unsigned char *ciphertext, size_t length,
+            const unsigned char *tag,
+            unsigned char *plaintext_buf);
 }
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+/**
+ * Version 2 of Port's file encryption.
+ *
+ * Version 1 (aes256::encrypt_file) is a single AES-256-CBC stream, which can
+ * only be encrypted one block after another. Version 2 splits the plaintext
+ * into fixed-size chunks that are each sealed with AES-256-GCM, so chunks can
+ * be encrypted and decrypted independently, on as many cores as we have.
+ *
+ * Layout:
+ *   Header(24) | chunk 0 | chunk 1 | ... | chunk n-1
+ * where every chunk is ciphertext(chunk_size) | tag(16), except the last
+ * chunk which holds whatever is left over (possibly nothing).
+ *
+ * Files are keyed with the same key and IV pair as version 1, so callers keep
+ * passing around the string from aes256::combine_key_and_iv. The nonce of
+ * chunk i is the first 8 bytes of the IV followed by i as a big endian
+ * 32 bit integer. The header is authenticated as additional data of every
+ * chunk, so the chunk size and plaintext size can't be tampered with, and
+ * the nonce ties every chunk to its position in the file.
+ *
+ * Since every chunk sits at a known offset, any byte range of the plaintext
+ * can be decrypted on its own with a Reader, without touching the rest of
+ * the file.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "workpool.hpp"
+
+namespace chunkedfile
+{
+  const char MAGIC[8] = "PORTCF2";
+  const std::uint32_t DEFAULT_CHUNK_SIZE = 1 << 20;
+  const std::uint32_t MAX_CHUNK_SIZE = 1 << 26;
+
+  struct Header
+  {
+    char magic[8];
+    std::uint32_t chunk_size;
+    std::uint32_t reserved;
+    std::uint64_t plaintext_size;
+  };
+  static_assert(sizeof(Header) == 24, "The header is written to disk as is and must not contain padding");
+
+  /// @brief check whether a file starts with the version 2 magic
+  bool is_chunked(const std::string &path);
+
+  /// @brief encrypt a file into the version 2 format
+  /// @param key aes256::KEY_LENGTH bytes
+  /// @param iv aes256::IV_LENGTH bytes
+  /// @param lane the worker pool lane chunks are spread over
+  void encrypt_file(const std::string &path_to_input,
+                    const std::string &path_to_output,
+                    const unsigned char *key,
+                    const unsigned char *iv,
+                    std::uint32_t chunk_size = DEFAULT_CHUNK_SIZE,
+                    workpool::Lane lane = workpool::Lane::interactive);
+
+  /// @brief decrypt a version 2 file. Throws if any chunk fails authentication.
+  void decrypt_file(const std::string &path_to_input,
+                    const std::string &path_to_output,
+                    const unsigned char *key,
+                    const unsigned char *iv,
+                    workpool::Lane lane = workpool::Lane::interactive);
+
+  /// @brief Random access to the plaintext of a version 2 file.
+  /// Only the chunks overlapping a requested range are read and decrypted.
+  class Reader
+  {
+  public:
+    Reader(const std::string &path, const unsigned char *key, const unsigned char *iv);
+    ~Reader();
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    /// @brief size of the decrypted file
+    std::uint64_t size() const;
+    /// @brief decrypt up to length bytes starting at offset. Reads past the end are cut short.
+    /// Throws if any chunk in the range fails authentication.
+    std::vector<unsigned char> read(std::uint64_t offset, std::size_t length,
+                                    workpool::Lane lane = workpool::Lane::interactive) const;
+
+  private:
+    struct State;
+    std::unique_ptr<State> state;
+  };
+}
@@ -0,0 +1,44 @@
+#pragma once
+/**
+ * Reusable cipher contexts for short messages.
+ *
+ * With OpenSSL 3, looking up an algorithm through the provider layer and
+ * setting up a fresh EVP_CIPHER_CTX costs more than encrypting a chat
+ * message. Algorithms are fetched once per process here, and every thread
+ * keeps a few contexts per algorithm and direction around. A Lease borrows
+ * one of them and only needs a new key and IV to be ready again.
+ */
+
+#include <openssl/evp.h>
+
+namespace cipherpool
+{
+  enum class Cipher
+  {
+    aes_256_cbc,
+    aes_256_gcm,
+  };
+
+  /// @brief the algorithm, fetched on first use and kept for the lifetime of the process
+  const EVP_CIPHER *fetch(Cipher cipher);
+
+  /// @brief Borrow a context of this thread. It goes back to the thread's cache when the lease ends,
+  /// unless the lease ends because of an exception, in which case it is freed.
+  class Lease
+  {
+  public:
+    Lease(Cipher cipher, bool encrypting);
+    ~Lease();
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+
+    /// @brief start a new message with key and iv. Throws if OpenSSL refuses.
+    EVP_CIPHER_CTX *init(const unsigned char *key, const unsigned char *iv);
+    EVP_CIPHER_CTX *get() const { return ctx; }
+
+  private:
+    EVP_CIPHER_CTX *ctx;
+    unsigned int slot;
+    int exceptions;
+  };
+}
@@ -1,12 +1,48 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <vector>
+
+#include "workpool.hpp"
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
 
 namespace hash
 {
+  const std::size_t SHA256_LENGTH = 32;
 
   /// @brief hash a string using sha256
   /// @param input 
   /// @return hashed input
-  std::string hashSHA256(std::string input);
+  std::string hashSHA256(const std::string &input);
+
+  /// @brief Incremental SHA-256, for input that arrives in pieces
+  class Sha256
+  {
+  public:
+    Sha256();
+    ~Sha256();
+    Sha256(const Sha256 &) = delete;
+    Sha256 &operator=(const Sha256 &) = delete;
+
+    void update(const unsigned char *data, std::size_t length);
+    void update(const std::string &data);
+    /// @param digest receives SHA256_LENGTH bytes. The hasher starts over afterwards.
+    void final(unsigned char *digest);
+    /// @return the hex digest. The hasher starts over afterwards.
+    std::string final_hex();
+
+  private:
+    EVP_MD_CTX *ctx;
+  };
+
+  /// @brief hash a file without loading all of it into memory
+  /// @return hex digest. Throws if the file can't be read.
+  std::string hash_file(const std::string &path);
+
+  /// @brief hash many short inputs in one go, across the worker pool if there are enough of them
+  /// @return hex digests, in order
+  std::vector<std::string> hash_many(const std::vector<std::string> &inputs,
+                                     workpool::Lane lane = workpool::Lane::interactive);
 }
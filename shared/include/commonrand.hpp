@@ -1,11 +1,17 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 namespace commonrand
 {
   /// @brief Generate a random hex string
   /// @param length 
-  /// @return random hex string encoding length bytes
+  /// @return random hex string encoding length bytes, or "error"
   std::string hex(std::size_t length);
-};
\ No newline at end of file
+
+  /// @brief Fill a buffer with cryptographically secure random bytes.
+  /// Short requests are served from a per-thread buffer that is refilled from OpenSSL's DRBG in bulk,
+  /// and every byte handed out is wiped from it. Throws if the DRBG fails.
+  void bytes(unsigned char *buffer, std::size_t length);
+};
@@ -0,0 +1,75 @@
+#pragma once
+/**
+ * Outcomes of decryption, for the try_* variants that report expected
+ * failures without throwing.
+ *
+ * Garbage and stale messages are routine for a messenger, and rejecting one
+ * should cost no more than noticing it's bad. Exceptions remain for what isn't
+ * expected, like OpenSSL running out of memory.
+ */
+
+namespace decryption
+{
+  enum class Status
+  {
+    ok,
+    /// @brief the input is too short or not shaped like a ciphertext
+    malformed,
+    /// @brief the format version is one we don't know
+    unsupported_version,
+    /// @brief a key passed in has the wrong length or encoding
+    bad_key,
+    /// @brief no secret could be agreed on with the public key in the message
+    bad_peer_key,
+    /// @brief the authentication tag doesn't match, the message was altered or is for another key
+    bad_tag,
+    /// @brief CBC padding is wrong, usually a wrong key
+    bad_padding,
+  };
+
+  /// @brief the code JS sees for status
+  inline const char *name(Status status)
+  {
+    switch (status)
+    {
+    case Status::ok:
+      return "ok";
+    case Status::malformed:
+      return "malformed";
+    case Status::unsupported_version:
+      return "unsupported_version";
+    case Status::bad_key:
+      return "bad_key";
+    case Status::bad_peer_key:
+      return "bad_peer_key";
+    case Status::bad_tag:
+      return "bad_tag";
+    case Status::bad_padding:
+      return "bad_padding";
+    }
+    return "unknown";
+  }
+
+  /// @brief a sentence for error messages and exceptions
+  inline const char *describe(Status status)
+  {
+    switch (status)
+    {
+    case Status::ok:
+      return "Decrypted";
+    case Status::malformed:
+      return "The ciphertext is too short or malformed";
+    case Status::unsupported_version:
+      return "The ciphertext has an unsupported version";
+    case Status::bad_key:
+      return "The key has the wrong length or encoding";
+    case Status::bad_peer_key:
+      return "Could not agree on a secret with the public key in the message";
+    case Status::bad_tag:
+      return "Could not decrypt and verify authenticity of message";
+    case Status::bad_padding:
+      return "Could not decrypt, the padding is wrong";
+    }
+    return "Unknown decryption failure";
+  }
+}
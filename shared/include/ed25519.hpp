@@ -1,8 +1,61 @@
 #pragma once
+#include <cstddef>
 #include <string>
+#include <vector>
+
+#include "workpool.hpp"
+
+typedef struct evp_pkey_st EVP_PKEY;
 
 namespace ed25519
 {
+  const unsigned int PUBLIC_KEY_LENGTH = 32;
+  const unsigned int SIGNATURE_LENGTH = 64;
+
   std::string generate_keys_json();
+  /// @return a base64 signature, or "error"
   std::string sign_message(const std::string &message, const std::string &private_key_b64);
-};
\ No newline at end of file
+
+  /// @brief Signs with a private key that is parsed once. Safe to share between threads.
+  class Signer
+  {
+  public:
+    /// @brief throws if the key is malformed
+    explicit Signer(const std::string &private_key_b64);
+    ~Signer();
+    Signer(const Signer &) = delete;
+    Signer &operator=(const Signer &) = delete;
+
+    /// @param signature_buf receives SIGNATURE_LENGTH bytes
+    void sign(const unsigned char *message, std::size_t length, unsigned char *signature_buf) const;
+    /// @return a base64 signature, like sign_message
+    std::string sign(const std::string &message) const;
+    /// @brief sign every message across the worker pool
+    /// @return base64 signatures, in order
+    std::vector<std::string> sign_many(const std::vector<std::string> &messages,
+                                       workpool::Lane lane = workpool::Lane::interactive) const;
+
+  private:
+    EVP_PKEY *private_key;
+  };
+
+  /// @param signature SIGNATURE_LENGTH bytes
+  /// @param public_key PUBLIC_KEY_LENGTH bytes
+  /// @return true only if signature is a valid signature of message by public_key
+  bool verify(const unsigned char *message, std::size_t length,
+              const unsigned char *signature,
+              const unsigned char *public_key);
+  /// @brief verify the output of sign_message. Malformed signatures or keys don't verify.
+  bool verify(const std::string &message, const std::string &signature_b64, const std::string &public_key_b64);
+
+  struct SignedMessage
+  {
+    std::string message;
+    std::string signature_b64;
+    std::string public_key_b64;
+  };
+  /// @brief verify many signatures across the worker pool
+  /// @return whether each message verified, in order
+  std::vector<bool> verify_many(const std::vector<SignedMessage> &messages,
+                                workpool::Lane lane = workpool::Lane::interactive);
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -9,7 +10,36 @@ namespace encoders
   /// @param length the number of bytes to encode
   /// @return a hexadecimal encoding of data
   std::string binary_to_hex(const unsigned char *data, std::size_t length);
+  /// @brief convert a hexadecimal string to bytes. An odd trailing digit becomes a byte of its own.
+  /// Throws std::invalid_argument on anything that isn't a hex digit.
   std::vector<unsigned char> hex_to_binary(const std::string &hex_string);
+  /// @brief decode url safe base64, stopping at the first character outside the alphabet (like padding)
   std::vector<unsigned char> base64_decode(const std::string &in);
+  /// @brief encode as url safe base64 with padding
   std::string base64_encode(const std::vector<unsigned char> &in);
-};
\ No newline at end of file
+
+  /*
+   * The same codecs writing into caller provided buffers, for hot paths that
+   * don't want to allocate. Size the buffers with the *_length helpers.
+   */
+
+  inline std::size_t hex_encoded_length(std::size_t length) { return length * 2; }
+  inline std::size_t hex_decoded_length(std::size_t length) { return (length + 1) / 2; }
+  inline std::size_t base64_encoded_length(std::size_t length) { return (length + 2) / 3 * 4; }
+  /// @brief an upper bound, the actual length depends on padding
+  inline std::size_t base64_decoded_max_length(std::size_t length) { return (length + 3) / 4 * 3; }
+
+  /// @param out receives hex_encoded_length(length) lower case characters, not null terminated
+  void binary_to_hex(const unsigned char *data, std::size_t length, char *out);
+  /// @param out receives hex_decoded_length(length) bytes
+  /// @return the number of bytes written
+  std::size_t hex_to_binary(const char *hex, std::size_t length, unsigned char *out);
+  /// @brief whether hex_to_binary would accept every character, without throwing on the first bad one
+  bool is_hex(const char *hex, std::size_t length);
+  /// @param out receives base64_encoded_length(length) characters, not null terminated
+  /// @return the number of characters written
+  std::size_t base64_encode(const unsigned char *data, std::size_t length, char *out);
+  /// @param out must hold base64_decoded_max_length(length) bytes
+  /// @return the number of bytes written
+  std::size_t base64_decode(const char *in, std::size_t length, unsigned char *out);
+};
@@ -0,0 +1,62 @@
+#pragma once
+/**
+ * Multi-recipient envelopes for large group messages.
+ *
+ * The payload is encrypted once with AES-256-GCM under a random content key,
+ * and only the 32 byte content key is wrapped for every member with a key
+ * derived from the shared secret with that member. Sending to n members then
+ * costs one payload plus n small wrapped keys, instead of n full ciphertexts.
+ *
+ * Layouts:
+ *   payload:     version(1) | iv(12) | tag(16) | ciphertext(k)
+ *   wrapped key: iv(12) | tag(16) | encrypted content key(32)
+ *
+ * The version byte is authenticated with the payload, and every wrapped key
+ * is bound to its payload by authenticating the payload's version and IV.
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "aesgcm.hpp"
+#include "decryption.hpp"
+
+namespace envelope
+{
+  const unsigned char VERSION = 1;
+  const std::size_t PAYLOAD_OVERHEAD = 1 + aesgcm::IV_LENGTH + aesgcm::TAG_LENGTH;
+  const std::size_t WRAPPED_KEY_LENGTH = aesgcm::IV_LENGTH + aesgcm::TAG_LENGTH + aesgcm::KEY_LENGTH;
+
+  struct Sealed
+  {
+    std::vector<unsigned char> payload;
+    /// @brief one wrapped key per secret, in the order the secrets were given
+    std::vector<std::vector<unsigned char>> wrapped_keys;
+  };
+
+  /// @brief encrypt plaintext once and wrap its key for every secret
+  /// @param secrets shared secrets of at least aesgcm::KEY_LENGTH bytes. Only the first 32 bytes are used.
+  Sealed seal(const unsigned char *plaintext, std::size_t length, const std::vector<std::vector<unsigned char>> &secrets);
+  /// @brief unwrap the content key with secret and decrypt the payload. Throws if either fails authentication.
+  std::vector<unsigned char> open(const unsigned char *payload, std::size_t payload_length,
+                                  const unsigned char *wrapped_key, std::size_t wrapped_key_length,
+                                  const std::vector<unsigned char> &secret);
+  /// @brief open without throwing on envelopes that are malformed or don't verify
+  /// @param plaintext receives the plaintext if the status is ok
+  decryption::Status try_open(const unsigned char *payload, std::size_t payload_length,
+                              const unsigned char *wrapped_key, std::size_t wrapped_key_length,
+                              const std::vector<unsigned char> &secret,
+                              std::vector<unsigned char> &plaintext);
+
+  /// @brief seal with hex secrets, base64 encoding the payload and every wrapped key
+  /// @param wrapped_keys_b64 receives one wrapped key per secret
+  /// @return the base64 payload
+  std::string seal(const std::string &plaintext, const std::vector<std::string> &secrets_hex,
+                   std::vector<std::string> &wrapped_keys_b64);
+  /// @brief open with a hex secret and base64 payload and wrapped key
+  /// @return the plaintext, or "error" if it can't be decrypted, like aes256::decrypt
+  std::string open(const std::string &payload_b64, const std::string &wrapped_key_b64, const std::string &secret_hex);
+  decryption::Status try_open(const std::string &payload_b64, const std::string &wrapped_key_b64, const std::string &secret_hex,
+                              std::string &plaintext);
+}
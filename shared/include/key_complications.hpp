@@ -1,20 +1,27 @@
 #pragma once
 
+#include <cstddef>
+#include <stdexcept>
 #include <vector>
 
 namespace key_complications
 {
   typedef std::vector<unsigned char> key;
-  inline key exclusive_or(key k1, key k2)
+
+  /// @brief xor length bytes of k1 and k2 into out, which may alias either of them
+  inline void exclusive_or(const unsigned char *k1, const unsigned char *k2, std::size_t length, unsigned char *out)
+  {
+    for (std::size_t i = 0; i < length; i++)
+      out[i] = k1[i] ^ k2[i];
+  }
+
+  inline key exclusive_or(const key &k1, const key &k2)
   {
-    key resultant_key;
     if (k1.size() != k2.size())
       throw std::runtime_error("YAP shared secret and derived key are not the same length");
 
-    for (int i = 0; i < k1.size(); i++)
-    {
-      resultant_key.push_back(k1[i] ^ k2[i]);
-    }
+    key resultant_key(k1.size());
+    exclusive_or(k1.data(), k2.data(), k1.size(), resultant_key.data());
     return resultant_key;
   };
-}
\ No newline at end of file
+}
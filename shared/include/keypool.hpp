@@ -0,0 +1,70 @@
+#pragma once
+/**
+ * A pool of one-time X25519 keypairs, generated ahead of time.
+ *
+ * Generating the ephemeral keypair is the most expensive part of encrypting
+ * a YAP message. The pool keeps keypairs ready so the send path only has to
+ * pick one up, and refills itself on the interactive lane of the worker pool
+ * once it runs low. Refills are short, and on the bulk lane a running backup
+ * would hold them up until it is done. Every keypair is handed out exactly
+ * once and wiped from the pool as it leaves, so a private key can never end
+ * up encrypting two messages.
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "workpool.hpp"
+#include "x25519.hpp"
+
+namespace keypool
+{
+  const std::size_t DEFAULT_CAPACITY = 32;
+  const std::size_t DEFAULT_LOW_WATERMARK = 8;
+
+  class EphemeralPool
+  {
+  public:
+    /// @param low_watermark a refill starts as soon as fewer keypairs than this are left
+    EphemeralPool(std::size_t capacity = DEFAULT_CAPACITY,
+                  std::size_t low_watermark = DEFAULT_LOW_WATERMARK,
+                  workpool::WorkerPool &workers = workpool::shared());
+    /// @brief waits for a running refill and wipes every keypair that was never used
+    ~EphemeralPool();
+    EphemeralPool(const EphemeralPool &) = delete;
+    EphemeralPool &operator=(const EphemeralPool &) = delete;
+
+    /// @brief take a keypair nobody else will get. Generated on the spot if the pool is empty.
+    void take(x25519::fixed_key &private_key, x25519::fixed_key &public_key);
+    /// @brief change the limits. A smaller capacity wipes the keypairs that no longer fit.
+    void configure(std::size_t capacity, std::size_t low_watermark);
+    /// @brief generate keypairs on the calling thread until the pool is full
+    void fill();
+    std::size_t available();
+
+  private:
+    struct KeyPair
+    {
+      x25519::fixed_key private_key;
+      x25519::fixed_key public_key;
+    };
+    // Must be called with the lock held
+    void refill_if_low();
+    void refill();
+    static void wipe(KeyPair &pair);
+
+    std::mutex lock;
+    std::condition_variable refilled;
+    std::vector<KeyPair> ready;
+    std::size_t capacity;
+    std::size_t low_watermark;
+    bool refilling = false;
+    bool stopping = false;
+    workpool::WorkerPool &workers;
+  };
+
+  /// @brief The process-wide pool used for YAP encryption
+  EphemeralPool &shared();
+}
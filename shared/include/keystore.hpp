@@ -0,0 +1,72 @@
+#pragma once
+/**
+ * Keys parsed once and kept in native memory for the length of a session.
+ *
+ * JS only ever sees an opaque handle (a small number), so secrets stored here
+ * never have to pass through the JS heap again. Secret bytes live in OpenSSL's
+ * secure heap when it is available (locked pages, excluded from core dumps)
+ * and are wiped when removed. X25519 private keys are kept as ready to use
+ * EVP_PKEYs, so no call has to rebuild one from raw bytes.
+ *
+ * Handles are never reused within a process, a removed handle stays invalid.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "x25519.hpp"
+
+typedef struct evp_pkey_st EVP_PKEY;
+
+namespace keystore
+{
+  typedef std::uint32_t Handle;
+
+  enum class Kind
+  {
+    secret,
+    x25519_private_key,
+  };
+
+  /// @brief A stored key. Stays valid while the caller holds on to it, even if its handle is removed meanwhile.
+  class Key
+  {
+  public:
+    Key(Kind kind, const unsigned char *bytes, std::size_t length);
+    ~Key();
+    Key(const Key &) = delete;
+    Key &operator=(const Key &) = delete;
+
+    Kind kind() const { return type; }
+    /// @brief the secret, or the raw private key
+    const unsigned char *data() const { return bytes; }
+    std::size_t size() const { return length; }
+    /// @brief only for x25519 private keys
+    EVP_PKEY *pkey() const { return private_key; }
+    const x25519::fixed_key &public_key() const { return public_key_bin; }
+
+  private:
+    Kind type;
+    unsigned char *bytes;
+    std::size_t length;
+    EVP_PKEY *private_key = nullptr;
+    x25519::fixed_key public_key_bin{};
+  };
+
+  /// @brief store a copy of a secret, like an AES key or an X25519 shared secret
+  Handle add_secret(const unsigned char *secret, std::size_t length);
+  /// @brief store an X25519 private key of PRIVATE_KEY_LENGTH bytes
+  Handle add_x25519_private_key(const unsigned char *private_key);
+  /// @brief generate an X25519 keypair whose private key never leaves the store
+  Handle generate_x25519(x25519::fixed_key &public_key);
+  /// @brief agree on a secret with a peer and store it, without ever handing it out
+  Handle derive_x25519_secret(Handle private_key, const unsigned char *peer_public_key);
+
+  /// @brief look up a key. Throws if the handle is unknown or the key is of another kind.
+  std::shared_ptr<const Key> get(Handle handle, Kind kind);
+  /// @brief forget a key. Its memory is wiped once nobody uses it anymore.
+  void remove(Handle handle);
+  /// @brief forget every key, eg. on logout
+  void clear();
+}
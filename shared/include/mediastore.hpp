@@ -0,0 +1,115 @@
+#pragma once
+/**
+ * A content-addressed store of encrypted media.
+ *
+ * Forwarding the same picture or video to many chats used to encrypt it into
+ * a fresh temp file every time. The store keeps one encrypted copy per unique
+ * plaintext, named after the SHA-256 of the plaintext, and hands out the same
+ * key and ciphertext for every further put of the same content.
+ *
+ * The plaintext is hashed in the same read loop that encrypts it, so a miss
+ * reads the input once. Inputs the store has seen before are recognised by
+ * their file identity (device, inode, size and modification time) and
+ * answered without reading them at all.
+ *
+ * Ciphertexts are in the version 1 format of aes256::encrypt_file and their
+ * keys look like the ones aes256FileEncrypt returns. Keys only live in
+ * memory, so whatever a previous run left in the directory is deleted when
+ * the store is opened.
+ *
+ * Entries are evicted least recently used first once the ciphertexts take
+ * more than the budget. An entry is pinned from the put that returns it until
+ * it is released, and pinned entries are never evicted.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace mediastore
+{
+  const std::uint64_t DEFAULT_BUDGET = 512 * 1024 * 1024;
+
+  /// @brief The encrypted copy of a file
+  struct Stored
+  {
+    /// @brief hex SHA-256 of the plaintext, the handle to release the entry with
+    std::string digest;
+    std::string path;
+    /// @brief hex iv | key, like aes256FileEncrypt returns
+    std::string key_and_iv;
+    /// @brief whether the store already had the content
+    bool hit = false;
+  };
+
+  struct Stats
+  {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::size_t entries = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t budget = 0;
+  };
+
+  class Store
+  {
+  public:
+    /// @param directory created if it doesn't exist. Files left in it are deleted.
+    explicit Store(const std::string &directory, std::uint64_t budget = DEFAULT_BUDGET);
+    /// @brief deletes every ciphertext, their keys are gone with the store
+    ~Store();
+    Store(const Store &) = delete;
+    Store &operator=(const Store &) = delete;
+
+    /// @brief encrypt a file into the store, or find the copy it already has. The entry is pinned.
+    /// Throws if the file can't be read or the ciphertext can't be written.
+    Stored put(const std::string &path_to_input);
+    /// @brief unpin an entry returned by put, once its ciphertext isn't needed anymore
+    void release(const std::string &digest);
+    /// @brief change the budget, evicting right away if the store is over it
+    void set_budget(std::uint64_t budget);
+    /// @brief delete every ciphertext, pinned or not, eg. on logout
+    void clear();
+    Stats stats();
+
+  private:
+    // device, inode, size, modification time in seconds and nanoseconds
+    typedef std::tuple<std::uint64_t, std::uint64_t, std::uint64_t, std::int64_t, std::int64_t> Identity;
+    struct Entry
+    {
+      std::string digest;
+      std::string path;
+      std::string key_and_iv;
+      std::uint64_t size;
+      unsigned int pins;
+      std::vector<Identity> identities;
+    };
+    static Identity identify(const std::string &path);
+    // Must be called with the lock held
+    Stored pin(std::list<Entry>::iterator entry, bool hit);
+    void evict();
+    void erase(std::list<Entry>::iterator entry);
+
+    const std::string directory;
+    std::mutex lock;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::map<Identity, std::string> identities;
+    std::uint64_t budget;
+    Stats counters;
+  };
+
+  /// @brief open the process-wide store used by the native crypto module.
+  /// Opening it again with the same directory only changes the budget.
+  Store &open(const std::string &directory, std::uint64_t budget = DEFAULT_BUDGET);
+  /// @brief the process-wide store. Throws if it wasn't opened.
+  Store &shared();
+}
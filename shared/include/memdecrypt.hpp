@@ -0,0 +1,52 @@
+#pragma once
+/**
+ * Decrypting small encrypted files straight into memory.
+ *
+ * Thumbnails and other small media used to be decrypted into a temp file that
+ * the image loader read back and that was deleted afterwards. These decrypt
+ * into a buffer instead and never write to the filesystem.
+ *
+ * Both file formats are understood: version 1 (aes256::encrypt_file) and
+ * version 2 (chunkedfile). Files are keyed with the string from
+ * aes256::combine_key_and_iv. The whole plaintext is held in memory, so
+ * every call takes a cap on its size and refuses larger files before
+ * decrypting any of them.
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "workpool.hpp"
+
+namespace memdecrypt
+{
+  const std::size_t DEFAULT_MAX_SIZE = 8 * 1024 * 1024;
+
+  /// @brief decrypt a whole file into memory.
+  /// Throws if the file can't be read, doesn't decrypt, or its plaintext is longer than max_size.
+  /// @param key_and_iv hex iv | key, like aes256FileEncrypt returns
+  std::vector<unsigned char> decrypt_file(const std::string &path, const std::string &key_and_iv,
+                                          std::size_t max_size = DEFAULT_MAX_SIZE,
+                                          workpool::Lane lane = workpool::Lane::interactive);
+
+  struct File
+  {
+    std::string path;
+    std::string key_and_iv;
+  };
+
+  struct Decrypted
+  {
+    std::vector<unsigned char> plaintext;
+    /// @brief why the file couldn't be decrypted, empty if it was
+    std::string error;
+  };
+
+  /// @brief decrypt many files across the worker pool, eg. the thumbnails of a gallery.
+  /// A file that fails doesn't fail the others, it gets an error instead.
+  /// @return one result per file, in order
+  std::vector<Decrypted> decrypt_many(const std::vector<File> &files,
+                                      std::size_t max_size = DEFAULT_MAX_SIZE,
+                                      workpool::Lane lane = workpool::Lane::interactive);
+}
@@ -0,0 +1,96 @@
+#pragma once
+/**
+ * Incremental backups on top of pbencrypt.
+ *
+ * The database is split into fixed size page groups and a manifest remembers
+ * a SHA-256 hash of every group as of the last backup. An incremental backup
+ * (a delta) only carries the groups whose hash changed, plus the new size of
+ * the database, sealed with the same password based encryption as a full
+ * backup.
+ *
+ * A chain starts with a full backup and a manifest written from the same
+ * snapshot by encrypt_base. The base backup and every delta carry the chain
+ * id, and every delta records its position in the chain, so a restore can
+ * check that it replays the base backup and then every delta, in order.
+ * Restores and applies work on a copy of the database that only replaces it
+ * once every delta has been read in full, so a damaged delta never leaves a
+ * half patched database behind.
+ *
+ * Plaintext layout of a delta, before encryption:
+ *   DeltaHeader(56) | (group index(8) | group bytes) * changed_groups
+ * where every group is group_size bytes except the last group of the database.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pbencrypt.hpp"
+#include "pipeline.hpp"
+
+namespace pbdelta
+{
+  /// @brief 16 SQLite pages of the default size
+  const std::uint32_t DEFAULT_GROUP_SIZE = 64 * 1024;
+  const std::size_t HASH_LENGTH = 32;
+  const std::size_t CHAIN_ID_LENGTH = pbencrypt::CHAIN_ID_LENGTH;
+
+  typedef std::array<unsigned char, HASH_LENGTH> GroupHash;
+
+  /// @brief The state of the database as of the last backup in a chain
+  struct Manifest
+  {
+    std::uint32_t group_size = DEFAULT_GROUP_SIZE;
+    std::uint64_t database_size = 0;
+    /// @brief 0 for the full backup the chain starts with, then 1, 2, ... for every delta
+    std::uint64_t sequence = 0;
+    /// @brief random, shared by the base backup's manifest and all its deltas
+    std::array<unsigned char, CHAIN_ID_LENGTH> chain{};
+    std::vector<GroupHash> hashes;
+  };
+
+  /// @brief hash every page group of a database, starting a new chain. encrypt_base also makes the base backup for it.
+  Manifest create_manifest(const std::string &path_to_db, std::uint32_t group_size = DEFAULT_GROUP_SIZE);
+  void save_manifest(const Manifest &manifest, const std::string &path);
+  Manifest load_manifest(const std::string &path);
+
+  /// @brief write a full backup that starts a new chain, and the manifest for its first delta
+  void encrypt_base(std::string password,
+                    std::string metadata,
+                    const std::string &path_to_db,
+                    const std::string &path_to_dest,
+                    const std::string &path_to_manifest,
+                    const pipeline::Progress &progress = nullptr);
+
+  /// @brief write an encrypted delta holding every group that changed since previous
+  /// @param path_to_next_manifest the manifest for the next delta is written here. Callers
+  /// should only replace the previous manifest with it once the delta is safely stored.
+  /// @return the number of changed groups in the delta
+  std::size_t encrypt(std::string password,
+                      std::string metadata,
+                      const std::string &path_to_db,
+                      const std::string &path_to_previous_manifest,
+                      const std::string &path_to_dest,
+                      const std::string &path_to_next_manifest,
+                      const pipeline::Progress &progress = nullptr);
+
+  /// @brief write the changed groups of a delta into a database restored up to the previous link of the chain.
+  /// The database is only replaced once the whole delta has been read and checked.
+  /// @param expected_sequence the sequence the delta must have, or 0 to accept any
+  /// @return the plaintext metadata stored with the delta
+  std::string apply(std::string password,
+                    const std::string &path_to_delta,
+                    const std::string &path_to_db,
+                    std::uint64_t expected_sequence = 0,
+                    const pipeline::Progress &progress = nullptr);
+
+  /// @brief restore a base backup from encrypt_base and replay its deltas in order.
+  /// Throws if a delta belongs to another chain. The destination is only written once everything has been replayed.
+  /// @return the plaintext metadata of the last backup in the chain
+  std::string restore(std::string password,
+                      const std::string &path_to_base,
+                      const std::vector<std::string> &paths_to_deltas,
+                      const std::string &path_to_db_destination);
+}
@@ -1,8 +1,52 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+#include "pipeline.hpp"
+
 namespace pbencrypt {
-  void encrypt(std::string password, std::string metadata, std::string path_to_db, std::string path_to_dest);
-  std::string decrypt(std::string password, std::string path_to_backup, std::string database_snapshot_destination);
+  const std::size_t CHAIN_ID_LENGTH = 16;
+
+  /// @brief How the database is packed before it is encrypted
+  enum class Compression
+  {
+    /// @brief raw database pages, readable by every version of the app
+    none,
+    /// @brief zlib deflate stream, which usually shrinks a database several times over
+    deflate,
+  };
+
+  /// @brief encrypt a database snapshot with a password into a backup file
+  /// @param progress optionally told how many database bytes have been encrypted so far
+  void encrypt(std::string password, std::string metadata, std::string path_to_db, std::string path_to_dest,
+               Compression compression = Compression::none,
+               const pipeline::Progress &progress = nullptr);
+  /// @brief restore a database snapshot from a backup file. Compressed backups are detected and inflated on the fly.
+  /// @param progress optionally told how many backup bytes have been decrypted so far
+  /// @return the plaintext metadata stored with the backup
+  std::string decrypt(std::string password, std::string path_to_backup, std::string database_snapshot_destination,
+                      const pipeline::Progress &progress = nullptr);
+
+  /// @brief encrypt a database snapshot as the base of a chain of incremental backups (see pbdelta).
+  /// The chain id is kept in the header, so a restore can check every delta belongs to this base.
+  /// Such backups need a version of the app that knows about incremental backups to be restored.
+  /// @param chain CHAIN_ID_LENGTH bytes
+  void encrypt_base(std::string password, std::string metadata, std::string path_to_db, std::string path_to_dest,
+                    const unsigned char *chain, Compression compression = Compression::none,
+                    const pipeline::Progress &progress = nullptr);
+  /// @brief read the chain id from the header of a backup, without decrypting anything
+  /// @param chain receives CHAIN_ID_LENGTH bytes
+  /// @return false if the backup isn't the base of a chain
+  bool read_chain(const std::string &path_to_backup, unsigned char *chain);
+
+  /// @brief encrypt size bytes pulled from source into a backup file
+  void encrypt(std::string password, std::string metadata, const pipeline::Source &source, std::uint64_t size,
+               std::string path_to_dest, Compression compression = Compression::none,
+               const pipeline::Progress &progress = nullptr);
+  /// @brief decrypt a backup file and push the plaintext into sink instead of a file
+  /// @return the plaintext metadata stored with the backup
+  std::string decrypt(std::string password, std::string path_to_backup, const pipeline::Sink &sink,
+                      const pipeline::Progress &progress = nullptr);
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+/**
+ * A streaming pipeline that lets disk reads, crypto and disk writes overlap.
+ *
+ * Data flows from a source, through any number of stages, into a sink. Every
+ * step runs on its own thread and hands large, page aligned buffers to the
+ * next step through a bounded ring, so a slow step applies back pressure
+ * instead of letting memory grow.
+ *
+ *   source -> ring -> stage -> ring -> ... -> stage -> ring -> sink
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pipeline
+{
+  const std::size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+  const std::size_t DEFAULT_RING_SLOTS = 4;
+  /// @brief Progress is reported roughly this often, and once more at the end
+  const std::uint64_t PROGRESS_INTERVAL = 8 << 20;
+
+  /// @brief Fills buf with up to capacity bytes and returns how many it wrote. 0 means the input is exhausted.
+  typedef std::function<std::size_t(unsigned char *buf, std::size_t capacity)> Source;
+  typedef std::function<void(const unsigned char *data, std::size_t length)> Sink;
+  /// @brief Called with the number of source bytes that went into the pipeline so far and the expected total
+  typedef std::function<void(std::uint64_t processed, std::uint64_t total)> Progress;
+
+  /// @brief A page aligned buffer owned by a ring
+  struct Buffer
+  {
+    unsigned char *data;
+    std::size_t capacity;
+    std::size_t length;
+  };
+
+  /// @brief A fixed set of buffers cycling between a producer and a consumer
+  class Ring
+  {
+  public:
+    Ring(std::size_t slots, std::size_t buffer_size);
+    ~Ring();
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+
+    /// @brief producer: wait for an empty buffer. nullptr if the pipeline was cancelled.
+    Buffer *acquire();
+    /// @brief producer: hand a filled buffer to the consumer
+    void publish(Buffer *buffer);
+    /// @brief producer: there is nothing more to publish
+    void close();
+    /// @brief consumer: wait for a filled buffer. nullptr once the ring is closed and drained, or cancelled.
+    Buffer *consume();
+    /// @brief consumer: give a buffer back to the producer
+    void release(Buffer *buffer);
+    /// @brief wake everybody up and fail every further call
+    void cancel();
+
+  private:
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<Buffer> buffers;
+    std::deque<Buffer *> empty;
+    std::deque<Buffer *> filled;
+    bool closed = false;
+    bool cancelled = false;
+  };
+
+  /// @brief Output side of a stage. Collects output into ring buffers and publishes them as they fill up.
+  class Writer
+  {
+  public:
+    explicit Writer(Ring &ring) : ring(ring) {}
+    /// @brief get space for at least at_least bytes, publishing the current buffer first if it is too full
+    /// @param available set to how many bytes may be written to the returned pointer
+    unsigned char *reserve(std::size_t at_least, std::size_t &available);
+    /// @brief mark length bytes of the space from reserve as written
+    void commit(std::size_t length);
+    /// @brief copy data into the output
+    void write(const unsigned char *data, std::size_t length);
+    /// @brief publish whatever is left in the current buffer
+    void flush();
+
+  private:
+    Ring &ring;
+    Buffer *current = nullptr;
+  };
+
+  /// @brief A transformation between source and sink, like encryption
+  class Stage
+  {
+  public:
+    virtual ~Stage() = default;
+    virtual void process(const unsigned char *data, std::size_t length, Writer &out) = 0;
+    /// @brief called once after the last input, to write out anything held back
+    virtual void finish(Writer &) {}
+  };
+
+  /// @brief Run source through every stage into sink and wait for it to finish.
+  /// The first exception thrown by any step cancels the whole pipeline and is rethrown here.
+  /// @param total expected number of source bytes, only used for progress
+  void run(const Source &source,
+           const std::vector<Stage *> &stages,
+           const Sink &sink,
+           std::uint64_t total = 0,
+           const Progress &progress = nullptr,
+           std::size_t buffer_size = DEFAULT_BUFFER_SIZE);
+}
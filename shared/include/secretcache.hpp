@@ -0,0 +1,74 @@
+#pragma once
+/**
+ * A bounded cache of X25519 shared secrets.
+ *
+ * Chats derive the secret for the same pair of keys over and over. The cache
+ * remembers the most recently used secrets, keyed by a SHA-256 hash of the
+ * private and the peer public key so the keys themselves aren't kept around.
+ * Secrets are wiped as soon as they are evicted.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "x25519.hpp"
+
+namespace secretcache
+{
+  const std::size_t DEFAULT_CAPACITY = 256;
+
+  struct Stats
+  {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::size_t size = 0;
+    std::size_t capacity = 0;
+  };
+
+  class Cache
+  {
+  public:
+    explicit Cache(std::size_t capacity = DEFAULT_CAPACITY);
+    ~Cache();
+    Cache(const Cache &) = delete;
+    Cache &operator=(const Cache &) = delete;
+
+    /// @brief x25519::derive_secret, answered from the cache when possible
+    /// @param private_key PRIVATE_KEY_LENGTH bytes
+    /// @param peer_public_key PUBLIC_KEY_LENGTH bytes
+    /// @param secret_buf receives SECRET_LENGTH bytes
+    void derive(const unsigned char *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf);
+    /// @brief wipe every secret, eg. on logout
+    void clear();
+    Stats stats();
+
+  private:
+    typedef std::array<unsigned char, 32> Digest;
+    struct DigestHash
+    {
+      std::size_t operator()(const Digest &digest) const;
+    };
+    struct Entry
+    {
+      Digest id;
+      x25519::fixed_key secret;
+    };
+    // Must be called with the lock held
+    void evict_last();
+
+    std::mutex lock;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<Digest, std::list<Entry>::iterator, DigestHash> index;
+    std::size_t capacity;
+    Stats counters;
+  };
+
+  /// @brief The process-wide cache used by the native crypto module
+  Cache &shared();
+}
@@ -0,0 +1,89 @@
+#pragma once
+/**
+ * A fixed-size pool of native worker threads shared by the crypto module.
+ *
+ * Work is submitted to one of two lanes. Interactive work (something the user
+ * is waiting on, like decrypting an image that is on screen) is always picked
+ * before bulk work (backups, restores). Bulk work is never allowed to occupy
+ * every worker, so a long running backup can't hold up interactive work.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace workpool
+{
+  enum class Lane
+  {
+    interactive = 0,
+    bulk = 1,
+  };
+
+  /// @brief Counters for a single lane. Wait times are measured from submission until a worker picks the job up.
+  struct LaneStats
+  {
+    std::size_t queued = 0;
+    std::size_t running = 0;
+    std::uint64_t completed = 0;
+    std::uint64_t total_wait_us = 0;
+    std::uint64_t max_wait_us = 0;
+  };
+
+  struct Stats
+  {
+    std::size_t threads = 0;
+    LaneStats interactive;
+    LaneStats bulk;
+  };
+
+  class WorkerPool
+  {
+  public:
+    /// @brief Start a pool
+    /// @param thread_count number of workers. 0 picks one per hardware thread.
+    explicit WorkerPool(std::size_t thread_count = 0);
+    /// @brief Runs every job still queued, then stops the workers
+    ~WorkerPool();
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /// @brief Queue a job. Jobs must not throw, catch and report errors inside the job.
+    void submit(Lane lane, std::function<void()> job);
+
+    /// @brief Run body(0) ... body(count - 1) across the pool and wait for all of them.
+    /// The calling thread works through indices as well, so this is safe to call from inside a job.
+    /// The first exception thrown by body is rethrown here once every index has finished.
+    void parallel_for(Lane lane, std::size_t count, const std::function<void(std::size_t)> &body);
+
+    Stats stats();
+    std::size_t size() const { return workers.size(); }
+
+  private:
+    struct Job
+    {
+      std::function<void()> work;
+      std::chrono::steady_clock::time_point submitted;
+    };
+    void run_worker();
+    // Pick the next job a worker may run. Must be called with the lock held.
+    bool take_job(Job &job, Lane &lane);
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<Job> queues[2];
+    LaneStats lane_stats[2];
+    std::size_t max_bulk_running;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+  };
+
+  /// @brief The process-wide pool used by the native crypto module
+  WorkerPool &shared();
+}
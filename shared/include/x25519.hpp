@@ -1,12 +1,20 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <memory>
 #include <vector>
 
+typedef struct evp_pkey_st EVP_PKEY;
+
 namespace x25519
 {
   typedef std::vector<unsigned char> key;
   const unsigned int PUBLIC_KEY_LENGTH = 32;
+  const unsigned int PRIVATE_KEY_LENGTH = 32;
+  const unsigned int SECRET_LENGTH = 32;
+  /// @brief a key or shared secret that lives on the stack
+  typedef std::array<unsigned char, 32> fixed_key;
   class KeyPair
   {
   public:
@@ -23,4 +31,21 @@ namespace x25519
   };
   std::shared_ptr<KeyPair> generate_keypair();
   key derive_secret(key &private_key_bin, key &peer_public_key_bin);
+
+  /*
+   * The same without allocating key buffers, for hot paths
+   */
+
+  /// @brief generate a keypair into caller owned buffers
+  void generate_keypair(fixed_key &private_key, fixed_key &public_key);
+  /// @param private_key PRIVATE_KEY_LENGTH bytes
+  /// @param peer_public_key PUBLIC_KEY_LENGTH bytes
+  /// @param secret_buf receives SECRET_LENGTH bytes
+  void derive_secret(const unsigned char *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf);
+  /// @brief the same with a private key that was loaded before, see keystore
+  void derive_secret(EVP_PKEY *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf);
+  /// @brief derive_secret without throwing when the peer public key is unusable, like a low order point
+  /// @return false if no secret could be agreed on. Unexpected failures still throw.
+  bool try_derive_secret(const unsigned char *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf);
+  bool try_derive_secret(EVP_PKEY *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf);
 }
@@ -22,18 +22,84 @@
  * 2. A public key that the peer has authenticated as yours
  */
 
+#include <cstddef>
+#include <string>
 #include <vector>
 
+#include "decryption.hpp"
+#include "workpool.hpp"
+#include "x25519.hpp"
+
 namespace yap
 {
   namespace v1
   {
+    /// @brief ephemeral public key(32) | nonce(12) | tag(16) in front of the ciphertext
+    const std::size_t OVERHEAD = 60;
+
+    std::vector<unsigned char> encrypt(const std::vector<unsigned char> &shared_secret,
+                                       const std::vector<unsigned char> &peer_public_key,
+                                       const std::vector<unsigned char> &plaintext);
+    std::vector<unsigned char> decrypt(const std::vector<unsigned char> &shared_secret,
+                                       const std::vector<unsigned char> &private_key,
+                                       const std::vector<unsigned char> &ciphertext);
+
+    /*
+     * The same into caller owned buffers. Nothing is allocated on the heap
+     * besides what OpenSSL needs internally for the ephemeral key agreement.
+     */
+
+    /// @param out receives OVERHEAD + length bytes
+    void encrypt(const x25519::fixed_key &shared_secret,
+                 const x25519::fixed_key &peer_public_key,
+                 const unsigned char *plaintext, std::size_t length,
+                 unsigned char *out);
+    /// @param out receives length - OVERHEAD bytes. Throws if the ciphertext is too short or can't be verified.
+    /// @return the length of the plaintext
+    std::size_t decrypt(const x25519::fixed_key &shared_secret,
+                        const x25519::fixed_key &private_key,
+                        const unsigned char *ciphertext, std::size_t length,
+                        unsigned char *out);
+    /// @brief the same with a private key that was loaded before, see keystore
+    std::size_t decrypt(const x25519::fixed_key &shared_secret,
+                        EVP_PKEY *private_key,
+                        const unsigned char *ciphertext, std::size_t length,
+                        unsigned char *out);
+
+    /// @brief decrypt without throwing on messages that are malformed or don't verify
+    /// @param out receives length - OVERHEAD bytes if the status is ok
+    decryption::Status try_decrypt(const x25519::fixed_key &shared_secret,
+                                   const x25519::fixed_key &private_key,
+                                   const unsigned char *ciphertext, std::size_t length,
+                                   unsigned char *out);
+    decryption::Status try_decrypt(const x25519::fixed_key &shared_secret,
+                                   EVP_PKEY *private_key,
+                                   const unsigned char *ciphertext, std::size_t length,
+                                   unsigned char *out);
+
+    /*
+     * Batches, for catching up on a queue of messages
+     */
+
+    /// @brief A message to decrypt, encoded the way it travels through JS
+    struct EncodedMessage
+    {
+      std::string shared_secret_hex;
+      std::string private_key_hex;
+      std::string ciphertext_b64;
+    };
+
+    /// @brief The outcome for one message. error is empty if it decrypted.
+    struct Opened
+    {
+      std::string plaintext;
+      std::string error;
+      decryption::Status status = decryption::Status::ok;
+    };
 
-    std::vector<unsigned char> encrypt(std::vector<unsigned char> shared_secret,
-                                       std::vector<unsigned char> peer_public_key,
-                                       std::vector<unsigned char> plaintext);
-    std::vector<unsigned char> decrypt(std::vector<unsigned char> shared_secret,
-                                       std::vector<unsigned char> private_key,
-                                       std::vector<unsigned char> ciphertext);
+    /// @brief decrypt every message across the worker pool. A message that fails doesn't affect the others.
+    /// @return one result per message, in order
+    std::vector<Opened> decrypt_many(const std::vector<EncodedMessage> &messages,
+                                     workpool::Lane lane = workpool::Lane::interactive);
   };
 };
\ No newline at end of file
@@ -1,20 +1,175 @@
 #include "NativeCryptoModule.h"
 
-#include <future>
 #include <openssl/evp.h>
+#include <cmath>
 #include <memory>
 #include <fstream>
 
 #include "commonhash.hpp"
 #include "commonrand.hpp"
+#include "decryption.hpp"
 #include "ed25519.hpp"
 #include "x25519.hpp"
 #include "aes256.hpp"
+#include "chunkedfile.hpp"
+#include "envelope.hpp"
+#include "pbdelta.hpp"
 #include "pbencrypt.hpp"
 #include "yap.hpp"
 #include "encoders.hpp"
+#include "keystore.hpp"
+#include "mediastore.hpp"
+#include "memdecrypt.hpp"
+#include "secretcache.hpp"
+#include "workpool.hpp"
 namespace facebook::react
 {
+  namespace
+  {
+    /// @brief The longest range aes256FileReadRange decrypts in one call
+    const double MAX_RANGE_LENGTH = 16 * 1024 * 1024;
+    /// @brief Integers above this can't all be told apart as JS numbers
+    const double MAX_SAFE_INTEGER = 9007199254740991.0;
+
+    /// @brief Hands a native byte vector to JS as the backing store of an ArrayBuffer, without copying it
+    class VectorBuffer : public jsi::MutableBuffer
+    {
+    public:
+      explicit VectorBuffer(std::vector<unsigned char> &&bytes) : bytes(std::move(bytes)) {}
+      size_t size() const override { return bytes.size(); }
+      uint8_t *data() override { return bytes.data(); }
+
+    private:
+      std::vector<unsigned char> bytes;
+    };
+
+    /// @brief A borrowed view into JS owned memory. Only valid for the duration of a synchronous call.
+    struct ByteView
+    {
+      const unsigned char *data;
+      size_t size;
+    };
+
+    /// @brief View the bytes of an ArrayBuffer or a typed array (eg. Uint8Array) without copying them
+    ByteView view_bytes(jsi::Runtime &rt, const jsi::Object &object)
+    {
+      if (object.isArrayBuffer(rt))
+      {
+        auto buffer = object.getArrayBuffer(rt);
+        return {buffer.data(rt), buffer.size(rt)};
+      }
+      // Typed arrays are views into an underlying ArrayBuffer
+      auto backing = object.getProperty(rt, "buffer");
+      if (!backing.isObject() || !backing.getObject(rt).isArrayBuffer(rt))
+        throw jsi::JSError(rt, "Expected an ArrayBuffer or a Uint8Array");
+      auto buffer = backing.getObject(rt).getArrayBuffer(rt);
+      auto offset = static_cast<size_t>(object.getProperty(rt, "byteOffset").asNumber());
+      auto length = static_cast<size_t>(object.getProperty(rt, "byteLength").asNumber());
+      if (offset + length > buffer.size(rt))
+        throw jsi::JSError(rt, "Typed array is out of bounds of its buffer");
+      return {buffer.data(rt) + offset, length};
+    }
+
+    /// @brief View bytes that must be exactly length bytes long, like keys
+    ByteView view_bytes(jsi::Runtime &rt, const jsi::Object &object, size_t length, const char *what)
+    {
+      auto view = view_bytes(rt, object);
+      if (view.size != length)
+        throw jsi::JSError(rt, std::string(what) + " must be " + std::to_string(length) + " bytes long");
+      return view;
+    }
+
+    /// @brief Copy a view of exactly 32 bytes onto the stack
+    x25519::fixed_key to_fixed_key(const ByteView &view)
+    {
+      x25519::fixed_key key;
+      std::copy(view.data, view.data + key.size(), key.begin());
+      return key;
+    }
+
+    /// @brief Check that a number from JS can be a keystore handle
+    keystore::Handle to_handle(jsi::Runtime &rt, double handle)
+    {
+      if (!(handle >= 1 && handle <= UINT32_MAX) || handle != static_cast<double>(static_cast<keystore::Handle>(handle)))
+        throw jsi::JSError(rt, "Invalid key handle");
+      return static_cast<keystore::Handle>(handle);
+    }
+
+    /// @brief Check that a number from JS is a whole number of bytes, eg. a file offset or a size
+    std::uint64_t to_byte_count(jsi::Runtime &rt, double value, const char *what)
+    {
+      if (!std::isfinite(value) || value < 0 || value > MAX_SAFE_INTEGER || value != std::floor(value))
+        throw jsi::JSError(rt, std::string(what) + " must be a non-negative integer");
+      return static_cast<std::uint64_t>(value);
+    }
+
+    /// @brief Decode a hex key that must be exactly length bytes long
+    std::vector<unsigned char> key_from_hex(jsi::Runtime &rt, const std::string &hex, size_t length, const char *what)
+    {
+      if (!encoders::is_hex(hex.data(), hex.size()))
+        throw jsi::JSError(rt, std::string(what) + " must be hex encoded");
+      auto key = encoders::hex_to_binary(hex);
+      if (key.size() != length)
+        throw jsi::JSError(rt, std::string(what) + " must be " + std::to_string(length) + " bytes long");
+      return key;
+    }
+
+    /// @brief Check a file key from JS before a worker decodes it
+    void check_key_and_iv(jsi::Runtime &rt, const std::string &key_and_iv)
+    {
+      if (key_and_iv.size() != aes256::KEY_AND_IV_HEX_LENGTH || !encoders::is_hex(key_and_iv.data(), key_and_iv.size()))
+        throw jsi::JSError(rt, "The file key must be " + std::to_string(aes256::KEY_AND_IV_HEX_LENGTH) + " hex characters");
+    }
+
+    jsi::Object to_array_buffer(jsi::Runtime &rt, std::vector<unsigned char> &&bytes)
+    {
+      return jsi::ArrayBuffer(rt, std::make_shared<VectorBuffer>(std::move(bytes)));
+    }
+
+    /// @brief Forward pipeline progress to an optional JS callback. The callback is scheduled on the JS thread.
+    pipeline::Progress progress_to_js(std::optional<AsyncCallback<double, double>> on_progress)
+    {
+      if (!on_progress)
+        return nullptr;
+      return [callback = std::move(*on_progress)](std::uint64_t processed, std::uint64_t total)
+      { callback.call(static_cast<double>(processed), static_cast<double>(total)); };
+    }
+
+    /// @brief {plaintext} if status is ok, otherwise {error, code}. Same shape as the results of yapV1DecryptMany.
+    jsi::Object decryption_result(jsi::Runtime &rt, decryption::Status status, const std::string &plaintext)
+    {
+      jsi::Object result(rt);
+      if (status == decryption::Status::ok)
+      {
+        result.setProperty(rt, "plaintext", jsi::String::createFromUtf8(rt, plaintext));
+      }
+      else
+      {
+        result.setProperty(rt, "error", jsi::String::createFromUtf8(rt, decryption::describe(status)));
+        result.setProperty(rt, "code", jsi::String::createFromAscii(rt, decryption::name(status)));
+      }
+      return result;
+    }
+
+    std::size_t to_max_size(jsi::Runtime &rt, std::optional<double> max_bytes)
+    {
+      if (!max_bytes)
+        return memdecrypt::DEFAULT_MAX_SIZE;
+      return static_cast<std::size_t>(std::min<std::uint64_t>(to_byte_count(rt, *max_bytes, "The size cap"), SIZE_MAX));
+    }
+
+    NativeCryptoModule::PromiseResult resolve_undefined()
+    {
+      return [](jsi::Runtime &) -> jsi::Value
+      { return jsi::Value::undefined(); };
+    }
+
+    NativeCryptoModule::PromiseResult resolve_string(std::string value)
+    {
+      return [value = std::move(value)](jsi::Runtime &rt) -> jsi::Value
+      { return jsi::String::createFromUtf8(rt, value); };
+    }
+  }
 
   NativeCryptoModule::NativeCryptoModule(std::shared_ptr<CallInvoker> jsInvoker)
       : NativeCryptoModuleCxxSpec(std::move(jsInvoker)) {}
@@ -28,6 +183,27 @@ namespace facebook::react
   {
     return hash::hashSHA256(input);
   }
+  jsi::Array NativeCryptoModule::hashSHA256Many(jsi::Runtime &rt, jsi::Array inputs)
+  {
+    const size_t count = inputs.size(rt);
+    std::vector<std::string> to_hash;
+    to_hash.reserve(count);
+    for (size_t i = 0; i < count; i++)
+      to_hash.push_back(inputs.getValueAtIndex(rt, i).asString(rt).utf8(rt));
+    auto digests = hash::hash_many(to_hash);
+    jsi::Array results(rt, count);
+    for (size_t i = 0; i < count; i++)
+      results.setValueAtIndex(rt, i, jsi::String::createFromUtf8(rt, digests[i]));
+    return results;
+  }
+  jsi::Object NativeCryptoModule::hashSHA256File(jsi::Runtime &rt, std::string path_to_file)
+  {
+    auto hasher = [path_to_file]() -> PromiseResult
+    {
+      return resolve_string(hash::hash_file(path_to_file));
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, hasher);
+  }
 
   std::string NativeCryptoModule::randHex(jsi::Runtime &rt, double size)
   {
@@ -41,6 +217,50 @@ namespace facebook::react
   {
     return ed25519::sign_message(message, private_key);
   }
+  jsi::Array NativeCryptoModule::ed25519SignMany(jsi::Runtime &rt, jsi::Array messages, std::string private_key)
+  {
+    const size_t count = messages.size(rt);
+    std::vector<std::string> to_sign;
+    to_sign.reserve(count);
+    for (size_t i = 0; i < count; i++)
+      to_sign.push_back(messages.getValueAtIndex(rt, i).asString(rt).utf8(rt));
+    // The key is parsed once, and the JS thread helps out while the pool signs
+    auto signatures = ed25519::Signer(private_key).sign_many(to_sign);
+    jsi::Array results(rt, count);
+    for (size_t i = 0; i < count; i++)
+      results.setValueAtIndex(rt, i, jsi::String::createFromUtf8(rt, signatures[i]));
+    return results;
+  }
+  bool NativeCryptoModule::ed25519VerifyMessage(jsi::Runtime &rt, std::string message, std::string signature, std::string public_key)
+  {
+    return ed25519::verify(message, signature, public_key);
+  }
+  jsi::Object NativeCryptoModule::ed25519VerifyMany(jsi::Runtime &rt, jsi::Array messages)
+  {
+    // JS values can only be read on the JS thread
+    const size_t count = messages.size(rt);
+    std::vector<ed25519::SignedMessage> signed_messages;
+    signed_messages.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      jsi::Array triple = messages.getValueAtIndex(rt, i).asObject(rt).asArray(rt);
+      signed_messages.push_back({triple.getValueAtIndex(rt, 0).asString(rt).utf8(rt),
+                                 triple.getValueAtIndex(rt, 1).asString(rt).utf8(rt),
+                                 triple.getValueAtIndex(rt, 2).asString(rt).utf8(rt)});
+    }
+    auto verifier = [signed_messages = std::move(signed_messages)]() -> PromiseResult
+    {
+      auto valid = ed25519::verify_many(signed_messages);
+      return [valid = std::move(valid)](jsi::Runtime &rt) -> jsi::Value
+      {
+        jsi::Array results(rt, valid.size());
+        for (size_t i = 0; i < valid.size(); i++)
+          results.setValueAtIndex(rt, i, jsi::Value(static_cast<bool>(valid[i])));
+        return results;
+      };
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, verifier);
+  }
   std::string NativeCryptoModule::generateX25519Keypair(jsi::Runtime &rt)
   {
     auto keypair = x25519::generate_keypair();
@@ -50,10 +270,14 @@ namespace facebook::react
   {
     // Convert the shared secret to a hex string
 
-    auto private_key = encoders::hex_to_binary(private_key_hex);    
-    auto public_key = encoders::hex_to_binary(public_key_hex);
-    auto ss = x25519::derive_secret(private_key, public_key);
-    return encoders::binary_to_hex(ss.data(), ss.size());
+    auto private_key = key_from_hex(rt, private_key_hex, x25519::PRIVATE_KEY_LENGTH, "X25519 private key");
+    auto public_key = key_from_hex(rt, public_key_hex, x25519::PUBLIC_KEY_LENGTH, "X25519 public key");
+    x25519::fixed_key ss;
+    secretcache::shared().derive(private_key.data(), public_key.data(), ss.data());
+    std::fill(private_key.begin(), private_key.end(), 0);
+    auto ss_hex = encoders::binary_to_hex(ss.data(), ss.size());
+    std::fill(ss.begin(), ss.end(), 0);
+    return ss_hex;
   }
   std::string NativeCryptoModule::aes256Encrypt(jsi::Runtime &rt, std::string plaintext, std::string secret)
   {
@@ -63,9 +287,66 @@ namespace facebook::react
   {
     return aes256::decrypt(ciphertext, secret);
   }
+  jsi::Object NativeCryptoModule::aes256DecryptResult(jsi::Runtime &rt, std::string ciphertext, std::string secret)
+  {
+    std::string plaintext;
+    auto status = aes256::try_decrypt(ciphertext, secret, plaintext);
+    return decryption_result(rt, status, plaintext);
+  }
+  jsi::Object NativeCryptoModule::aes256EncryptMulti(jsi::Runtime &rt, std::string plaintext, jsi::Array tagged_secrets)
+  {
+    const size_t count = tagged_secrets.size(rt);
+    std::vector<std::string> tags, secrets;
+    tags.reserve(count);
+    secrets.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      jsi::Array pair = tagged_secrets.getValueAtIndex(rt, i).asObject(rt).asArray(rt);
+      tags.push_back(pair.getValueAtIndex(rt, 0).asString(rt).utf8(rt));
+      secrets.push_back(pair.getValueAtIndex(rt, 1).asString(rt).utf8(rt));
+    }
+    // The JS thread helps out while the pool encrypts, then builds the result in one go
+    auto ciphertexts = aes256::encrypt_many(plaintext, secrets);
+    jsi::Object results(rt);
+    for (size_t i = 0; i < count; i++)
+      results.setProperty(rt, tags[i].c_str(), jsi::String::createFromUtf8(rt, ciphertexts[i]));
+    return results;
+  }
+  jsi::Object NativeCryptoModule::envelopeSeal(jsi::Runtime &rt, std::string plaintext, jsi::Array tagged_secrets)
+  {
+    const size_t count = tagged_secrets.size(rt);
+    std::vector<std::string> tags, secrets;
+    tags.reserve(count);
+    secrets.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      jsi::Array pair = tagged_secrets.getValueAtIndex(rt, i).asObject(rt).asArray(rt);
+      tags.push_back(pair.getValueAtIndex(rt, 0).asString(rt).utf8(rt));
+      secrets.push_back(pair.getValueAtIndex(rt, 1).asString(rt).utf8(rt));
+    }
+    std::vector<std::string> wrapped_keys;
+    std::string payload = envelope::seal(plaintext, secrets, wrapped_keys);
+    jsi::Object keys(rt);
+    for (size_t i = 0; i < count; i++)
+      keys.setProperty(rt, tags[i].c_str(), jsi::String::createFromUtf8(rt, wrapped_keys[i]));
+    jsi::Object result(rt);
+    result.setProperty(rt, "payload", jsi::String::createFromUtf8(rt, payload));
+    result.setProperty(rt, "keys", keys);
+    return result;
+  }
+  std::string NativeCryptoModule::envelopeOpen(jsi::Runtime &rt, std::string payload, std::string wrapped_key, std::string secret)
+  {
+    return envelope::open(payload, wrapped_key, secret);
+  }
+  jsi::Object NativeCryptoModule::envelopeOpenResult(jsi::Runtime &rt, std::string payload, std::string wrapped_key, std::string secret)
+  {
+    std::string plaintext;
+    auto status = envelope::try_open(payload, wrapped_key, secret, plaintext);
+    return decryption_result(rt, status, plaintext);
+  }
   jsi::Object NativeCryptoModule::aes256FileEncrypt(jsi::Runtime &rt, std::string path_to_input, std::string path_to_output)
   {
-    auto encryptor = [path_to_input, path_to_output, &rt]() -> jsi::Value
+    auto encryptor = [path_to_input, path_to_output]() -> PromiseResult
     {
       unsigned char key[EVP_MAX_KEY_LENGTH];
       unsigned char iv[EVP_MAX_IV_LENGTH];
@@ -81,22 +362,88 @@ namespace facebook::react
         in_file.close();
         throw std::runtime_error("Outputfile for encryption could not be opened.");
       }
-      aes256::encrypt_file(in_file, out_file, key, iv);
+      aes256::FileDigests digests;
+      aes256::encrypt_file(in_file, out_file, key, iv, digests);
       in_file.close();
       out_file.close();
-      return jsi::String::createFromUtf8(rt, aes256::combine_key_and_iv(key, iv));
+      std::string key_and_iv = aes256::combine_key_and_iv(key, iv);
+      std::string plaintext_digest = encoders::binary_to_hex(digests.plaintext.data(), digests.plaintext.size());
+      std::string ciphertext_digest = encoders::binary_to_hex(digests.ciphertext.data(), digests.ciphertext.size());
+      return [key_and_iv, plaintext_digest, ciphertext_digest](jsi::Runtime &rt) -> jsi::Value
+      {
+        jsi::Object result(rt);
+        result.setProperty(rt, "key", jsi::String::createFromAscii(rt, key_and_iv));
+        result.setProperty(rt, "plaintextDigest", jsi::String::createFromAscii(rt, plaintext_digest));
+        result.setProperty(rt, "ciphertextDigest", jsi::String::createFromAscii(rt, ciphertext_digest));
+        return result;
+      };
     };
-    return NativeCryptoModule::make_promise(rt, encryptor);
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, encryptor);
+  }
+
+  jsi::Object NativeCryptoModule::aes256FileEncryptV2(jsi::Runtime &rt, std::string path_to_input, std::string path_to_output)
+  {
+    auto encryptor = [path_to_input, path_to_output]() -> PromiseResult
+    {
+      unsigned char key[EVP_MAX_KEY_LENGTH];
+      unsigned char iv[EVP_MAX_IV_LENGTH];
+      aes256::generate_random_key(key);
+      aes256::generate_random_iv(iv);
+      chunkedfile::encrypt_file(path_to_input, path_to_output, key, iv);
+      return resolve_string(aes256::combine_key_and_iv(key, iv));
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, encryptor);
+  }
+
+  jsi::Object NativeCryptoModule::aes256FileReadRange(jsi::Runtime &rt, std::string path_to_input, std::string key_and_iv, double offset, double length)
+  {
+    std::uint64_t first = to_byte_count(rt, offset, "The range offset");
+    std::uint64_t count = to_byte_count(rt, length, "The range length");
+    // The whole range is decrypted into one buffer, so read long files piece by piece
+    if (length > MAX_RANGE_LENGTH)
+      throw jsi::JSError(rt, "Range reads are limited to " + std::to_string(static_cast<std::uint64_t>(MAX_RANGE_LENGTH)) + " bytes");
+    check_key_and_iv(rt, key_and_iv);
+    auto reader = [path_to_input, key_and_iv, first, count]() -> PromiseResult
+    {
+      std::string key_bin;
+      std::string iv_bin;
+      aes256::split_key_and_iv(key_and_iv, key_bin, iv_bin);
+      chunkedfile::Reader file(path_to_input,
+                               reinterpret_cast<const unsigned char *>(key_bin.data()),
+                               reinterpret_cast<const unsigned char *>(iv_bin.data()));
+      // std::function needs to be copyable, so the bytes live behind a shared pointer until JS picks them up
+      auto bytes = std::make_shared<std::vector<unsigned char>>(
+          file.read(first, static_cast<std::size_t>(count)));
+      double total_size = static_cast<double>(file.size());
+      return [bytes, total_size](jsi::Runtime &rt) -> jsi::Value
+      {
+        jsi::Object result(rt);
+        result.setProperty(rt, "bytes", to_array_buffer(rt, std::move(*bytes)));
+        result.setProperty(rt, "totalSize", total_size);
+        return result;
+      };
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, reader);
   }
 
   jsi::Object NativeCryptoModule::aes256FileDecrypt(jsi::Runtime &rt, std::string path_to_input, std::string path_to_output, std::string key_and_iv)
   {
+    check_key_and_iv(rt, key_and_iv);
     auto encryptor = [path_to_input,
                       path_to_output,
-                      key_and_iv]() -> jsi::Value
+                      key_and_iv]() -> PromiseResult
     {
       std::string key_bin;
       std::string iv_bin;
+      aes256::split_key_and_iv(key_and_iv, key_bin, iv_bin);
+      // Version 2 files announce themselves with a header, anything else is a version 1 CBC stream
+      if (chunkedfile::is_chunked(path_to_input))
+      {
+        chunkedfile::decrypt_file(path_to_input, path_to_output,
+                                  reinterpret_cast<const unsigned char *>(key_bin.data()),
+                                  reinterpret_cast<const unsigned char *>(iv_bin.data()));
+        return resolve_undefined();
+      }
       std::ifstream in_stream(path_to_input, std::ios::binary);
       if (!in_stream.is_open())
         throw std::runtime_error("Could not open input file for decryption");
@@ -107,36 +454,122 @@ namespace facebook::react
         in_stream.close();
         throw std::runtime_error("Could not open output file for decryption");
       }
-      aes256::split_key_and_iv(key_and_iv, key_bin, iv_bin);
       aes256::decrypt_file(in_stream, out_stream, key_bin, iv_bin);
       out_stream.close();
       in_stream.close();
-      return jsi::Value::undefined();
+      return resolve_undefined();
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, encryptor);
+  }
+
+  jsi::Object NativeCryptoModule::aes256FileDecryptToMemory(jsi::Runtime &rt, std::string path_to_input, std::string key_and_iv, std::optional<double> max_bytes)
+  {
+    std::size_t max_size = to_max_size(rt, max_bytes);
+    check_key_and_iv(rt, key_and_iv);
+    auto decryptor = [path_to_input, key_and_iv, max_size]() -> PromiseResult
+    {
+      // std::function needs to be copyable, so the bytes live behind a shared pointer until JS picks them up
+      auto bytes = std::make_shared<std::vector<unsigned char>>(memdecrypt::decrypt_file(path_to_input, key_and_iv, max_size));
+      return [bytes](jsi::Runtime &rt) -> jsi::Value
+      { return to_array_buffer(rt, std::move(*bytes)); };
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, decryptor);
+  }
+
+  jsi::Object NativeCryptoModule::aes256FileDecryptManyToMemory(jsi::Runtime &rt, jsi::Array files, std::optional<double> max_bytes)
+  {
+    std::size_t max_size = to_max_size(rt, max_bytes);
+    // JS values can only be read on the JS thread
+    const size_t count = files.size(rt);
+    std::vector<memdecrypt::File> to_decrypt;
+    to_decrypt.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      jsi::Array file = files.getValueAtIndex(rt, i).asObject(rt).asArray(rt);
+      to_decrypt.push_back({file.getValueAtIndex(rt, 0).asString(rt).utf8(rt),
+                            file.getValueAtIndex(rt, 1).asString(rt).utf8(rt)});
+    }
+    auto decryptor = [to_decrypt = std::move(to_decrypt), max_size]() -> PromiseResult
+    {
+      auto decrypted = std::make_shared<std::vector<memdecrypt::Decrypted>>(memdecrypt::decrypt_many(to_decrypt, max_size));
+      return [decrypted](jsi::Runtime &rt) -> jsi::Value
+      {
+        jsi::Array results(rt, decrypted->size());
+        for (size_t i = 0; i < decrypted->size(); i++)
+        {
+          auto &one = (*decrypted)[i];
+          jsi::Object result(rt);
+          if (one.error.empty())
+            result.setProperty(rt, "bytes", to_array_buffer(rt, std::move(one.plaintext)));
+          else
+            result.setProperty(rt, "error", jsi::String::createFromUtf8(rt, one.error));
+          results.setValueAtIndex(rt, i, std::move(result));
+        }
+        return results;
+      };
     };
-    return NativeCryptoModule::make_promise(rt, encryptor);
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, decryptor);
   }
 
-  jsi::Object NativeCryptoModule::pbEncrypt(jsi::Runtime &rt, std::string password, std::string metadata, std::string path_to_db, std::string path_to_destination)
+  jsi::Object NativeCryptoModule::pbEncrypt(jsi::Runtime &rt, std::string password, std::string metadata, std::string path_to_db, std::string path_to_destination, std::optional<bool> compress, std::optional<AsyncCallback<double, double>> on_progress)
   {
-    auto encryptor = [password, metadata, path_to_db, path_to_destination]() -> jsi::Value
+    auto compression = compress.value_or(false) ? pbencrypt::Compression::deflate : pbencrypt::Compression::none;
+    auto progress = progress_to_js(std::move(on_progress));
+    auto encryptor = [password, metadata, path_to_db, path_to_destination, compression, progress]() -> PromiseResult
     {
-      pbencrypt::encrypt(password, metadata, path_to_db, path_to_destination);
-      return jsi::Value::undefined();
+      pbencrypt::encrypt(password, metadata, path_to_db, path_to_destination, compression, progress);
+      return resolve_undefined();
     };
-    return NativeCryptoModule::make_promise(rt, encryptor);
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::bulk, encryptor);
   }
 
-  jsi::Object NativeCryptoModule::pbDecrypt(jsi::Runtime &rt, std::string password, std::string path_to_backup, std::string path_to_db_destination)
+  jsi::Object NativeCryptoModule::pbDecrypt(jsi::Runtime &rt, std::string password, std::string path_to_backup, std::string path_to_db_destination, std::optional<AsyncCallback<double, double>> on_progress)
   {
+    auto progress = progress_to_js(std::move(on_progress));
     auto decryptor = [password,
                       path_to_backup,
                       path_to_db_destination,
-                      &rt]() -> jsi::Value
+                      progress]() -> PromiseResult
+    {
+      std::string plaintext_metadata = pbencrypt::decrypt(password, path_to_backup, path_to_db_destination, progress);
+      return resolve_string(plaintext_metadata);
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::bulk, decryptor);
+  }
+
+  jsi::Object NativeCryptoModule::pbEncryptBase(jsi::Runtime &rt, std::string password, std::string metadata, std::string path_to_db, std::string path_to_destination, std::string path_to_manifest, std::optional<AsyncCallback<double, double>> on_progress)
+  {
+    auto progress = progress_to_js(std::move(on_progress));
+    auto encryptor = [password, metadata, path_to_db, path_to_destination, path_to_manifest, progress]() -> PromiseResult
+    {
+      pbdelta::encrypt_base(password, metadata, path_to_db, path_to_destination, path_to_manifest, progress);
+      return resolve_undefined();
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::bulk, encryptor);
+  }
+
+  jsi::Object NativeCryptoModule::pbEncryptDelta(jsi::Runtime &rt, std::string password, std::string metadata, std::string path_to_db, std::string path_to_manifest, std::string path_to_destination, std::string path_to_next_manifest)
+  {
+    auto encryptor = [password, metadata, path_to_db, path_to_manifest, path_to_destination, path_to_next_manifest]() -> PromiseResult
+    {
+      double changed = pbdelta::encrypt(password, metadata, path_to_db, path_to_manifest, path_to_destination, path_to_next_manifest);
+      return [changed](jsi::Runtime &rt) -> jsi::Value
+      { return jsi::Value(changed); };
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::bulk, encryptor);
+  }
+
+  jsi::Object NativeCryptoModule::pbRestoreIncremental(jsi::Runtime &rt, std::string password, std::string path_to_base, jsi::Array paths_to_deltas, std::string path_to_db_destination)
+  {
+    // JS values can only be read on the JS thread
+    std::vector<std::string> deltas;
+    for (size_t i = 0; i < paths_to_deltas.size(rt); i++)
+      deltas.push_back(paths_to_deltas.getValueAtIndex(rt, i).asString(rt).utf8(rt));
+    auto restorer = [password, path_to_base, deltas, path_to_db_destination]() -> PromiseResult
     {
-      std::string plaintext_metadata = pbencrypt::decrypt(password, path_to_backup, path_to_db_destination);
-      return jsi::String::createFromUtf8(rt, std::string(plaintext_metadata));
+      return resolve_string(pbdelta::restore(password, path_to_base, deltas, path_to_db_destination));
     };
-    return NativeCryptoModule::make_promise(rt, decryptor);
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::bulk, restorer);
   }
 
   std::string NativeCryptoModule::yapV1Encrypt(jsi::Runtime &rt, std::string shared_secret_hex, std::string peer_public_key_hex, std::string plaintext)
@@ -144,16 +577,285 @@ namespace facebook::react
     auto ss = encoders::hex_to_binary(shared_secret_hex);
     auto peer_public_key = encoders::hex_to_binary(peer_public_key_hex);
     auto plaintext_data = std::vector<unsigned char>(plaintext.begin(), plaintext.end());
-    auto encapsulated_ct = yap::v1::encrypt(ss, peer_public_key, plaintext_data);
-
     auto ct = yap::v1::encrypt(ss, peer_public_key, plaintext_data);
     return encoders::base64_encode(ct);
   }
-  std::string NativeCryptoModule::yapV1Decrypt(jsi::Runtime &rt, std::string shared_secret_hex, std::string private_key_hex, std::string plaintext)
+  std::string NativeCryptoModule::yapV1Decrypt(jsi::Runtime &rt, std::string shared_secret_hex, std::string private_key_hex, std::string ciphertext)
+  {
+    auto opened = yap::v1::decrypt_many({{shared_secret_hex, private_key_hex, ciphertext}});
+    return opened[0].error.empty() ? opened[0].plaintext : "error";
+  }
+  jsi::Object NativeCryptoModule::yapV1DecryptResult(jsi::Runtime &rt, std::string shared_secret_hex, std::string private_key_hex, std::string ciphertext)
+  {
+    auto opened = yap::v1::decrypt_many({{shared_secret_hex, private_key_hex, ciphertext}});
+    return decryption_result(rt, opened[0].status, opened[0].plaintext);
+  }
+  jsi::Object NativeCryptoModule::yapV1DecryptMany(jsi::Runtime &rt, jsi::Array messages)
+  {
+    // JS values can only be read on the JS thread
+    const size_t count = messages.size(rt);
+    std::vector<yap::v1::EncodedMessage> encoded;
+    encoded.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      jsi::Array message = messages.getValueAtIndex(rt, i).asObject(rt).asArray(rt);
+      encoded.push_back({message.getValueAtIndex(rt, 0).asString(rt).utf8(rt),
+                         message.getValueAtIndex(rt, 1).asString(rt).utf8(rt),
+                         message.getValueAtIndex(rt, 2).asString(rt).utf8(rt)});
+    }
+    auto decryptor = [encoded = std::move(encoded)]() -> PromiseResult
+    {
+      auto opened = std::make_shared<std::vector<yap::v1::Opened>>(yap::v1::decrypt_many(encoded));
+      return [opened](jsi::Runtime &rt) -> jsi::Value
+      {
+        jsi::Array results(rt, opened->size());
+        for (size_t i = 0; i < opened->size(); i++)
+        {
+          auto &one = (*opened)[i];
+          results.setValueAtIndex(rt, i, decryption_result(rt, one.status, one.plaintext));
+        }
+        return results;
+      };
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, decryptor);
+  }
+  jsi::Object NativeCryptoModule::deriveX25519SecretBytes(jsi::Runtime &rt, jsi::Object private_key, jsi::Object public_key)
+  {
+    auto private_key_view = view_bytes(rt, private_key, x25519::PRIVATE_KEY_LENGTH, "X25519 private key");
+    auto public_key_view = view_bytes(rt, public_key, x25519::PUBLIC_KEY_LENGTH, "X25519 public key");
+    std::vector<unsigned char> ss(x25519::SECRET_LENGTH);
+    secretcache::shared().derive(private_key_view.data, public_key_view.data, ss.data());
+    return to_array_buffer(rt, std::move(ss));
+  }
+  jsi::Object NativeCryptoModule::aes256EncryptBytes(jsi::Runtime &rt, jsi::Object plaintext, jsi::Object secret)
+  {
+    auto plaintext_view = view_bytes(rt, plaintext);
+    auto secret_view = view_bytes(rt, secret, aes256::KEY_LENGTH, "AES-256 secret");
+    return to_array_buffer(rt, aes256::encrypt(plaintext_view.data, plaintext_view.size, secret_view.data));
+  }
+  jsi::Object NativeCryptoModule::aes256DecryptBytes(jsi::Runtime &rt, jsi::Object ciphertext, jsi::Object secret)
+  {
+    auto ciphertext_view = view_bytes(rt, ciphertext);
+    auto secret_view = view_bytes(rt, secret, aes256::KEY_LENGTH, "AES-256 secret");
+    std::vector<unsigned char> plaintext;
+    auto status = aes256::try_decrypt(ciphertext_view.data, ciphertext_view.size, secret_view.data, plaintext);
+    if (status != decryption::Status::ok)
+      throw jsi::JSError(rt, decryption::describe(status));
+    return to_array_buffer(rt, std::move(plaintext));
+  }
+  jsi::Object NativeCryptoModule::yapV1EncryptBytes(jsi::Runtime &rt, jsi::Object shared_secret, jsi::Object peer_public_key, jsi::Object plaintext)
+  {
+    auto ss_view = view_bytes(rt, shared_secret, x25519::SECRET_LENGTH, "YAP shared secret");
+    auto peer_public_key_view = view_bytes(rt, peer_public_key, x25519::PUBLIC_KEY_LENGTH, "YAP peer public key");
+    auto plaintext_view = view_bytes(rt, plaintext);
+    auto ss = to_fixed_key(ss_view);
+    std::vector<unsigned char> ct(yap::v1::OVERHEAD + plaintext_view.size);
+    yap::v1::encrypt(ss, to_fixed_key(peer_public_key_view), plaintext_view.data, plaintext_view.size, ct.data());
+    std::fill(ss.begin(), ss.end(), 0);
+    return to_array_buffer(rt, std::move(ct));
+  }
+  jsi::Object NativeCryptoModule::yapV1DecryptBytes(jsi::Runtime &rt, jsi::Object shared_secret, jsi::Object private_key, jsi::Object ciphertext)
   {
-    return std::string();
+    auto ss_view = view_bytes(rt, shared_secret, x25519::SECRET_LENGTH, "YAP shared secret");
+    auto private_key_view = view_bytes(rt, private_key, x25519::PRIVATE_KEY_LENGTH, "X25519 private key");
+    auto ciphertext_view = view_bytes(rt, ciphertext);
+    if (ciphertext_view.size < yap::v1::OVERHEAD)
+      throw jsi::JSError(rt, "YAP ciphertext is too short to contain its header");
+    auto ss = to_fixed_key(ss_view);
+    auto private_key_bin = to_fixed_key(private_key_view);
+    std::vector<unsigned char> pt(ciphertext_view.size - yap::v1::OVERHEAD);
+    decryption::Status status;
+    try
+    {
+      status = yap::v1::try_decrypt(ss, private_key_bin, ciphertext_view.data, ciphertext_view.size, pt.data());
+    }
+    catch (...)
+    {
+      std::fill(ss.begin(), ss.end(), 0);
+      std::fill(private_key_bin.begin(), private_key_bin.end(), 0);
+      throw;
+    }
+    std::fill(ss.begin(), ss.end(), 0);
+    std::fill(private_key_bin.begin(), private_key_bin.end(), 0);
+    if (status != decryption::Status::ok)
+      throw jsi::JSError(rt, decryption::describe(status));
+    return to_array_buffer(rt, std::move(pt));
   }
-  jsi::Object NativeCryptoModule::make_promise(jsi::Runtime &rt, std::function<jsi::Value()> func)
+
+  double NativeCryptoModule::keystoreAddSecret(jsi::Runtime &rt, std::string secret_hex)
+  {
+    // Secrets come in several lengths, but never empty or with half a byte
+    if (secret_hex.empty() || secret_hex.size() % 2 != 0 || !encoders::is_hex(secret_hex.data(), secret_hex.size()))
+      throw jsi::JSError(rt, "Secrets must be a non-empty hex string of whole bytes");
+    auto secret = encoders::hex_to_binary(secret_hex);
+    auto handle = keystore::add_secret(secret.data(), secret.size());
+    std::fill(secret.begin(), secret.end(), 0);
+    return handle;
+  }
+  double NativeCryptoModule::keystoreAddX25519PrivateKey(jsi::Runtime &rt, std::string private_key_hex)
+  {
+    auto private_key = key_from_hex(rt, private_key_hex, x25519::PRIVATE_KEY_LENGTH, "X25519 private key");
+    auto handle = keystore::add_x25519_private_key(private_key.data());
+    std::fill(private_key.begin(), private_key.end(), 0);
+    return handle;
+  }
+  jsi::Object NativeCryptoModule::keystoreGenerateX25519(jsi::Runtime &rt)
+  {
+    x25519::fixed_key public_key;
+    auto handle = keystore::generate_x25519(public_key);
+    jsi::Object result(rt);
+    result.setProperty(rt, "handle", static_cast<double>(handle));
+    result.setProperty(rt, "publicKey", jsi::String::createFromUtf8(rt, encoders::binary_to_hex(public_key.data(), public_key.size())));
+    return result;
+  }
+  double NativeCryptoModule::keystoreDeriveX25519Secret(jsi::Runtime &rt, double private_key, std::string peer_public_key_hex)
+  {
+    auto peer_public_key = key_from_hex(rt, peer_public_key_hex, x25519::PUBLIC_KEY_LENGTH, "X25519 public key");
+    return keystore::derive_x25519_secret(to_handle(rt, private_key), peer_public_key.data());
+  }
+  void NativeCryptoModule::keystoreRemove(jsi::Runtime &rt, double handle)
+  {
+    keystore::remove(to_handle(rt, handle));
+  }
+  void NativeCryptoModule::keystoreClear(jsi::Runtime &rt)
+  {
+    keystore::clear();
+  }
+  std::string NativeCryptoModule::aes256EncryptWithKey(jsi::Runtime &rt, std::string plaintext, double secret)
+  {
+    auto key = keystore::get(to_handle(rt, secret), keystore::Kind::secret);
+    // Longer keys have always been accepted, only the first 32 bytes are used
+    if (key->size() < aes256::KEY_LENGTH)
+      throw jsi::JSError(rt, "aes256 keys must be at least 32 bytes long");
+    auto iv_ciphertext = aes256::encrypt(reinterpret_cast<const unsigned char *>(plaintext.data()), plaintext.size(), key->data());
+    return encoders::base64_encode(iv_ciphertext);
+  }
+  std::string NativeCryptoModule::aes256DecryptWithKey(jsi::Runtime &rt, std::string ciphertext, double secret)
+  {
+    auto key = keystore::get(to_handle(rt, secret), keystore::Kind::secret);
+    if (key->size() < aes256::KEY_LENGTH)
+      throw jsi::JSError(rt, "aes256 keys must be at least 32 bytes long");
+    auto iv_ciphertext = encoders::base64_decode(ciphertext);
+    std::vector<unsigned char> plaintext;
+    if (aes256::try_decrypt(iv_ciphertext.data(), iv_ciphertext.size(), key->data(), plaintext) != decryption::Status::ok)
+      return "error";
+    return std::string(plaintext.begin(), plaintext.end());
+  }
+  std::string NativeCryptoModule::yapV1EncryptWithKey(jsi::Runtime &rt, double shared_secret, std::string peer_public_key_hex, std::string plaintext)
+  {
+    auto key = keystore::get(to_handle(rt, shared_secret), keystore::Kind::secret);
+    if (key->size() != x25519::SECRET_LENGTH)
+      throw jsi::JSError(rt, "YAP shared secret must be 32 bytes long");
+    auto peer_public_key = key_from_hex(rt, peer_public_key_hex, x25519::PUBLIC_KEY_LENGTH, "YAP peer public key");
+    x25519::fixed_key ss, peer;
+    std::copy(key->data(), key->data() + ss.size(), ss.begin());
+    std::copy(peer_public_key.begin(), peer_public_key.end(), peer.begin());
+    std::vector<unsigned char> ct(yap::v1::OVERHEAD + plaintext.size());
+    yap::v1::encrypt(ss, peer, reinterpret_cast<const unsigned char *>(plaintext.data()), plaintext.size(), ct.data());
+    std::fill(ss.begin(), ss.end(), 0);
+    return encoders::base64_encode(ct);
+  }
+  std::string NativeCryptoModule::yapV1DecryptWithKey(jsi::Runtime &rt, double shared_secret, double private_key, std::string ciphertext)
+  {
+    auto ss_key = keystore::get(to_handle(rt, shared_secret), keystore::Kind::secret);
+    auto private_key_entry = keystore::get(to_handle(rt, private_key), keystore::Kind::x25519_private_key);
+    if (ss_key->size() != x25519::SECRET_LENGTH)
+      throw jsi::JSError(rt, "YAP shared secret must be 32 bytes long");
+    x25519::fixed_key ss;
+    std::copy(ss_key->data(), ss_key->data() + ss.size(), ss.begin());
+    std::string plaintext;
+    auto ct = encoders::base64_decode(ciphertext);
+    auto status = decryption::Status::malformed;
+    if (ct.size() >= yap::v1::OVERHEAD)
+    {
+      plaintext.resize(ct.size() - yap::v1::OVERHEAD);
+      status = yap::v1::try_decrypt(ss, private_key_entry->pkey(), ct.data(), ct.size(), reinterpret_cast<unsigned char *>(&plaintext[0]));
+    }
+    std::fill(ss.begin(), ss.end(), 0);
+    return status == decryption::Status::ok ? plaintext : "error";
+  }
+
+  jsi::Object NativeCryptoModule::secretCacheStats(jsi::Runtime &rt)
+  {
+    auto stats = secretcache::shared().stats();
+    jsi::Object result(rt);
+    result.setProperty(rt, "hits", static_cast<double>(stats.hits));
+    result.setProperty(rt, "misses", static_cast<double>(stats.misses));
+    result.setProperty(rt, "evictions", static_cast<double>(stats.evictions));
+    result.setProperty(rt, "size", static_cast<double>(stats.size));
+    result.setProperty(rt, "capacity", static_cast<double>(stats.capacity));
+    return result;
+  }
+  void NativeCryptoModule::secretCacheClear(jsi::Runtime &rt)
+  {
+    secretcache::shared().clear();
+  }
+
+  void NativeCryptoModule::mediaStoreOpen(jsi::Runtime &rt, std::string directory, double budget_bytes)
+  {
+    if (!(budget_bytes >= 0))
+      throw jsi::JSError(rt, "The media store budget must not be negative");
+    mediastore::open(directory, static_cast<std::uint64_t>(budget_bytes));
+  }
+  jsi::Object NativeCryptoModule::mediaStorePut(jsi::Runtime &rt, std::string path_to_input)
+  {
+    auto putter = [path_to_input]() -> PromiseResult
+    {
+      auto stored = std::make_shared<mediastore::Stored>(mediastore::shared().put(path_to_input));
+      return [stored](jsi::Runtime &rt) -> jsi::Value
+      {
+        jsi::Object result(rt);
+        result.setProperty(rt, "key", jsi::String::createFromAscii(rt, stored->key_and_iv));
+        result.setProperty(rt, "path", jsi::String::createFromUtf8(rt, stored->path));
+        result.setProperty(rt, "digest", jsi::String::createFromAscii(rt, stored->digest));
+        result.setProperty(rt, "hit", stored->hit);
+        return result;
+      };
+    };
+    return NativeCryptoModule::make_promise(rt, workpool::Lane::interactive, putter);
+  }
+  void NativeCryptoModule::mediaStoreRelease(jsi::Runtime &rt, std::string digest)
+  {
+    mediastore::shared().release(digest);
+  }
+  jsi::Object NativeCryptoModule::mediaStoreStats(jsi::Runtime &rt)
+  {
+    auto stats = mediastore::shared().stats();
+    jsi::Object result(rt);
+    result.setProperty(rt, "hits", static_cast<double>(stats.hits));
+    result.setProperty(rt, "misses", static_cast<double>(stats.misses));
+    result.setProperty(rt, "evictions", static_cast<double>(stats.evictions));
+    result.setProperty(rt, "entries", static_cast<double>(stats.entries));
+    result.setProperty(rt, "bytes", static_cast<double>(stats.bytes));
+    result.setProperty(rt, "budget", static_cast<double>(stats.budget));
+    return result;
+  }
+  void NativeCryptoModule::mediaStoreClear(jsi::Runtime &rt)
+  {
+    mediastore::shared().clear();
+  }
+
+  jsi::Object NativeCryptoModule::workerPoolStats(jsi::Runtime &rt)
+  {
+    auto stats = workpool::shared().stats();
+    auto lane_to_object = [&rt](const workpool::LaneStats &lane)
+    {
+      jsi::Object lane_obj(rt);
+      lane_obj.setProperty(rt, "queued", static_cast<double>(lane.queued));
+      lane_obj.setProperty(rt, "running", static_cast<double>(lane.running));
+      lane_obj.setProperty(rt, "completed", static_cast<double>(lane.completed));
+      lane_obj.setProperty(rt, "totalWaitMicros", static_cast<double>(lane.total_wait_us));
+      lane_obj.setProperty(rt, "maxWaitMicros", static_cast<double>(lane.max_wait_us));
+      return lane_obj;
+    };
+    jsi::Object result(rt);
+    result.setProperty(rt, "threads", static_cast<double>(stats.threads));
+    result.setProperty(rt, "interactive", lane_to_object(stats.interactive));
+    result.setProperty(rt, "bulk", lane_to_object(stats.bulk));
+    return result;
+  }
+
+  jsi::Object NativeCryptoModule::make_promise(jsi::Runtime &rt, workpool::Lane lane, std::function<PromiseResult()> func)
   {
     auto jsThreadInvoker = this->jsInvoker_;
     // Get the constructor for a JS promise.
@@ -163,7 +865,7 @@ namespace facebook::react
         rt,
         jsi::PropNameID::forAscii(rt, "executor"),
         2, // resolve and reject
-        [func, jsThreadInvoker](
+        [func, jsThreadInvoker, lane](
             jsi::Runtime &rt,
             const jsi::Value &thisVal,
             const jsi::Value *args,
@@ -178,34 +880,36 @@ namespace facebook::react
           {
             try
             {
-              // Resolve the promise with the result
-              auto result = std::make_shared<jsi::Value>(func());
+              // Do the work here, but only turn the result into a JS value on the JS thread
+              PromiseResult result = func();
               // Resolve back on the JS thread that can access the runtime safely
               jsThreadInvoker->invokeAsync([=](jsi::Runtime &rt)
-                                           { resolve->call(rt, std::move(*result.get())); });
+                                           { resolve->call(rt, result(rt)); });
             }
-            catch (const std::runtime_error &e)
+            catch (const std::exception &e)
             {
+              // Pool jobs must not throw, so anything that goes wrong ends up rejecting the promise
+              std::string message = e.what();
               // Reject back on the JS thread that can access the runtime safely
               jsThreadInvoker->invokeAsync([=](jsi::Runtime &rt)
                                            {
 
               // Repare an error to reject with
               jsi::Object errorObj(rt);
-              errorObj.setProperty(rt, "message", jsi::String::createFromUtf8(rt, e.what()));
+              errorObj.setProperty(rt, "message", jsi::String::createFromUtf8(rt, message));
               errorObj.setProperty(rt, "code", jsi::String::createFromUtf8(rt, "ERR_NATIVE_ERROR"));
 
               jsi::Function errorConstructor = rt.global().getPropertyAsFunction(rt, "Error");
               jsi::Value errorValue = errorConstructor.callAsConstructor(
                   rt,
-                  jsi::String::createFromUtf8(rt, e.what()));
+                  jsi::String::createFromUtf8(rt, message));
 
               reject->call(rt, errorValue); });
             }
           };
 
-          // Asynchronously dispatch the call to do the work. Don't worry, we'll be back on this thread soon enough to resolve or reject.
-          [[maybe_unused]] std::future fut = std::async(std::launch::async, worker);
+          // Queue the work on the shared worker pool. Don't worry, we'll be back on this thread soon enough to resolve or reject.
+          workpool::shared().submit(lane, worker);
           // The executor returns nothing in JS, but don't worry, promise chaining should still work with resolve or reject.
           return jsi::Value::undefined();
         });
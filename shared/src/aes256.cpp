@@ -1,25 +1,24 @@
 #include "aes256.hpp"
 
+#include "cipherpool.hpp"
+#include "commonhash.hpp"
+#include "commonrand.hpp"
 #include "encoders.hpp"
+#include <cstring>
 #include <fstream>
 #include <openssl/evp.h>
-#include <openssl/rand.h>
+
+#define MANY_PARALLEL_THRESHOLD (16 * 1024)
+#define FILE_BUFFER_SIZE (64 * 1024)
 
 void aes256::generate_random_key(unsigned char *buffer)
 {
-  if (RAND_bytes(buffer, EVP_MAX_KEY_LENGTH) != 1)
-  {
-    throw std::runtime_error(
-        "Could not generate a random key for aes256 encryption");
-  }
+  commonrand::bytes(buffer, EVP_MAX_KEY_LENGTH);
 }
 
 void aes256::generate_random_iv(unsigned char *buffer)
 {
-  if (-1 == RAND_bytes(buffer, EVP_MAX_IV_LENGTH))
-  {
-    throw std::runtime_error("Could not generate an iv for aes256 encryption");
-  }
+  commonrand::bytes(buffer, EVP_MAX_IV_LENGTH);
 }
 
 std::string aes256::combine_key_and_iv(unsigned char *key, unsigned char *iv)
@@ -32,6 +31,8 @@ std::string aes256::combine_key_and_iv(unsigned char *key, unsigned char *iv)
 void aes256::split_key_and_iv(std::string key_and_iv, std::string &key_buf,
                               std::string &iv_buf)
 {
+  if (key_and_iv.size() != KEY_AND_IV_HEX_LENGTH || !encoders::is_hex(key_and_iv.data(), key_and_iv.size()))
+    throw std::runtime_error("The file key must be " + std::to_string(KEY_AND_IV_HEX_LENGTH) + " hex characters");
   std::vector<unsigned char> key_and_iv_bin = encoders::hex_to_binary(key_and_iv);
   iv_buf.resize(EVP_MAX_IV_LENGTH);
   memcpy(iv_buf.data(), key_and_iv_bin.data(), EVP_MAX_IV_LENGTH);
@@ -39,170 +40,195 @@ void aes256::split_key_and_iv(std::string key_and_iv, std::string &key_buf,
   memcpy(key_buf.data(), key_and_iv_bin.data() + EVP_MAX_IV_LENGTH, EVP_MAX_KEY_LENGTH);
 }
 
-std::string aes256::encrypt(std::string &plaintext, std::string &key_hex)
+std::vector<unsigned char> aes256::encrypt(const unsigned char *plaintext, std::size_t plaintext_length, const unsigned char *key)
 {
-  // Convert hex keys to binary
-  std::vector<unsigned char> key = encoders::hex_to_binary(key_hex);
   // Format of the output is | IV | ciphertext |
-  std::vector<unsigned char> out_buf(16 + plaintext.size() + EVP_MAX_BLOCK_LENGTH, 0);
+  std::vector<unsigned char> out_buf(IV_LENGTH + plaintext_length + EVP_MAX_BLOCK_LENGTH, 0);
   auto iv = out_buf.data();
-  auto ciphertext = out_buf.data() + 16;
+  auto ciphertext = out_buf.data() + IV_LENGTH;
   // Generate a random IV
-  if (RAND_bytes(iv, 16) != 1)
-  {
-    // Handle the error
-    throw std::runtime_error(
-        "RAND_bytes failed to generate secure random bytes.");
-  }
-  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-  if (!ctx)
-  {
-    throw std::runtime_error("Failed to create cipher context");
-  }
-
-  if (1 !=
-      EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
-                         reinterpret_cast<const unsigned char *>(key.data()),
-                         iv))
-  {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Failed to initialize encryption");
-  }
+  commonrand::bytes(iv, IV_LENGTH);
+  cipherpool::Lease lease(cipherpool::Cipher::aes_256_cbc, true);
+  EVP_CIPHER_CTX *ctx = lease.init(key, iv);
 
   int len;
-  if (1 != EVP_EncryptUpdate(
-               ctx, ciphertext, &len,
-               reinterpret_cast<const unsigned char *>(plaintext.data()),
-               plaintext.size()))
-  {
-    EVP_CIPHER_CTX_free(ctx);
-  }
+  if (1 != EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, plaintext_length))
+    throw std::runtime_error("Failed to encrypt");
   int ciphertext_len = len;
 
-  if (1 !=
-      EVP_EncryptFinal_ex(
-          ctx, ciphertext + len, &len))
-  {
-    EVP_CIPHER_CTX_free(ctx);
+  if (1 != EVP_EncryptFinal_ex(ctx, ciphertext + len, &len))
     throw std::runtime_error("Failed to finalize encryption");
-  }
   ciphertext_len += len;
-  out_buf.resize(16 + ciphertext_len);
-
-  EVP_CIPHER_CTX_free(ctx);
-  // base 64 encode the encrypted bytes
-  std::string iv_ciphertext_b64 = encoders::base64_encode(out_buf);
-  return iv_ciphertext_b64;
+  out_buf.resize(IV_LENGTH + ciphertext_len);
+  return out_buf;
 }
 
-std::string aes256::decrypt(std::string &ciphertext_b64, std::string &key_hex)
+std::vector<unsigned char> aes256::decrypt(const unsigned char *iv_ciphertext, std::size_t length, const unsigned char *key)
 {
-  try
-  {
-    // Convert hex keys to binary
-    std::vector<unsigned char> key = encoders::hex_to_binary(key_hex);
-    // convert b64 to binary
-    std::vector<unsigned char> iv_ciphertext = encoders::base64_decode(ciphertext_b64);
-    if (iv_ciphertext.size() < 16)
-    {
-      throw std::runtime_error(
-          "The received message is too short to contain an IV, let alone a ciphertext");
-    }
-    unsigned char *iv = iv_ciphertext.data();                  // IV is at the head
-    unsigned char *ciphertext_buf = iv_ciphertext.data() + 16; // IV is  16 bytes, the rest is ciphertext
+  std::vector<unsigned char> plaintext;
+  auto status = try_decrypt(iv_ciphertext, length, key, plaintext);
+  if (status != decryption::Status::ok)
+    throw std::runtime_error(decryption::describe(status));
+  return plaintext;
+}
 
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    if (!ctx)
-    {
-      throw std::runtime_error("Failed to create cipher context");
-    }
+decryption::Status aes256::try_decrypt(const unsigned char *iv_ciphertext, std::size_t length, const unsigned char *key,
+                                       std::vector<unsigned char> &plaintext)
+{
+  // CBC ciphertexts are whole blocks, at least one, and a block is as long as the IV
+  if (length < 2 * IV_LENGTH || length % IV_LENGTH != 0)
+    return decryption::Status::malformed;
+  const unsigned char *iv = iv_ciphertext;                         // IV is at the head
+  const unsigned char *ciphertext_buf = iv_ciphertext + IV_LENGTH; // the rest is ciphertext
+  std::size_t ciphertext_len = length - IV_LENGTH;
 
-    if (1 != EVP_DecryptInit_ex(
-                 ctx, EVP_aes_256_cbc(), NULL,
-                 key.data(),
-                 iv))
-    {
-      EVP_CIPHER_CTX_free(ctx);
-      throw std::runtime_error("Failed to initialize decryption");
-    }
+  cipherpool::Lease lease(cipherpool::Cipher::aes_256_cbc, false);
+  EVP_CIPHER_CTX *ctx = lease.init(key, iv);
 
-    std::string plaintext;
-    plaintext.resize(iv_ciphertext.size() - 16);
-    int len;
-    if (1 != EVP_DecryptUpdate(
-                 ctx, reinterpret_cast<unsigned char *>(&plaintext[0]), &len,
-                 ciphertext_buf,
-                 plaintext.size()))
-    {
-      EVP_CIPHER_CTX_free(ctx);
-      throw std::runtime_error("Failed to decrypt");
-    }
-    int plaintext_len = len;
+  // CBC output is never longer than its input, the padding is stripped on finalization
+  plaintext.resize(ciphertext_len + EVP_MAX_BLOCK_LENGTH);
+  int len;
+  if (1 != EVP_DecryptUpdate(ctx, plaintext.data(), &len, ciphertext_buf, ciphertext_len))
+    throw std::runtime_error("Failed to decrypt");
+  int plaintext_len = len;
 
-    if (1 != EVP_DecryptFinal_ex(
-                 ctx, reinterpret_cast<unsigned char *>(&plaintext[0]) + len,
-                 &len))
-    {
-      EVP_CIPHER_CTX_free(ctx);
-      throw std::runtime_error("Failed to finalize decryption");
-    }
-    plaintext_len += len;
-    plaintext.resize(plaintext_len);
+  // The next lease starts over with a new key and IV, even after bad padding
+  if (1 != EVP_DecryptFinal_ex(ctx, plaintext.data() + len, &len))
+  {
+    plaintext.clear();
+    return decryption::Status::bad_padding;
+  }
+  plaintext_len += len;
+  plaintext.resize(plaintext_len);
+  return decryption::Status::ok;
+}
 
-    EVP_CIPHER_CTX_free(ctx);
+std::string aes256::encrypt(std::string &plaintext, std::string &key_hex)
+{
+  // Convert hex keys to binary
+  std::vector<unsigned char> key = encoders::hex_to_binary(key_hex);
+  // Longer keys have always been accepted, only the first 32 bytes are used
+  if (key.size() < KEY_LENGTH)
+    throw std::runtime_error("aes256 keys must be at least 32 bytes long");
+  auto iv_ciphertext = encrypt(reinterpret_cast<const unsigned char *>(plaintext.data()), plaintext.size(), key.data());
+  // base 64 encode the encrypted bytes
+  return encoders::base64_encode(iv_ciphertext);
+}
 
-    return plaintext;
+std::vector<std::string> aes256::encrypt_many(const std::string &plaintext, const std::vector<std::string> &keys_hex, workpool::Lane lane)
+{
+  std::vector<std::string> ciphertexts(keys_hex.size());
+  auto encrypt_one = [&](std::size_t i)
+  {
+    std::vector<unsigned char> key = encoders::hex_to_binary(keys_hex[i]);
+    // Longer keys have always been accepted, only the first 32 bytes are used
+    if (key.size() < KEY_LENGTH)
+      throw std::runtime_error("aes256 keys must be at least 32 bytes long");
+    auto iv_ciphertext = encrypt(reinterpret_cast<const unsigned char *>(plaintext.data()), plaintext.size(), key.data());
+    ciphertexts[i] = encoders::base64_encode(iv_ciphertext);
+  };
+  // Handing a few short messages to other threads costs more than encrypting them right here
+  if (keys_hex.size() * (plaintext.size() + IV_LENGTH) < MANY_PARALLEL_THRESHOLD)
+  {
+    for (std::size_t i = 0; i < keys_hex.size(); i++)
+      encrypt_one(i);
   }
-  catch (const std::exception &e)
+  else
   {
-    return "error";
+    workpool::shared().parallel_for(lane, keys_hex.size(), encrypt_one);
   }
+  return ciphertexts;
 }
 
-void aes256::encrypt_file(std::ifstream &in_stream, std::ofstream &out_stream,
-                          unsigned char *key, unsigned char *iv)
+std::string aes256::decrypt(std::string &ciphertext_b64, std::string &key_hex)
 {
-  // Set up encryption context
-  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-  if (!ctx)
+  std::string plaintext;
+  try
   {
-    throw std::runtime_error("Could not create cipher context");
+    // Only what isn't the message's fault still throws
+    if (try_decrypt(ciphertext_b64, key_hex, plaintext) != decryption::Status::ok)
+      return "error";
   }
-
-  // Initialize encryption
-  if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key, iv) != 1)
+  catch (const std::exception &e)
   {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Could not begin aes 256 encryption");
+    return "error";
   }
+  return plaintext;
+}
 
-  unsigned char in_buf[1024], out_buf[1024 + EVP_MAX_BLOCK_LENGTH];
-  int bytes_read, encrypted_bytes;
+decryption::Status aes256::try_decrypt(const std::string &ciphertext_b64, const std::string &key_hex, std::string &plaintext)
+{
+  // Longer keys have always been accepted, only the first 32 bytes are used
+  if (encoders::hex_decoded_length(key_hex.size()) < KEY_LENGTH || !encoders::is_hex(key_hex.data(), key_hex.size()))
+    return decryption::Status::bad_key;
+  std::vector<unsigned char> key = encoders::hex_to_binary(key_hex);
+  std::vector<unsigned char> iv_ciphertext = encoders::base64_decode(ciphertext_b64);
+  std::vector<unsigned char> plaintext_bin;
+  auto status = try_decrypt(iv_ciphertext.data(), iv_ciphertext.size(), key.data(), plaintext_bin);
+  if (status == decryption::Status::ok)
+    plaintext.assign(plaintext_bin.begin(), plaintext_bin.end());
+  return status;
+}
 
-  // Reading in 1024 bytes at a time, encrypt each block and write it to the out
-  // buffer From the out buffer,  write it to the output file
-  while ((bytes_read =
-              in_stream.read(reinterpret_cast<char *>(in_buf), sizeof(in_buf))
-                  .gcount()) > 0)
+namespace
+{
+  /// @brief Encrypt a stream, feeding whichever hashers are given on the way
+  /// @return the number of ciphertext bytes written
+  std::uint64_t encrypt_stream(std::ifstream &in_stream, std::ofstream &out_stream,
+                               unsigned char *key, unsigned char *iv,
+                               hash::Sha256 *plaintext_hash, hash::Sha256 *ciphertext_hash)
   {
-    if (EVP_EncryptUpdate(ctx, out_buf, &encrypted_bytes, in_buf, bytes_read) !=
-        1)
+    // Set up encryption context
+    cipherpool::Lease lease(cipherpool::Cipher::aes_256_cbc, true);
+    EVP_CIPHER_CTX *ctx = lease.init(key, iv);
+
+    // Large reads keep the per call overhead of the cipher, the hashers and the streams down
+    std::vector<unsigned char> in_buf(FILE_BUFFER_SIZE), out_buf(FILE_BUFFER_SIZE + EVP_MAX_BLOCK_LENGTH);
+    int bytes_read, encrypted_bytes;
+    std::uint64_t written = 0;
+
+    // Encrypt each block read and write it to the output file, hashing both sides while they are at hand
+    while ((bytes_read =
+                in_stream.read(reinterpret_cast<char *>(in_buf.data()), in_buf.size())
+                    .gcount()) > 0)
     {
-      EVP_CIPHER_CTX_free(ctx);
-      throw std::runtime_error("Could not encrypt a block");
+      if (plaintext_hash)
+        plaintext_hash->update(in_buf.data(), bytes_read);
+      if (EVP_EncryptUpdate(ctx, out_buf.data(), &encrypted_bytes, in_buf.data(), bytes_read) !=
+          1)
+        throw std::runtime_error("Could not encrypt a block");
+      if (ciphertext_hash)
+        ciphertext_hash->update(out_buf.data(), encrypted_bytes);
+      out_stream.write(reinterpret_cast<char *>(out_buf.data()), encrypted_bytes);
+      written += encrypted_bytes;
     }
-    out_stream.write(reinterpret_cast<char *>(out_buf), encrypted_bytes);
-  }
+    if (in_stream.bad())
+      throw std::runtime_error("Could not read the file to encrypt");
 
-  // Finalize the encryption, add any padding, terminators and whatnot
-  if (EVP_EncryptFinal_ex(ctx, out_buf, &encrypted_bytes) != 1)
-  {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Could not finalize encryption");
+    // Finalize the encryption, add any padding, terminators and whatnot
+    if (EVP_EncryptFinal_ex(ctx, out_buf.data(), &encrypted_bytes) != 1)
+      throw std::runtime_error("Could not finalize encryption");
+    if (ciphertext_hash)
+      ciphertext_hash->update(out_buf.data(), encrypted_bytes);
+    out_stream.write(reinterpret_cast<char *>(out_buf.data()), encrypted_bytes);
+    return written + encrypted_bytes;
   }
-  out_stream.write(reinterpret_cast<char *>(out_buf), encrypted_bytes);
+}
 
-  EVP_CIPHER_CTX_free(ctx);
+void aes256::encrypt_file(std::ifstream &in_stream, std::ofstream &out_stream,
+                          unsigned char *key, unsigned char *iv)
+{
+  encrypt_stream(in_stream, out_stream, key, iv, nullptr, nullptr);
+}
+
+std::uint64_t aes256::encrypt_file(std::ifstream &in_stream, std::ofstream &out_stream,
+                                   unsigned char *key, unsigned char *iv, FileDigests &digests)
+{
+  hash::Sha256 plaintext_hash, ciphertext_hash;
+  std::uint64_t written = encrypt_stream(in_stream, out_stream, key, iv, &plaintext_hash, &ciphertext_hash);
+  plaintext_hash.final(digests.plaintext.data());
+  ciphertext_hash.final(digests.ciphertext.data());
+  return written;
 }
 
 void aes256::decrypt_file(std::ifstream &in_stream, std::ofstream &out_stream,
@@ -212,21 +238,12 @@ void aes256::decrypt_file(std::ifstream &in_stream, std::ofstream &out_stream,
       reinterpret_cast<const unsigned char *>(key.data());
   const unsigned char *iv_buf =
       reinterpret_cast<const unsigned char *>(iv.data());
-  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-  if (!ctx)
-  {
-    throw std::runtime_error("Can't create context for aes256 decryption");
-  }
-
   // Set up the decryption context
-  if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key_buf, iv_buf) !=
-      1)
-  {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Can't create context for aes256 decryption");
-  }
+  cipherpool::Lease lease(cipherpool::Cipher::aes_256_cbc, false);
+  EVP_CIPHER_CTX *ctx = lease.init(key_buf, iv_buf);
 
-  unsigned char inBuf[1024 + EVP_MAX_BLOCK_LENGTH], outBuf[1024];
+  // Decryption may hold back a block and emit it with the next one, so the output needs room for it
+  unsigned char inBuf[1024], outBuf[1024 + EVP_MAX_BLOCK_LENGTH];
   int bytesRead, decryptedBytes;
 
   // Process the input file in blocks and write the decrypted output
@@ -236,20 +253,12 @@ void aes256::decrypt_file(std::ifstream &in_stream, std::ofstream &out_stream,
   {
     if (EVP_DecryptUpdate(ctx, outBuf, &decryptedBytes, inBuf, bytesRead) !=
         1)
-    {
-      EVP_CIPHER_CTX_free(ctx);
       throw std::runtime_error("Error decrypting file");
-    }
     out_stream.write(reinterpret_cast<char *>(outBuf), decryptedBytes);
   }
 
   // Finalize the decryption
   if (EVP_DecryptFinal_ex(ctx, outBuf, &decryptedBytes) != 1)
-  {
-    EVP_CIPHER_CTX_free(ctx);
     throw std::runtime_error("Error finalizing file decryption");
-  }
   out_stream.write(reinterpret_cast<char *>(outBuf), decryptedBytes);
-
-  EVP_CIPHER_CTX_free(ctx);
 }
@@ -1,45 +1,78 @@
 #include "aesgcm.hpp"
 
+#include <cstring>
+#include <stdexcept>
 #include <openssl/evp.h>
+#include "cipherpool.hpp"
 #include "commonrand.hpp"
-#include "encoders.hpp"
 
-void aesgcm::encrypt(key secret, data plaintext, unsigned char *iv_buf, unsigned char *tag_buf, unsigned char *ciphertext_buf)
+void aesgcm::encrypt(const key &secret, const data &plaintext, unsigned char *iv_buf, unsigned char *tag_buf, unsigned char *ciphertext_buf)
 {
-  EVP_CIPHER_CTX *ctx;
-  /* Create and initialise the context */
-  if (!(ctx = EVP_CIPHER_CTX_new()))
-    throw std::runtime_error("Could not create cipher context");
-
-  /* Initialise the encryption operation. */
-  if (1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL))
-  {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Could not initialize encryption");
-  }
+  if (secret.size() != KEY_LENGTH)
+    throw std::runtime_error("AES-GCM keys must be 32 bytes long");
 
+  fixed_key fixed;
+  memcpy(fixed.data(), secret.data(), KEY_LENGTH);
+  encrypt(fixed, plaintext.data(), plaintext.size(), iv_buf, tag_buf, ciphertext_buf);
+  std::fill(fixed.begin(), fixed.end(), 0);
+}
+
+aesgcm::data aesgcm::decrypt(const key &secret, unsigned char *iv_buf, unsigned char *tag_buf, unsigned char *ciphertext_buf, size_t ciphertext_length)
+{
+  if (secret.size() != KEY_LENGTH)
+    throw std::runtime_error("AES-GCM keys must be 32 bytes long");
+
+  std::vector<unsigned char> plaintext(ciphertext_length, 0);
+  if (!open(secret.data(), iv_buf, nullptr, 0, ciphertext_buf, ciphertext_length, tag_buf, plaintext.data()))
+    throw std::runtime_error("Could not decrypt and verify authenticity of message");
+
+  return plaintext;
+}
+
+void aesgcm::encrypt(const fixed_key &secret, const unsigned char *plaintext, size_t length, unsigned char *iv_buf, unsigned char *tag_buf, unsigned char *ciphertext_buf)
+{
   // We use the default IV length, 12 bytes
-  // TODO: This is silly, create a separate method for bytes
-  auto iv = encoders::hex_to_binary(commonrand::hex(12));
-  memcpy(iv_buf, iv.data(), 12);
+  commonrand::bytes(iv_buf, IV_LENGTH);
 
-  /* Initialise key and IV */
-  if (1 != EVP_EncryptInit_ex(ctx, NULL, NULL, secret.data(), iv_buf))
-  {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Could not initialize encryption");
-  }
+  seal(secret.data(), iv_buf, nullptr, 0, plaintext, length, ciphertext_buf, tag_buf);
+}
+
+void aesgcm::decrypt(const fixed_key &secret, const unsigned char *iv_buf, const unsigned char *tag_buf, const unsigned char *ciphertext_buf, size_t ciphertext_length, unsigned char *plaintext_buf)
+{
+  auto status = try_decrypt(secret, iv_buf, tag_buf, ciphertext_buf, ciphertext_length, plaintext_buf);
+  if (status != decryption::Status::ok)
+    throw std::runtime_error(decryption::describe(status));
+}
+
+decryption::Status aesgcm::try_decrypt(const fixed_key &secret, const unsigned char *iv_buf, const unsigned char *tag_buf, const unsigned char *ciphertext_buf, size_t ciphertext_length, unsigned char *plaintext_buf)
+{
+  if (!open(secret.data(), iv_buf, nullptr, 0, ciphertext_buf, ciphertext_length, tag_buf, plaintext_buf))
+    return decryption::Status::bad_tag;
+  return decryption::Status::ok;
+}
+
+void aesgcm::seal(const unsigned char *key,
+                  const unsigned char *iv,
+                  const unsigned char *aad, size_t aad_length,
+                  const unsigned char *plaintext, size_t length,
+                  unsigned char *ciphertext_buf,
+                  unsigned char *tag_buf)
+{
+  /* Borrow a context and start a message. We use the default IV length, 12 bytes */
+  cipherpool::Lease lease(cipherpool::Cipher::aes_256_gcm, true);
+  EVP_CIPHER_CTX *ctx = lease.init(key, iv);
 
   int len;
+  /* Authenticate the additional data, if there is any */
+  if (aad_length > 0 && 1 != EVP_EncryptUpdate(ctx, NULL, &len, aad, aad_length))
+    throw std::runtime_error("Could not authenticate additional data");
+
   int ciphertext_len;
   if (1 != EVP_EncryptUpdate(ctx,
                              ciphertext_buf,
-                             &len, plaintext.data(),
-                             plaintext.size()))
-  {
-    EVP_CIPHER_CTX_free(ctx);
+                             &len, plaintext,
+                             length))
     throw std::runtime_error("Could not encrypt data");
-  }
   ciphertext_len = len;
 
   /*
@@ -49,81 +82,49 @@ void aesgcm::encrypt(key secret, data plaintext, unsigned char *iv_buf, unsigned
   if (1 != EVP_EncryptFinal_ex(ctx,
                                ciphertext_buf + ciphertext_len,
                                &len))
-  {
-    EVP_CIPHER_CTX_free(ctx);
     throw std::runtime_error("Could not encrypt data");
-  }
   // Since no extra bytes should be written, assert that
   if (0 != len)
     throw std::runtime_error("Bytes were written during finalization");
 
   /* Get the tag */
   if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, aesgcm::TAG_LENGTH, tag_buf))
-  {
-    EVP_CIPHER_CTX_free(ctx);
     throw std::runtime_error("Could not encrypt data");
-  }
-
-  /* Clean up */
-  EVP_CIPHER_CTX_free(ctx);
 }
 
-aesgcm::data aesgcm::decrypt(key secret, unsigned char *iv_buf, unsigned char *tag_buf, unsigned char *ciphertext_buf, size_t ciphertext_length)
+bool aesgcm::open(const unsigned char *key,
+                  const unsigned char *iv,
+                  const unsigned char *aad, size_t aad_length,
+                  const unsigned char *ciphertext, size_t length,
+                  const unsigned char *tag,
+                  unsigned char *plaintext_buf)
 {
-  EVP_CIPHER_CTX *ctx;
   int len;
 
-  /* Create and initialise the context */
-  if (!(ctx = EVP_CIPHER_CTX_new()))
-  {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Could not create the decryption context");
-  }
-
-  /* Initialise the decryption operation. */
-  if (!EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL))
-  {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Could not initialize the decryption context");
-  }
-
-  /* Initialise key and IV */
-  if (!EVP_DecryptInit_ex(ctx, NULL, NULL, secret.data(), iv_buf))
-  {
-    EVP_CIPHER_CTX_free(ctx);
-    throw std::runtime_error("Could not initialize key and iv");
-  }
+  /* Borrow a context and start a message with the key and IV */
+  cipherpool::Lease lease(cipherpool::Cipher::aes_256_gcm, false);
+  EVP_CIPHER_CTX *ctx = lease.init(key, iv);
+
+  /* Authenticate the additional data, if there is any */
+  if (aad_length > 0 && !EVP_DecryptUpdate(ctx, NULL, &len, aad, aad_length))
+    throw std::runtime_error("Could not authenticate additional data");
 
-  std::vector<unsigned char> plaintext(ciphertext_length, 0);
   /*
    * Provide the message to be decrypted, and obtain the plaintext output.
    * EVP_DecryptUpdate can be called multiple times if necessary
    */
-  if (!EVP_DecryptUpdate(ctx, plaintext.data(), &len, ciphertext_buf, ciphertext_length))
-  {
-    EVP_CIPHER_CTX_free(ctx);
+  if (!EVP_DecryptUpdate(ctx, plaintext_buf, &len, ciphertext, length))
     throw std::runtime_error("Could not set ciphertext");
-  }
-  // At this point, it's probably a good idea to ensure that plaintext length matches
 
-  // Set expected tag value.
-  if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, aesgcm::TAG_LENGTH, tag_buf))
-  {
-    EVP_CIPHER_CTX_free(ctx);
+  // Set expected tag value. OpenSSL doesn't modify it, it just isn't declared const.
+  if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, aesgcm::TAG_LENGTH, const_cast<unsigned char *>(tag)))
     throw std::runtime_error("Could not set expected tag");
-  }
 
   /*
    * Finalise the decryption. A positive return value indicates success,
    * anything else is a failure - the plaintext is not trustworthy.
+   * The next lease starts over with a new key and IV either way.
    */
-  int success = EVP_DecryptFinal_ex(ctx, plaintext.data() + len, &len);
-
-  /* Clean up */
-  EVP_CIPHER_CTX_free(ctx);
-
-  if (success <= 0)
-    throw std::runtime_error("Could not decrypt and verify authenticity of message");
-
-  return plaintext;
+  int success = EVP_DecryptFinal_ex(ctx, plaintext_buf + len, &len);
+  return success > 0;
 }
@@ -0,0 +1,255 @@
+#include "chunkedfile.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <openssl/crypto.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aesgcm.hpp"
+
+namespace
+{
+  /// @brief Owns a file descriptor. Chunks are read and written with pread/pwrite
+  /// so every worker can work on its own offset of the same file.
+  class File
+  {
+  public:
+    File(const std::string &path, int flags, const char *error) : fd(::open(path.c_str(), flags, 0666))
+    {
+      if (fd < 0)
+        throw std::runtime_error(error);
+    }
+    ~File() { ::close(fd); }
+    File(const File &) = delete;
+    File &operator=(const File &) = delete;
+
+    std::uint64_t size() const
+    {
+      struct stat info;
+      if (fstat(fd, &info) != 0)
+        throw std::runtime_error("Could not determine file size");
+      return info.st_size;
+    }
+
+    void read_at(unsigned char *buf, std::size_t length, std::uint64_t offset) const
+    {
+      while (length > 0)
+      {
+        ssize_t n = pread(fd, buf, length, offset);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0)
+          throw std::runtime_error("Could not read from file");
+        buf += n;
+        length -= n;
+        offset += n;
+      }
+    }
+
+    void write_at(const unsigned char *buf, std::size_t length, std::uint64_t offset) const
+    {
+      while (length > 0)
+      {
+        ssize_t n = pwrite(fd, buf, length, offset);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0)
+          throw std::runtime_error("Could not write to file");
+        buf += n;
+        length -= n;
+        offset += n;
+      }
+    }
+
+    void truncate(std::uint64_t length) const
+    {
+      if (ftruncate(fd, length) != 0)
+        throw std::runtime_error("Could not resize file");
+    }
+
+  private:
+    int fd;
+  };
+
+  std::uint64_t chunk_count(const chunkedfile::Header &header)
+  {
+    // There is always at least one chunk, so even an empty file is authenticated
+    return std::max<std::uint64_t>(1, (header.plaintext_size + header.chunk_size - 1) / header.chunk_size);
+  }
+
+  std::size_t chunk_plaintext_length(const chunkedfile::Header &header, std::uint64_t index)
+  {
+    return std::min<std::uint64_t>(header.chunk_size, header.plaintext_size - index * header.chunk_size);
+  }
+
+  std::uint64_t chunk_offset(const chunkedfile::Header &header, std::uint64_t index)
+  {
+    return sizeof(chunkedfile::Header) + index * (static_cast<std::uint64_t>(header.chunk_size) + aesgcm::TAG_LENGTH);
+  }
+
+  void chunk_nonce(const unsigned char *iv, std::uint64_t index, unsigned char *nonce)
+  {
+    memcpy(nonce, iv, 8);
+    nonce[8] = (index >> 24) & 0xff;
+    nonce[9] = (index >> 16) & 0xff;
+    nonce[10] = (index >> 8) & 0xff;
+    nonce[11] = index & 0xff;
+  }
+
+  chunkedfile::Header read_header(const File &in)
+  {
+    chunkedfile::Header header;
+    if (in.size() < sizeof(header))
+      throw std::runtime_error("File is too short to be an encrypted file");
+    in.read_at(reinterpret_cast<unsigned char *>(&header), sizeof(header), 0);
+    if (memcmp(header.magic, chunkedfile::MAGIC, sizeof(header.magic)) != 0)
+      throw std::runtime_error("File is not a version 2 encrypted file");
+    if (header.chunk_size == 0 || header.chunk_size > chunkedfile::MAX_CHUNK_SIZE)
+      throw std::runtime_error("Encrypted file has an invalid chunk size");
+    std::uint64_t last = chunk_count(header) - 1;
+    if (in.size() != chunk_offset(header, last) + chunk_plaintext_length(header, last) + aesgcm::TAG_LENGTH)
+      throw std::runtime_error("Encrypted file is truncated or corrupted");
+    return header;
+  }
+
+  /// @brief read and authenticate chunk index into buf
+  /// @return the length of the chunk's plaintext, which sits at the start of buf
+  std::size_t decrypt_chunk(const File &in, const chunkedfile::Header &header,
+                            const unsigned char *key, const unsigned char *iv,
+                            std::uint64_t index, std::vector<unsigned char> &buf)
+  {
+    std::size_t length = chunk_plaintext_length(header, index);
+    buf.resize(length + aesgcm::TAG_LENGTH);
+    unsigned char nonce[aesgcm::IV_LENGTH];
+    chunk_nonce(iv, index, nonce);
+    in.read_at(buf.data(), buf.size(), chunk_offset(header, index));
+    if (!aesgcm::open(key, nonce,
+                      reinterpret_cast<const unsigned char *>(&header), sizeof(header),
+                      buf.data(), length, buf.data() + length, buf.data()))
+      throw std::runtime_error("Could not decrypt and verify authenticity of file");
+    return length;
+  }
+}
+
+bool chunkedfile::is_chunked(const std::string &path)
+{
+  File in(path, O_RDONLY, "Could not open file");
+  char magic[sizeof(MAGIC)];
+  if (in.size() < sizeof(magic))
+    return false;
+  in.read_at(reinterpret_cast<unsigned char *>(magic), sizeof(magic), 0);
+  return memcmp(magic, MAGIC, sizeof(magic)) == 0;
+}
+
+void chunkedfile::encrypt_file(const std::string &path_to_input,
+                               const std::string &path_to_output,
+                               const unsigned char *key,
+                               const unsigned char *iv,
+                               std::uint32_t chunk_size,
+                               workpool::Lane lane)
+{
+  if (chunk_size == 0 || chunk_size > MAX_CHUNK_SIZE)
+    throw std::runtime_error("Invalid chunk size for file encryption");
+
+  File in(path_to_input, O_RDONLY, "Input file for encryption could not be opened.");
+  File out(path_to_output, O_WRONLY | O_CREAT | O_TRUNC, "Outputfile for encryption could not be opened.");
+
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(header.magic));
+  header.chunk_size = chunk_size;
+  header.reserved = 0;
+  header.plaintext_size = in.size();
+  const std::uint64_t count = chunk_count(header);
+  if (count > UINT32_MAX)
+    throw std::runtime_error("File is too large to encrypt");
+  out.write_at(reinterpret_cast<const unsigned char *>(&header), sizeof(header), 0);
+
+  workpool::shared().parallel_for(lane, count, [&](std::size_t index)
+                                  {
+    std::size_t length = chunk_plaintext_length(header, index);
+    std::vector<unsigned char> buf(length + aesgcm::TAG_LENGTH);
+    unsigned char nonce[aesgcm::IV_LENGTH];
+    chunk_nonce(iv, index, nonce);
+    in.read_at(buf.data(), length, static_cast<std::uint64_t>(index) * chunk_size);
+    // GCM is happy to encrypt in place
+    aesgcm::seal(key, nonce,
+                 reinterpret_cast<const unsigned char *>(&header), sizeof(header),
+                 buf.data(), length, buf.data(), buf.data() + length);
+    out.write_at(buf.data(), buf.size(), chunk_offset(header, index)); });
+}
+
+void chunkedfile::decrypt_file(const std::string &path_to_input,
+                               const std::string &path_to_output,
+                               const unsigned char *key,
+                               const unsigned char *iv,
+                               workpool::Lane lane)
+{
+  File in(path_to_input, O_RDONLY, "Could not open input file for decryption");
+  Header header = read_header(in);
+  File out(path_to_output, O_WRONLY | O_CREAT | O_TRUNC, "Could not open output file for decryption");
+  out.truncate(header.plaintext_size);
+
+  workpool::shared().parallel_for(lane, chunk_count(header), [&](std::size_t index)
+                                  {
+    std::vector<unsigned char> buf;
+    std::size_t length = decrypt_chunk(in, header, key, iv, index, buf);
+    out.write_at(buf.data(), length, static_cast<std::uint64_t>(index) * header.chunk_size); });
+}
+
+struct chunkedfile::Reader::State
+{
+  State(const std::string &path) : in(path, O_RDONLY, "Could not open input file for decryption"), header(read_header(in)) {}
+  ~State()
+  {
+    OPENSSL_cleanse(key, sizeof(key));
+    OPENSSL_cleanse(iv, sizeof(iv));
+  }
+  File in;
+  Header header;
+  unsigned char key[aesgcm::KEY_LENGTH];
+  unsigned char iv[aesgcm::IV_LENGTH];
+};
+
+chunkedfile::Reader::Reader(const std::string &path, const unsigned char *key, const unsigned char *iv)
+    : state(std::make_unique<State>(path))
+{
+  memcpy(state->key, key, sizeof(state->key));
+  // Only the first 8 bytes of the IV go into chunk nonces
+  memcpy(state->iv, iv, sizeof(state->iv));
+}
+
+chunkedfile::Reader::~Reader() = default;
+
+std::uint64_t chunkedfile::Reader::size() const
+{
+  return state->header.plaintext_size;
+}
+
+std::vector<unsigned char> chunkedfile::Reader::read(std::uint64_t offset, std::size_t length, workpool::Lane lane) const
+{
+  const Header &header = state->header;
+  if (offset >= header.plaintext_size || length == 0)
+    return {};
+  length = std::min<std::uint64_t>(length, header.plaintext_size - offset);
+  std::vector<unsigned char> out(length);
+
+  const std::uint64_t first = offset / header.chunk_size;
+  const std::uint64_t last = (offset + length - 1) / header.chunk_size;
+  workpool::shared().parallel_for(lane, last - first + 1, [&](std::size_t i)
+                                  {
+    std::uint64_t index = first + i;
+    std::vector<unsigned char> buf;
+    std::size_t chunk_length = decrypt_chunk(state->in, header, state->key, state->iv, index, buf);
+
+    // Copy out the part of this chunk that overlaps the requested range
+    std::uint64_t chunk_start = index * header.chunk_size;
+    std::uint64_t from = std::max(offset, chunk_start);
+    std::uint64_t to = std::min(offset + length, chunk_start + chunk_length);
+    memcpy(out.data() + (from - offset), buf.data() + (from - chunk_start), to - from); });
+  return out;
+}
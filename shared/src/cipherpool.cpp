@@ -0,0 +1,90 @@
+#include "cipherpool.hpp"
+
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+  // Idle contexts kept per algorithm and direction on every thread
+  const std::size_t MAX_IDLE = 4;
+  const unsigned int SLOTS = 4;
+
+  /// @brief The contexts a thread isn't using right now
+  struct Cache
+  {
+    std::vector<EVP_CIPHER_CTX *> idle[SLOTS];
+    ~Cache()
+    {
+      for (auto &contexts : idle)
+        for (auto ctx : contexts)
+          EVP_CIPHER_CTX_free(ctx);
+    }
+  };
+
+  thread_local Cache cache;
+
+  const char *algorithm_name(cipherpool::Cipher cipher)
+  {
+    switch (cipher)
+    {
+    case cipherpool::Cipher::aes_256_cbc:
+      return "AES-256-CBC";
+    case cipherpool::Cipher::aes_256_gcm:
+      return "AES-256-GCM";
+    }
+    throw std::logic_error("Unknown cipher");
+  }
+}
+
+const EVP_CIPHER *cipherpool::fetch(Cipher cipher)
+{
+  // Never freed on purpose, OpenSSL may already be shut down by the time static destructors run
+  static EVP_CIPHER *ciphers[2] = {};
+  static std::once_flag fetched[2];
+  unsigned int index = static_cast<unsigned int>(cipher);
+  std::call_once(fetched[index], [&]
+                 { ciphers[index] = EVP_CIPHER_fetch(nullptr, algorithm_name(cipher), nullptr); });
+  if (!ciphers[index])
+    throw std::runtime_error("Could not fetch cipher");
+  return ciphers[index];
+}
+
+cipherpool::Lease::Lease(Cipher cipher, bool encrypting)
+    : ctx(nullptr), slot(static_cast<unsigned int>(cipher) * 2 + (encrypting ? 1 : 0)), exceptions(std::uncaught_exceptions())
+{
+  auto &idle = cache.idle[slot];
+  if (!idle.empty())
+  {
+    ctx = idle.back();
+    idle.pop_back();
+    return;
+  }
+  ctx = EVP_CIPHER_CTX_new();
+  if (!ctx)
+    throw std::runtime_error("Could not create cipher context");
+  if (EVP_CipherInit_ex2(ctx, fetch(cipher), nullptr, nullptr, encrypting ? 1 : 0, nullptr) != 1)
+  {
+    EVP_CIPHER_CTX_free(ctx);
+    throw std::runtime_error("Could not initialize cipher context");
+  }
+}
+
+cipherpool::Lease::~Lease()
+{
+  // A context abandoned halfway through by an exception isn't worth trusting again
+  auto &idle = cache.idle[slot];
+  if (std::uncaught_exceptions() > exceptions || idle.size() >= MAX_IDLE)
+    EVP_CIPHER_CTX_free(ctx);
+  else
+    idle.push_back(ctx);
+}
+
+EVP_CIPHER_CTX *cipherpool::Lease::init(const unsigned char *key, const unsigned char *iv)
+{
+  // Keeps the algorithm and direction and only sets up the new key and IV
+  if (EVP_CipherInit_ex2(ctx, nullptr, key, iv, -1, nullptr) != 1)
+    throw std::runtime_error("Could not initialize cipher context");
+  return ctx;
+}
@@ -1,28 +1,126 @@
 #include "commonhash.hpp"
 
-#include "encoders.hpp"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
 #include "encoders.hpp"
 
-std::string hash::hashSHA256(std::string input)
+// Large reads keep the number of syscalls down, hashing is faster than the disk either way
+#define FILE_BUFFER_SIZE (1024 * 1024)
+// Inputs hashed by one task of a batch. Spreading out fewer doesn't pay for the handoff.
+#define MANY_CHUNK 256
+
+namespace
+{
+  /// @brief SHA-256, fetched from the provider once. OpenSSL picks SHA-NI or the ARMv8 instructions itself.
+  const EVP_MD *sha256()
+  {
+    // Never freed on purpose, OpenSSL may already be shut down by the time static destructors run
+    static EVP_MD *md = nullptr;
+    static std::once_flag fetched;
+    std::call_once(fetched, []
+                   { md = EVP_MD_fetch(nullptr, "SHA256", nullptr); });
+    if (!md)
+      throw std::runtime_error("Could not fetch SHA-256");
+    return md;
+  }
+}
+
+std::string hash::hashSHA256(const std::string &input)
 {
-  EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
-  unsigned char hash[SHA256_DIGEST_LENGTH];
-  unsigned int hash_len;
+  Sha256 hasher;
+  hasher.update(input);
+  return hasher.final_hex();
+}
 
-  // Initialize the context with SHA-256
-  EVP_DigestInit_ex(mdctx, EVP_sha256(), nullptr);
+hash::Sha256::Sha256() : ctx(EVP_MD_CTX_new())
+{
+  if (!ctx)
+    throw std::runtime_error("Could not create digest context");
+  if (EVP_DigestInit_ex(ctx, sha256(), nullptr) != 1)
+  {
+    EVP_MD_CTX_free(ctx);
+    throw std::runtime_error("Could not initialize SHA-256");
+  }
+}
 
-  // Add the input string
-  EVP_DigestUpdate(mdctx, input.c_str(), input.length());
+hash::Sha256::~Sha256()
+{
+  EVP_MD_CTX_free(ctx);
+}
 
-  // Finalize the hash
-  EVP_DigestFinal_ex(mdctx, hash, &hash_len);
+void hash::Sha256::update(const unsigned char *data, std::size_t length)
+{
+  if (EVP_DigestUpdate(ctx, data, length) != 1)
+    throw std::runtime_error("Could not hash data");
+}
 
-  // Clean up
-  EVP_MD_CTX_free(mdctx);
+void hash::Sha256::update(const std::string &data)
+{
+  update(reinterpret_cast<const unsigned char *>(data.data()), data.size());
+}
 
-  // Convert the hash to a hexadecimal string
-  return encoders::binary_to_hex(hash, hash_len);
-}
\ No newline at end of file
+void hash::Sha256::final(unsigned char *digest)
+{
+  unsigned int digest_length;
+  if (EVP_DigestFinal_ex(ctx, digest, &digest_length) != 1 || digest_length != SHA256_LENGTH)
+    throw std::runtime_error("Could not finalize hash");
+  // Ready for the next input, reusing the context
+  if (EVP_DigestInit_ex(ctx, nullptr, nullptr) != 1)
+    throw std::runtime_error("Could not initialize SHA-256");
+}
+
+std::string hash::Sha256::final_hex()
+{
+  unsigned char digest[SHA256_LENGTH];
+  final(digest);
+  return encoders::binary_to_hex(digest, SHA256_LENGTH);
+}
+
+std::string hash::hash_file(const std::string &path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("Could not open file to hash");
+  std::unique_ptr<char[]> buffer(new char[FILE_BUFFER_SIZE]);
+  Sha256 hasher;
+  while (in)
+  {
+    in.read(buffer.get(), FILE_BUFFER_SIZE);
+    hasher.update(reinterpret_cast<const unsigned char *>(buffer.get()), in.gcount());
+  }
+  if (in.bad())
+    throw std::runtime_error("Could not read file to hash");
+  return hasher.final_hex();
+}
+
+std::vector<std::string> hash::hash_many(const std::vector<std::string> &inputs, workpool::Lane lane)
+{
+  std::vector<std::string> digests(inputs.size());
+  // Every task reuses one context for its whole chunk
+  auto hash_chunk = [&](std::size_t chunk)
+  {
+    Sha256 hasher;
+    std::size_t end = std::min(inputs.size(), (chunk + 1) * MANY_CHUNK);
+    for (std::size_t i = chunk * MANY_CHUNK; i < end; i++)
+    {
+      hasher.update(inputs[i]);
+      digests[i] = hasher.final_hex();
+    }
+  };
+  std::size_t chunks = (inputs.size() + MANY_CHUNK - 1) / MANY_CHUNK;
+  if (chunks <= 1)
+  {
+    for (std::size_t chunk = 0; chunk < chunks; chunk++)
+      hash_chunk(chunk);
+  }
+  else
+  {
+    workpool::shared().parallel_for(lane, chunks, hash_chunk);
+  }
+  return digests;
+}
@@ -1,18 +1,40 @@
 #include "commonrand.hpp"
+#include <cstring>
+#include <stdexcept>
 #include <vector>
 #include "encoders.hpp"
+#include <openssl/crypto.h>
 #include <openssl/rand.h>
+
+// Bytes fetched from the DRBG at once. Requests above a quarter of it go to the DRBG directly.
+#define POOL_SIZE 4096
+
+namespace
+{
+  /// @brief Random bytes of this thread that weren't handed out yet
+  struct Pool
+  {
+    unsigned char bytes[POOL_SIZE];
+    std::size_t used = POOL_SIZE;
+    ~Pool() { OPENSSL_cleanse(bytes, sizeof(bytes)); }
+  };
+
+  thread_local Pool pool;
+
+  void drbg(unsigned char *buffer, std::size_t length)
+  {
+    if (RAND_bytes(buffer, length) != 1)
+      throw std::runtime_error("RAND_bytes failed to generate secure random bytes.");
+  }
+}
+
 std::string commonrand::hex(std::size_t length)
 {
   auto random_data = std::vector<unsigned char>(length);
   try
   {
     // Generate random bytes and store them in random_data
-    if (RAND_bytes(random_data.data(), length) != 1)
-    {
-      // Handle the error
-      throw std::runtime_error("RAND_bytes failed to generate secure random bytes.");
-    }
+    bytes(random_data.data(), length);
     std::string random_data_hex = encoders::binary_to_hex(random_data.data(), length);
     return random_data_hex;
   }
@@ -20,4 +42,22 @@ std::string commonrand::hex(std::size_t length)
   {
     return "error";
   }
-}
\ No newline at end of file
+}
+
+void commonrand::bytes(unsigned char *buffer, std::size_t length)
+{
+  if (length > POOL_SIZE / 4)
+  {
+    drbg(buffer, length);
+    return;
+  }
+  if (POOL_SIZE - pool.used < length)
+  {
+    drbg(pool.bytes, POOL_SIZE);
+    pool.used = 0;
+  }
+  memcpy(buffer, pool.bytes + pool.used, length);
+  // Bytes that were handed out must not be found in memory later
+  OPENSSL_cleanse(pool.bytes + pool.used, length);
+  pool.used += length;
+}
@@ -1,7 +1,7 @@
 #include "ed25519.hpp"
 
+#include <stdexcept>
 #include <vector>
-#include <cassert>
 #include <openssl/evp.h>
 #include <encoders.hpp>
 
@@ -9,52 +9,116 @@ std::string ed25519::generate_keys_json()
 {
   EVP_PKEY *pkey = nullptr;
   EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
-  EVP_PKEY_keygen_init(pctx);
-  EVP_PKEY_keygen(pctx, &pkey);
-  // Extract private key
-  size_t private_key_len;
+  if (!pctx || 1 != EVP_PKEY_keygen_init(pctx) || 1 != EVP_PKEY_keygen(pctx, &pkey))
+  {
+    EVP_PKEY_CTX_free(pctx);
+    throw std::runtime_error("Failed ed25519 keygen");
+  }
+  EVP_PKEY_CTX_free(pctx);
+
+  // The lengths go in as the size of the buffers and come out as the size of the keys
+  size_t private_key_len = 32;
   std::vector<unsigned char> private_key(32);
-  EVP_PKEY_get_raw_private_key(pkey, private_key.data(), &private_key_len);
-  assert(32 == private_key_len);
+  int private_ok = EVP_PKEY_get_raw_private_key(pkey, private_key.data(), &private_key_len);
 
-  // Extract public key
-  size_t public_key_len;
-  std::vector<unsigned char> public_key(32);
-  EVP_PKEY_get_raw_public_key(pkey, public_key.data(), &public_key_len);
-  assert(32 == public_key_len);
+  size_t public_key_len = PUBLIC_KEY_LENGTH;
+  std::vector<unsigned char> public_key(PUBLIC_KEY_LENGTH);
+  int public_ok = EVP_PKEY_get_raw_public_key(pkey, public_key.data(), &public_key_len);
+  EVP_PKEY_free(pkey);
+  if (1 != private_ok || 32 != private_key_len || 1 != public_ok || PUBLIC_KEY_LENGTH != public_key_len)
+    throw std::runtime_error("Could not extract ed25519 keys");
 
   std::string private_key_b64 = encoders::base64_encode(private_key);
   std::string public_key_b64 = encoders::base64_encode(public_key);
+  std::fill(private_key.begin(), private_key.end(), 0);
   std::string keysJSON = "{\"privateKey\":\"" + private_key_b64 + "\",\"publicKey\":\"" + public_key_b64 + "\"}";
-
-  EVP_PKEY_free(pkey);
-  EVP_PKEY_CTX_free(pctx);
   return keysJSON;
 }
 std::string ed25519::sign_message(const std::string &message, const std::string &private_key_b64)
 {
-  std::vector<unsigned char> private_key = encoders::base64_decode(private_key_b64);
-  EVP_PKEY *priv_key = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, private_key.data(), 32);
-  size_t sig_len;
-  EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
-  if (1 != EVP_DigestSignInit(mdctx, NULL, NULL, NULL, priv_key))
+  try
   {
-    EVP_PKEY_free(priv_key);
-    return "error";
+    return Signer(private_key_b64).sign(message);
   }
-  if (1 != EVP_DigestSign(mdctx, NULL, &sig_len, (const unsigned char *)message.c_str(), message.length()))
+  catch (const std::exception &e)
   {
-    EVP_MD_CTX_free(mdctx);
-    EVP_PKEY_free(priv_key);
-    return "error";
-  }
-  std::vector<unsigned char> signature(sig_len);
-  if (1 != EVP_DigestSign(mdctx, signature.data(), &sig_len, (const unsigned char *)message.c_str(), message.length()))
-  {
-    EVP_MD_CTX_free(mdctx);
-    EVP_PKEY_free(priv_key);
     return "error";
   }
+}
+
+ed25519::Signer::Signer(const std::string &private_key_b64)
+{
+  std::vector<unsigned char> key = encoders::base64_decode(private_key_b64);
+  if (key.size() != 32)
+    throw std::runtime_error("ed25519 private keys must be 32 bytes long");
+  private_key = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, key.data(), key.size());
+  std::fill(key.begin(), key.end(), 0);
+  if (!private_key)
+    throw std::runtime_error("Could not load ed25519 private key");
+}
+
+ed25519::Signer::~Signer()
+{
+  EVP_PKEY_free(private_key);
+}
+
+void ed25519::Signer::sign(const unsigned char *message, std::size_t length, unsigned char *signature_buf) const
+{
+  size_t sig_len = SIGNATURE_LENGTH;
+  EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+  bool signed_ok = mdctx &&
+                   1 == EVP_DigestSignInit(mdctx, NULL, NULL, NULL, private_key) &&
+                   1 == EVP_DigestSign(mdctx, signature_buf, &sig_len, message, length);
   EVP_MD_CTX_free(mdctx);
+  if (!signed_ok || sig_len != SIGNATURE_LENGTH)
+    throw std::runtime_error("Could not sign message");
+}
+
+std::string ed25519::Signer::sign(const std::string &message) const
+{
+  std::vector<unsigned char> signature(SIGNATURE_LENGTH);
+  sign(reinterpret_cast<const unsigned char *>(message.data()), message.size(), signature.data());
   return encoders::base64_encode(signature);
-}
\ No newline at end of file
+}
+
+std::vector<std::string> ed25519::Signer::sign_many(const std::vector<std::string> &messages, workpool::Lane lane) const
+{
+  std::vector<std::string> signatures(messages.size());
+  workpool::shared().parallel_for(lane, messages.size(), [&](std::size_t i)
+                                  { signatures[i] = sign(messages[i]); });
+  return signatures;
+}
+
+bool ed25519::verify(const unsigned char *message, std::size_t length,
+                     const unsigned char *signature,
+                     const unsigned char *public_key)
+{
+  EVP_PKEY *pub_key = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, public_key, PUBLIC_KEY_LENGTH);
+  if (!pub_key)
+    return false;
+  EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+  bool valid = mdctx &&
+               1 == EVP_DigestVerifyInit(mdctx, NULL, NULL, NULL, pub_key) &&
+               1 == EVP_DigestVerify(mdctx, signature, SIGNATURE_LENGTH, message, length);
+  EVP_MD_CTX_free(mdctx);
+  EVP_PKEY_free(pub_key);
+  return valid;
+}
+
+bool ed25519::verify(const std::string &message, const std::string &signature_b64, const std::string &public_key_b64)
+{
+  auto signature = encoders::base64_decode(signature_b64);
+  auto public_key = encoders::base64_decode(public_key_b64);
+  if (signature.size() != SIGNATURE_LENGTH || public_key.size() != PUBLIC_KEY_LENGTH)
+    return false;
+  return verify(reinterpret_cast<const unsigned char *>(message.data()), message.size(), signature.data(), public_key.data());
+}
+
+std::vector<bool> ed25519::verify_many(const std::vector<SignedMessage> &messages, workpool::Lane lane)
+{
+  // vector<bool> packs bits, which threads can't write side by side
+  std::vector<char> valid(messages.size(), 0);
+  workpool::shared().parallel_for(lane, messages.size(), [&](std::size_t i)
+                                  { valid[i] = verify(messages[i].message, messages[i].signature_b64, messages[i].public_key_b64); });
+  return std::vector<bool>(valid.begin(), valid.end());
+}
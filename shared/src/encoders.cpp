@@ -1,75 +1,468 @@
 #include "encoders.hpp"
-#include <sstream>
-#include <iomanip>
 
-static const std::string base64_chars =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-    "abcdefghijklmnopqrstuvwxyz"
-    "0123456789-_";
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 
-std::string encoders::binary_to_hex(const unsigned char *data, std::size_t length)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ENCODERS_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ENCODERS_NEON 1
+#endif
+
+// pshufb and pmaddubsw for base64. Android's x86 ABIs and x86 Apple targets all have them.
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define ENCODERS_SSSE3 1
+#endif
+
+namespace
 {
-  std::stringstream hex_stream;
-  hex_stream << std::hex << std::setfill('0');
-  for (size_t i = 0; i < length; i++)
+  const char HEX_DIGITS[] = "0123456789abcdef";
+
+  const char BASE64_CHARS[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+      "abcdefghijklmnopqrstuvwxyz"
+      "0123456789-_";
+
+  const std::uint8_t INVALID = 0xff;
+
+  /// @brief A 256 entry lookup table built once at compile time
+  struct DecodeTable
+  {
+    std::uint8_t values[256];
+  };
+
+  constexpr DecodeTable make_hex_table()
+  {
+    DecodeTable table{};
+    for (int i = 0; i < 256; i++)
+      table.values[i] = INVALID;
+    for (int i = 0; i < 10; i++)
+      table.values['0' + i] = i;
+    for (int i = 0; i < 6; i++)
+    {
+      table.values['a' + i] = 10 + i;
+      table.values['A' + i] = 10 + i;
+    }
+    return table;
+  }
+
+  constexpr DecodeTable make_base64_table()
+  {
+    DecodeTable table{};
+    for (int i = 0; i < 256; i++)
+      table.values[i] = INVALID;
+    for (int i = 0; i < 64; i++)
+      table.values[static_cast<unsigned char>(BASE64_CHARS[i])] = i;
+    return table;
+  }
+
+  constexpr DecodeTable HEX_TABLE = make_hex_table();
+  constexpr DecodeTable BASE64_TABLE = make_base64_table();
+
+  /// @brief Two hex characters for every byte value, so encoding is one lookup per byte
+  struct HexPairs
+  {
+    char pairs[256][2];
+  };
+
+  constexpr HexPairs make_hex_pairs()
+  {
+    HexPairs table{};
+    for (int i = 0; i < 256; i++)
+    {
+      table.pairs[i][0] = HEX_DIGITS[i >> 4];
+      table.pairs[i][1] = HEX_DIGITS[i & 0xf];
+    }
+    return table;
+  }
+
+  constexpr HexPairs HEX_PAIRS = make_hex_pairs();
+
+  std::uint8_t hex_value(char c)
+  {
+    std::uint8_t value = HEX_TABLE.values[static_cast<unsigned char>(c)];
+    if (value == INVALID)
+      throw std::invalid_argument("Invalid hex digit");
+    return value;
+  }
+
+  /*
+   * Vector kernels. Each handles as many whole blocks as it can and returns
+   * how many input bytes it consumed, and the scalar code does the rest.
+   */
+
+#if defined(ENCODERS_SSE2)
+  /// @brief turn 16 nibbles into their hex characters
+  inline __m128i nibbles_to_hex(__m128i nibbles)
+  {
+    // '0' + n, plus the distance from '9' + 1 to 'a' for n > 9
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+  }
+
+  std::size_t encode_hex_blocks(const unsigned char *data, std::size_t length, char *out)
   {
-    hex_stream << std::setw(2) << static_cast<int>(data[i]);
+    const __m128i low_nibble = _mm_set1_epi8(0x0f);
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      __m128i high = nibbles_to_hex(_mm_and_si128(_mm_srli_epi16(bytes, 4), low_nibble));
+      __m128i low = nibbles_to_hex(_mm_and_si128(bytes, low_nibble));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_unpacklo_epi8(high, low));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+    return i;
+  }
+
+  /// @brief turn 16 hex characters into their values
+  /// @return false if any of them isn't a hex digit
+  inline bool hex_to_nibbles(__m128i chars, __m128i &nibbles)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_subs_epu8(digit, _mm_set1_epi8(9)), zero);
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_letter = _mm_cmpeq_epi8(_mm_subs_epu8(letter, _mm_set1_epi8(5)), zero);
+    if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xffff)
+      return false;
+    nibbles = _mm_or_si128(_mm_and_si128(is_digit, digit),
+                           _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+    return true;
+  }
+
+  /// @brief combine 8 pairs of nibbles, high nibble first, into 8 bytes in the low half of every 16 bit lane
+  inline __m128i pairs_to_bytes(__m128i nibbles)
+  {
+    __m128i high = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00ff)), 4);
+    __m128i low = _mm_srli_epi16(nibbles, 8);
+    return _mm_or_si128(high, low);
+  }
+
+  std::size_t decode_hex_blocks(const char *hex, std::size_t length, unsigned char *out)
+  {
+    std::size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+      __m128i first, second;
+      if (!hex_to_nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + i)), first) ||
+          !hex_to_nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + i + 16)), second))
+        break; // Let the scalar code find and report the bad digit
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i / 2),
+                       _mm_packus_epi16(pairs_to_bytes(first), pairs_to_bytes(second)));
+    }
+    return i;
+  }
+#elif defined(ENCODERS_NEON)
+  inline uint8x16_t nibbles_to_hex(uint8x16_t nibbles)
+  {
+    uint8x16_t letters = vandq_u8(vcgtq_u8(nibbles, vdupq_n_u8(9)), vdupq_n_u8('a' - '0' - 10));
+    return vaddq_u8(vaddq_u8(nibbles, vdupq_n_u8('0')), letters);
+  }
+
+  std::size_t encode_hex_blocks(const unsigned char *data, std::size_t length, char *out)
+  {
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+      uint8x16_t bytes = vld1q_u8(data + i);
+      uint8x16x2_t chars;
+      chars.val[0] = nibbles_to_hex(vshrq_n_u8(bytes, 4));
+      chars.val[1] = nibbles_to_hex(vandq_u8(bytes, vdupq_n_u8(0x0f)));
+      // Interleaves the high and low characters on the way out
+      vst2q_u8(reinterpret_cast<uint8_t *>(out + 2 * i), chars);
+    }
+    return i;
+  }
+
+  inline bool hex_to_nibbles(uint8x16_t chars, uint8x16_t &nibbles)
+  {
+    uint8x16_t digit = vsubq_u8(chars, vdupq_n_u8('0'));
+    uint8x16_t is_digit = vcleq_u8(digit, vdupq_n_u8(9));
+    uint8x16_t letter = vsubq_u8(vorrq_u8(chars, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_letter = vcleq_u8(letter, vdupq_n_u8(5));
+    if (vminvq_u8(vorrq_u8(is_digit, is_letter)) != 0xff)
+      return false;
+    nibbles = vbslq_u8(is_digit, digit, vaddq_u8(letter, vdupq_n_u8(10)));
+    return true;
+  }
+
+  std::size_t decode_hex_blocks(const char *hex, std::size_t length, unsigned char *out)
+  {
+    std::size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+      // Splits the even (high) and odd (low) characters on the way in
+      uint8x16x2_t chars = vld2q_u8(reinterpret_cast<const uint8_t *>(hex + i));
+      uint8x16_t high, low;
+      if (!hex_to_nibbles(chars.val[0], high) || !hex_to_nibbles(chars.val[1], low))
+        break; // Let the scalar code find and report the bad digit
+      vst1q_u8(out + i / 2, vorrq_u8(vshlq_n_u8(high, 4), low));
+    }
+    return i;
+  }
+#else
+  std::size_t encode_hex_blocks(const unsigned char *, std::size_t, char *) { return 0; }
+  std::size_t decode_hex_blocks(const char *, std::size_t, unsigned char *) { return 0; }
+#endif
+
+#if defined(ENCODERS_SSSE3)
+  /// @brief turn 12 bytes, loaded as 16, into 16 base64 characters
+  inline __m128i encode_base64_block(__m128i bytes)
+  {
+    // Each 32 bit lane gets one 3 byte group as b1 b0 b2 b1, then the four
+    // 6 bit values are moved into a byte each with multiplies instead of shifts
+    bytes = _mm_shuffle_epi8(bytes, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i ac = _mm_mulhi_epu16(_mm_and_si128(bytes, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i bd = _mm_mullo_epi16(_mm_and_si128(bytes, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    __m128i values = _mm_or_si128(ac, bd);
+
+    // Pick what to add to each value by its range: 0-25 'A', 26-51 'a', 52-61 '0', 62 '-', 63 '_'
+    __m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), values), _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+    return _mm_add_epi8(values, _mm_shuffle_epi8(offsets, range));
   }
-  return hex_stream.str();
+
+  std::size_t encode_base64_blocks(const unsigned char *data, std::size_t length, char *out)
+  {
+    std::size_t i = 0;
+    // A block reads 16 bytes but uses 12, so stop while a whole load still fits
+    for (; i + 16 <= length; i += 12, out += 16)
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                       encode_base64_block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i))));
+    return i;
+  }
+
+  /// @brief turn 16 base64 characters into their 6 bit values
+  /// @return false if any of them is outside the alphabet
+  inline bool base64_to_values(__m128i chars, __m128i &values)
+  {
+    __m128i high = _mm_and_si128(_mm_srli_epi32(chars, 4), _mm_set1_epi8(0x0f));
+    __m128i low = _mm_and_si128(chars, _mm_set1_epi8(0x0f));
+    // A bit for each kind of high nibble, set in the low nibble entries that are invalid for it:
+    // 0x01 for 0x2 (only '-'), 0x02 for 0x3 ('0'-'9'), 0x04 for 0x4 and 0x6 (all but 0),
+    // 0x08 for 0x5 (0-A and '_'), 0x10 for 0x7 (0-A) and 0x20 for high nibbles without characters
+    const __m128i invalid_low = _mm_setr_epi8(0x25, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21,
+                                              0x21, 0x21, 0x23, 0x3b, 0x3b, 0x3a, 0x3b, 0x33);
+    const __m128i kind_high = _mm_setr_epi8(0x20, 0x20, 0x01, 0x02, 0x04, 0x08, 0x04, 0x10,
+                                            0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20);
+    __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(invalid_low, low), _mm_shuffle_epi8(kind_high, high));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) != 0xffff)
+      return false;
+
+    // Within a high nibble every character is shifted by the same amount, except for '_' among 'P'-'Z'
+    const __m128i shifts = _mm_setr_epi8(0, 0, '-' - 62, '0' - 52, 'A', 'A', 'a' - 26, 'a' - 26, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i shift = _mm_sub_epi8(_mm_shuffle_epi8(shifts, high),
+                                 _mm_and_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('_')), _mm_set1_epi8('A' - ('_' - 63))));
+    values = _mm_sub_epi8(chars, shift);
+    return true;
+  }
+
+  std::size_t decode_base64_blocks(const char *in, std::size_t length, unsigned char *out)
+  {
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16, out += 12)
+    {
+      __m128i values;
+      if (!base64_to_values(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), values))
+        break; // Let the scalar code decode up to the first character outside the alphabet
+      // Pack pairs of 6 bit values into 12 bits, then pairs of those into 24 bits per 32 bit lane
+      __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+      __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+      __m128i bytes = _mm_shuffle_epi8(groups, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+      // Exactly 12 bytes, the buffer may end right after them
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out), bytes);
+      std::uint32_t last = static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(bytes, 8)));
+      memcpy(out + 8, &last, sizeof(last));
+    }
+    return i;
+  }
+#elif defined(ENCODERS_NEON)
+  /// @brief a table of 64 bytes for vqtbl4q_u8
+  inline uint8x16x4_t load_table(const std::uint8_t *table)
+  {
+    return {vld1q_u8(table), vld1q_u8(table + 16), vld1q_u8(table + 32), vld1q_u8(table + 48)};
+  }
+
+  std::size_t encode_base64_blocks(const unsigned char *data, std::size_t length, char *out)
+  {
+    const uint8x16x4_t alphabet = load_table(reinterpret_cast<const std::uint8_t *>(BASE64_CHARS));
+    const uint8x16_t six_bits = vdupq_n_u8(0x3f);
+    std::size_t i = 0;
+    for (; i + 48 <= length; i += 48, out += 64)
+    {
+      // Splits the first, second and third byte of each group on the way in
+      uint8x16x3_t bytes = vld3q_u8(data + i);
+      uint8x16x4_t chars;
+      chars.val[0] = vqtbl4q_u8(alphabet, vshrq_n_u8(bytes.val[0], 2));
+      chars.val[1] = vqtbl4q_u8(alphabet, vandq_u8(vorrq_u8(vshlq_n_u8(bytes.val[0], 4), vshrq_n_u8(bytes.val[1], 4)), six_bits));
+      chars.val[2] = vqtbl4q_u8(alphabet, vandq_u8(vorrq_u8(vshlq_n_u8(bytes.val[1], 2), vshrq_n_u8(bytes.val[2], 6)), six_bits));
+      chars.val[3] = vqtbl4q_u8(alphabet, vandq_u8(bytes.val[2], six_bits));
+      // Interleaves the four characters of each group on the way out
+      vst4q_u8(reinterpret_cast<uint8_t *>(out), chars);
+    }
+    return i;
+  }
+
+  std::size_t decode_base64_blocks(const char *in, std::size_t length, unsigned char *out)
+  {
+    // BASE64_TABLE for ASCII, which is as far as the alphabet goes
+    const uint8x16x4_t low_table = load_table(BASE64_TABLE.values);
+    const uint8x16x4_t high_table = load_table(BASE64_TABLE.values + 64);
+    const uint8x16_t sixty_four = vdupq_n_u8(64);
+    std::size_t i = 0;
+    for (; i + 64 <= length; i += 64, out += 48)
+    {
+      uint8x16x4_t chars = vld4q_u8(reinterpret_cast<const uint8_t *>(in + i));
+      uint8x16x4_t values;
+      uint8x16_t invalid = vdupq_n_u8(0);
+      for (int j = 0; j < 4; j++)
+      {
+        // Indexes past a table give 0 from vqtbl4q and leave the value alone in vqtbx4q,
+        // so bytes above 127 come out as 0 and are caught by their top bit instead
+        values.val[j] = vqtbx4q_u8(vqtbl4q_u8(low_table, chars.val[j]), high_table, vsubq_u8(chars.val[j], sixty_four));
+        invalid = vorrq_u8(invalid, vorrq_u8(values.val[j], vandq_u8(chars.val[j], vdupq_n_u8(0x80))));
+      }
+      // Valid values fit in 6 bits, INVALID and non-ASCII bytes don't
+      if (vmaxvq_u8(invalid) > 0x3f)
+        break; // Let the scalar code decode up to the first character outside the alphabet
+      uint8x16x3_t bytes;
+      bytes.val[0] = vorrq_u8(vshlq_n_u8(values.val[0], 2), vshrq_n_u8(values.val[1], 4));
+      bytes.val[1] = vorrq_u8(vshlq_n_u8(values.val[1], 4), vshrq_n_u8(values.val[2], 2));
+      bytes.val[2] = vorrq_u8(vshlq_n_u8(values.val[2], 6), values.val[3]);
+      vst3q_u8(out, bytes);
+    }
+    return i;
+  }
+#else
+  std::size_t encode_base64_blocks(const unsigned char *, std::size_t, char *) { return 0; }
+  std::size_t decode_base64_blocks(const char *, std::size_t, unsigned char *) { return 0; }
+#endif
 }
 
-std::vector<unsigned char> encoders::hex_to_binary(const std::string &hex)
+void encoders::binary_to_hex(const unsigned char *data, std::size_t length, char *out)
 {
-  std::vector<unsigned char> binary;
-  for (size_t i = 0; i < hex.length(); i += 2)
+  for (std::size_t i = encode_hex_blocks(data, length, out); i < length; i++)
   {
-    uint8_t byte = std::stoi(hex.substr(i, 2), nullptr, 16);
-    binary.push_back(static_cast<char>(byte));
+    out[2 * i] = HEX_PAIRS.pairs[data[i]][0];
+    out[2 * i + 1] = HEX_PAIRS.pairs[data[i]][1];
   }
-  return binary;
 }
 
-std::string encoders::base64_encode(const std::vector<unsigned char> &in)
+std::size_t encoders::hex_to_binary(const char *hex, std::size_t length, unsigned char *out)
 {
-  std::string out;
-  out.reserve(in.size() * 2); // Should give it a good head start
-  int val = 0, valb = -6;
-  for (unsigned char c : in)
-  {
-    val = (val << 8) + c;
-    valb += 8;
-    while (valb >= 0)
-    {
-      out.push_back(base64_chars[(val >> valb) & 0x3F]);
-      valb -= 6;
-    }
+  std::size_t i = decode_hex_blocks(hex, length, out);
+  for (; i + 2 <= length; i += 2)
+    out[i / 2] = hex_value(hex[i]) << 4 | hex_value(hex[i + 1]);
+  // An odd digit at the end has always been decoded as a byte of its own
+  if (i < length)
+    out[i / 2] = hex_value(hex[i]);
+  return hex_decoded_length(length);
+}
+
+bool encoders::is_hex(const char *hex, std::size_t length)
+{
+  for (std::size_t i = 0; i < length; i++)
+    if (HEX_TABLE.values[static_cast<unsigned char>(hex[i])] == INVALID)
+      return false;
+  return true;
+}
+
+std::size_t encoders::base64_encode(const unsigned char *data, std::size_t length, char *out)
+{
+  char *start = out;
+  std::size_t i = encode_base64_blocks(data, length, out);
+  out += i / 3 * 4;
+  for (; i + 3 <= length; i += 3)
+  {
+    std::uint32_t block = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+    out[0] = BASE64_CHARS[block >> 18];
+    out[1] = BASE64_CHARS[(block >> 12) & 0x3f];
+    out[2] = BASE64_CHARS[(block >> 6) & 0x3f];
+    out[3] = BASE64_CHARS[block & 0x3f];
+    out += 4;
   }
-  if (valb > -6)
-    out.push_back(base64_chars[((val << 8) >> (valb + 8)) & 0x3F]);
-  while (out.size() % 4)
-    out.push_back('=');
-  return out;
+  if (i < length)
+  {
+    std::uint32_t block = data[i] << 16 | (i + 1 < length ? data[i + 1] << 8 : 0);
+    out[0] = BASE64_CHARS[block >> 18];
+    out[1] = BASE64_CHARS[(block >> 12) & 0x3f];
+    out[2] = i + 1 < length ? BASE64_CHARS[(block >> 6) & 0x3f] : '=';
+    out[3] = '=';
+    out += 4;
+  }
+  return out - start;
 }
-std::vector<unsigned char> encoders::base64_decode(const std::string &in)
+
+std::size_t encoders::base64_decode(const char *in, std::size_t length, unsigned char *out)
 {
-  std::vector<int> T(256, -1);
-  for (int i = 0; i < 64; i++)
-    T[base64_chars[i]] = i;
-  std::vector<unsigned char> out;
-  out.reserve(in.length()); // Give it a sufficient base to work off of
-  std::vector<int> val(4, 0);
-  int valb = -8;
-  for (unsigned char c : in)
-  {
-    if (T[c] == -1)
+  unsigned char *start = out;
+  const unsigned char *chars = reinterpret_cast<const unsigned char *>(in);
+  std::size_t i = decode_base64_blocks(in, length, out);
+  out += i / 4 * 3;
+  // Whole blocks of four valid characters
+  for (; i + 4 <= length; i += 4)
+  {
+    std::uint8_t a = BASE64_TABLE.values[chars[i]], b = BASE64_TABLE.values[chars[i + 1]],
+                 c = BASE64_TABLE.values[chars[i + 2]], d = BASE64_TABLE.values[chars[i + 3]];
+    // Valid values fit in 6 bits, INVALID doesn't
+    if ((a | b | c | d) & 0xc0)
+      break;
+    std::uint32_t block = a << 18 | b << 12 | c << 6 | d;
+    out[0] = block >> 16;
+    out[1] = block >> 8;
+    out[2] = block;
+    out += 3;
+  }
+  // Whatever is left, up to the first character outside the alphabet. Leftover bits are dropped.
+  std::uint32_t block = 0;
+  int bits = 0;
+  for (; i < length; i++)
+  {
+    std::uint8_t value = BASE64_TABLE.values[chars[i]];
+    if (value == INVALID)
       break;
-    valb += 6;
-    val[valb / 8] = val[valb / 8] << 6 | T[c];
-    if (valb >= 0)
+    block = block << 6 | value;
+    bits += 6;
+    if (bits >= 8)
     {
-      out.push_back(char((val[valb / 8] >> (valb % 8)) & 0xFF));
-      valb -= 8;
+      bits -= 8;
+      *out++ = block >> bits;
     }
   }
+  return out - start;
+}
+
+std::string encoders::binary_to_hex(const unsigned char *data, std::size_t length)
+{
+  std::string hex(hex_encoded_length(length), '\0');
+  binary_to_hex(data, length, hex.data());
+  return hex;
+}
+
+std::vector<unsigned char> encoders::hex_to_binary(const std::string &hex)
+{
+  std::vector<unsigned char> binary(hex_decoded_length(hex.size()));
+  hex_to_binary(hex.data(), hex.size(), binary.data());
+  return binary;
+}
+
+std::string encoders::base64_encode(const std::vector<unsigned char> &in)
+{
+  std::string out(base64_encoded_length(in.size()), '\0');
+  base64_encode(in.data(), in.size(), out.data());
+  return out;
+}
+
+std::vector<unsigned char> encoders::base64_decode(const std::string &in)
+{
+  std::vector<unsigned char> out(base64_decoded_max_length(in.size()));
+  out.resize(base64_decode(in.data(), in.size(), out.data()));
   return out;
 }
@@ -0,0 +1,171 @@
+#include "envelope.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+#include "commonrand.hpp"
+#include "encoders.hpp"
+
+namespace
+{
+  const char WRAP_LABEL[] = "Port envelope key wrap v1";
+
+  /// @brief Derive the key that wraps content keys from a shared secret, so the secret
+  /// itself is never used as a GCM key next to its other uses
+  void wrapping_key(const std::vector<unsigned char> &secret, unsigned char *key)
+  {
+    if (secret.size() < aesgcm::KEY_LENGTH)
+      throw std::runtime_error("Envelope secrets must be at least 32 bytes long");
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (!ctx)
+      throw std::runtime_error("Could not create digest context");
+    unsigned int length;
+    bool ok = EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1 &&
+              EVP_DigestUpdate(ctx, WRAP_LABEL, sizeof(WRAP_LABEL) - 1) == 1 &&
+              EVP_DigestUpdate(ctx, secret.data(), aesgcm::KEY_LENGTH) == 1 &&
+              EVP_DigestFinal_ex(ctx, key, &length) == 1;
+    EVP_MD_CTX_free(ctx);
+    if (!ok)
+      throw std::runtime_error("Could not derive the envelope wrapping key");
+  }
+}
+
+envelope::Sealed envelope::seal(const unsigned char *plaintext, std::size_t length, const std::vector<std::vector<unsigned char>> &secrets)
+{
+  Sealed sealed;
+  unsigned char content_key[aesgcm::KEY_LENGTH];
+  commonrand::bytes(content_key, sizeof(content_key));
+
+  // Encrypt the payload once
+  sealed.payload.resize(PAYLOAD_OVERHEAD + length);
+  unsigned char *version = sealed.payload.data();
+  unsigned char *iv = version + 1;
+  unsigned char *tag = iv + aesgcm::IV_LENGTH;
+  unsigned char *ciphertext = tag + aesgcm::TAG_LENGTH;
+  *version = VERSION;
+  commonrand::bytes(iv, aesgcm::IV_LENGTH);
+  aesgcm::seal(content_key, iv, version, 1, plaintext, length, ciphertext, tag);
+
+  // Then wrap only the content key for every member
+  sealed.wrapped_keys.reserve(secrets.size());
+  unsigned char key[aesgcm::KEY_LENGTH];
+  for (const auto &secret : secrets)
+  {
+    wrapping_key(secret, key);
+    std::vector<unsigned char> wrapped(WRAPPED_KEY_LENGTH);
+    unsigned char *wrap_iv = wrapped.data();
+    unsigned char *wrap_tag = wrap_iv + aesgcm::IV_LENGTH;
+    commonrand::bytes(wrap_iv, aesgcm::IV_LENGTH);
+    // version | payload IV is the start of the payload
+    aesgcm::seal(key, wrap_iv, version, 1 + aesgcm::IV_LENGTH,
+                 content_key, sizeof(content_key), wrap_tag + aesgcm::TAG_LENGTH, wrap_tag);
+    sealed.wrapped_keys.push_back(std::move(wrapped));
+  }
+
+  OPENSSL_cleanse(key, sizeof(key));
+  OPENSSL_cleanse(content_key, sizeof(content_key));
+  return sealed;
+}
+
+std::vector<unsigned char> envelope::open(const unsigned char *payload, std::size_t payload_length,
+                                          const unsigned char *wrapped_key, std::size_t wrapped_key_length,
+                                          const std::vector<unsigned char> &secret)
+{
+  std::vector<unsigned char> plaintext;
+  auto status = try_open(payload, payload_length, wrapped_key, wrapped_key_length, secret, plaintext);
+  if (status != decryption::Status::ok)
+    throw std::runtime_error(decryption::describe(status));
+  return plaintext;
+}
+
+decryption::Status envelope::try_open(const unsigned char *payload, std::size_t payload_length,
+                                      const unsigned char *wrapped_key, std::size_t wrapped_key_length,
+                                      const std::vector<unsigned char> &secret,
+                                      std::vector<unsigned char> &plaintext)
+{
+  if (payload_length < PAYLOAD_OVERHEAD || wrapped_key_length != WRAPPED_KEY_LENGTH)
+    return decryption::Status::malformed;
+  if (payload[0] != VERSION)
+    return decryption::Status::unsupported_version;
+  if (secret.size() < aesgcm::KEY_LENGTH)
+    return decryption::Status::bad_key;
+
+  unsigned char key[aesgcm::KEY_LENGTH];
+  wrapping_key(secret, key);
+  unsigned char content_key[aesgcm::KEY_LENGTH];
+  const unsigned char *wrap_iv = wrapped_key;
+  const unsigned char *wrap_tag = wrap_iv + aesgcm::IV_LENGTH;
+  bool unwrapped = aesgcm::open(key, wrap_iv, payload, 1 + aesgcm::IV_LENGTH,
+                                wrap_tag + aesgcm::TAG_LENGTH, sizeof(content_key), wrap_tag, content_key);
+  OPENSSL_cleanse(key, sizeof(key));
+  if (!unwrapped)
+  {
+    OPENSSL_cleanse(content_key, sizeof(content_key));
+    return decryption::Status::bad_tag;
+  }
+
+  const unsigned char *iv = payload + 1;
+  const unsigned char *tag = iv + aesgcm::IV_LENGTH;
+  const unsigned char *ciphertext = tag + aesgcm::TAG_LENGTH;
+  plaintext.resize(payload_length - PAYLOAD_OVERHEAD);
+  bool opened = aesgcm::open(content_key, iv, payload, 1, ciphertext, plaintext.size(), tag, plaintext.data());
+  OPENSSL_cleanse(content_key, sizeof(content_key));
+  if (!opened)
+  {
+    plaintext.clear();
+    return decryption::Status::bad_tag;
+  }
+  return decryption::Status::ok;
+}
+
+std::string envelope::seal(const std::string &plaintext, const std::vector<std::string> &secrets_hex,
+                           std::vector<std::string> &wrapped_keys_b64)
+{
+  std::vector<std::vector<unsigned char>> secrets;
+  secrets.reserve(secrets_hex.size());
+  for (const auto &secret_hex : secrets_hex)
+    secrets.push_back(encoders::hex_to_binary(secret_hex));
+  Sealed sealed = seal(reinterpret_cast<const unsigned char *>(plaintext.data()), plaintext.size(), secrets);
+  for (auto &secret : secrets)
+    OPENSSL_cleanse(secret.data(), secret.size());
+
+  wrapped_keys_b64.clear();
+  wrapped_keys_b64.reserve(sealed.wrapped_keys.size());
+  for (const auto &wrapped : sealed.wrapped_keys)
+    wrapped_keys_b64.push_back(encoders::base64_encode(wrapped));
+  return encoders::base64_encode(sealed.payload);
+}
+
+std::string envelope::open(const std::string &payload_b64, const std::string &wrapped_key_b64, const std::string &secret_hex)
+{
+  std::string plaintext;
+  try
+  {
+    // Only what isn't the envelope's fault still throws
+    if (try_open(payload_b64, wrapped_key_b64, secret_hex, plaintext) != decryption::Status::ok)
+      return "error";
+  }
+  catch (const std::exception &e)
+  {
+    return "error";
+  }
+  return plaintext;
+}
+
+decryption::Status envelope::try_open(const std::string &payload_b64, const std::string &wrapped_key_b64, const std::string &secret_hex,
+                                      std::string &plaintext)
+{
+  if (!encoders::is_hex(secret_hex.data(), secret_hex.size()))
+    return decryption::Status::bad_key;
+  auto secret = encoders::hex_to_binary(secret_hex);
+  auto payload = encoders::base64_decode(payload_b64);
+  auto wrapped_key = encoders::base64_decode(wrapped_key_b64);
+  std::vector<unsigned char> plaintext_bin;
+  auto status = try_open(payload.data(), payload.size(), wrapped_key.data(), wrapped_key.size(), secret, plaintext_bin);
+  OPENSSL_cleanse(secret.data(), secret.size());
+  if (status == decryption::Status::ok)
+    plaintext.assign(plaintext_bin.begin(), plaintext_bin.end());
+  return status;
+}
@@ -0,0 +1,136 @@
+#include "keypool.hpp"
+
+#include <exception>
+#include <stdexcept>
+#include <openssl/crypto.h>
+
+keypool::EphemeralPool::EphemeralPool(std::size_t capacity, std::size_t low_watermark, workpool::WorkerPool &workers)
+    : capacity(capacity), low_watermark(low_watermark), workers(workers)
+{
+  if (low_watermark > capacity)
+    throw std::invalid_argument("The low watermark can't be above the capacity of the key pool");
+  // Taking a keypair never allocates
+  ready.reserve(capacity);
+}
+
+keypool::EphemeralPool::~EphemeralPool()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  stopping = true;
+  refilled.wait(guard, [this]
+                { return !refilling; });
+  for (auto &pair : ready)
+    wipe(pair);
+}
+
+void keypool::EphemeralPool::take(x25519::fixed_key &private_key, x25519::fixed_key &public_key)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready.empty())
+    {
+      auto &pair = ready.back();
+      private_key = pair.private_key;
+      public_key = pair.public_key;
+      wipe(pair);
+      ready.pop_back();
+      refill_if_low();
+      return;
+    }
+    refill_if_low();
+  }
+  // Ran dry, don't make the caller wait for the refill
+  x25519::generate_keypair(private_key, public_key);
+}
+
+void keypool::EphemeralPool::configure(std::size_t capacity, std::size_t low_watermark)
+{
+  if (low_watermark > capacity)
+    throw std::invalid_argument("The low watermark can't be above the capacity of the key pool");
+  std::lock_guard<std::mutex> guard(lock);
+  this->capacity = capacity;
+  this->low_watermark = low_watermark;
+  while (ready.size() > capacity)
+  {
+    wipe(ready.back());
+    ready.pop_back();
+  }
+  ready.reserve(capacity);
+  refill_if_low();
+}
+
+void keypool::EphemeralPool::fill()
+{
+  while (true)
+  {
+    KeyPair pair;
+    x25519::generate_keypair(pair.private_key, pair.public_key);
+    std::lock_guard<std::mutex> guard(lock);
+    if (ready.size() >= capacity)
+    {
+      wipe(pair);
+      return;
+    }
+    ready.push_back(pair);
+    wipe(pair);
+  }
+}
+
+std::size_t keypool::EphemeralPool::available()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return ready.size();
+}
+
+void keypool::EphemeralPool::refill_if_low()
+{
+  if (refilling || stopping || ready.size() >= low_watermark)
+    return;
+  refilling = true;
+  // Messages are sent while backups run, so the refill mustn't queue behind them
+  workers.submit(workpool::Lane::interactive, [this]
+                 { refill(); });
+}
+
+void keypool::EphemeralPool::refill()
+{
+  try
+  {
+    while (true)
+    {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping || ready.size() >= capacity)
+          break;
+      }
+      // Generate outside the lock so take() isn't held up
+      KeyPair pair;
+      x25519::generate_keypair(pair.private_key, pair.public_key);
+      std::lock_guard<std::mutex> guard(lock);
+      if (ready.size() < capacity)
+        ready.push_back(pair);
+      wipe(pair);
+    }
+  }
+  catch (const std::exception &)
+  {
+    // Jobs must not throw. take() generates keypairs itself until the next refill works.
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  refilling = false;
+  refilled.notify_all();
+}
+
+void keypool::EphemeralPool::wipe(KeyPair &pair)
+{
+  OPENSSL_cleanse(pair.private_key.data(), pair.private_key.size());
+  OPENSSL_cleanse(pair.public_key.data(), pair.public_key.size());
+}
+
+keypool::EphemeralPool &keypool::shared()
+{
+  // Constructing the worker pool first makes sure it outlives the key pool
+  workpool::shared();
+  static EphemeralPool pool;
+  return pool;
+}
@@ -0,0 +1,144 @@
+#include "keystore.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+namespace
+{
+  // Locked memory for secrets. Allocations fall back to the normal heap if it can't be set up.
+  const std::size_t SECURE_HEAP_SIZE = 64 * 1024;
+  const std::size_t SECURE_HEAP_MIN_ALLOCATION = 32;
+
+  std::mutex lock;
+  std::unordered_map<keystore::Handle, std::shared_ptr<const keystore::Key>> keys;
+  keystore::Handle last_handle = 0;
+
+  void init_secure_heap()
+  {
+    static std::once_flag initialized;
+    std::call_once(initialized, []
+                   { CRYPTO_secure_malloc_init(SECURE_HEAP_SIZE, SECURE_HEAP_MIN_ALLOCATION); });
+  }
+
+  keystore::Handle add(std::shared_ptr<const keystore::Key> key)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (last_handle == UINT32_MAX)
+      throw std::runtime_error("Ran out of key handles");
+    keys[++last_handle] = std::move(key);
+    return last_handle;
+  }
+}
+
+keystore::Key::Key(Kind kind, const unsigned char *data, std::size_t size) : type(kind), length(size)
+{
+  init_secure_heap();
+  bytes = static_cast<unsigned char *>(OPENSSL_secure_malloc(size ? size : 1));
+  // Once the secure heap is full, keep going on the normal heap. OPENSSL_secure_clear_free handles both.
+  if (!bytes)
+    bytes = static_cast<unsigned char *>(OPENSSL_malloc(size ? size : 1));
+  if (!bytes)
+    throw std::runtime_error("Could not allocate memory for a key");
+  memcpy(bytes, data, size);
+  if (kind != Kind::x25519_private_key)
+    return;
+
+  if (size != x25519::PRIVATE_KEY_LENGTH)
+  {
+    OPENSSL_secure_clear_free(bytes, length);
+    throw std::runtime_error("X25519 private keys must be 32 bytes long");
+  }
+  private_key = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, nullptr, bytes, length);
+  std::size_t public_key_length = public_key_bin.size();
+  if (!private_key || EVP_PKEY_get_raw_public_key(private_key, public_key_bin.data(), &public_key_length) != 1)
+  {
+    EVP_PKEY_free(private_key);
+    OPENSSL_secure_clear_free(bytes, length);
+    throw std::runtime_error("Could not load X25519 private key");
+  }
+}
+
+keystore::Key::~Key()
+{
+  EVP_PKEY_free(private_key);
+  OPENSSL_secure_clear_free(bytes, length ? length : 1);
+}
+
+keystore::Handle keystore::add_secret(const unsigned char *secret, std::size_t length)
+{
+  return add(std::make_shared<const Key>(Kind::secret, secret, length));
+}
+
+keystore::Handle keystore::add_x25519_private_key(const unsigned char *private_key)
+{
+  return add(std::make_shared<const Key>(Kind::x25519_private_key, private_key, x25519::PRIVATE_KEY_LENGTH));
+}
+
+keystore::Handle keystore::generate_x25519(x25519::fixed_key &public_key)
+{
+  x25519::fixed_key private_key;
+  x25519::generate_keypair(private_key, public_key);
+  try
+  {
+    Handle handle = add_x25519_private_key(private_key.data());
+    OPENSSL_cleanse(private_key.data(), private_key.size());
+    return handle;
+  }
+  catch (...)
+  {
+    OPENSSL_cleanse(private_key.data(), private_key.size());
+    throw;
+  }
+}
+
+keystore::Handle keystore::derive_x25519_secret(Handle private_key, const unsigned char *peer_public_key)
+{
+  auto key = get(private_key, Kind::x25519_private_key);
+  x25519::fixed_key secret;
+  x25519::derive_secret(key->pkey(), peer_public_key, secret.data());
+  try
+  {
+    Handle handle = add_secret(secret.data(), secret.size());
+    OPENSSL_cleanse(secret.data(), secret.size());
+    return handle;
+  }
+  catch (...)
+  {
+    OPENSSL_cleanse(secret.data(), secret.size());
+    throw;
+  }
+}
+
+std::shared_ptr<const keystore::Key> keystore::get(Handle handle, Kind kind)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = keys.find(handle);
+  if (found == keys.end())
+    throw std::runtime_error("Unknown key handle");
+  if (found->second->kind() != kind)
+    throw std::runtime_error("Key handle refers to a different kind of key");
+  return found->second;
+}
+
+void keystore::remove(Handle handle)
+{
+  std::shared_ptr<const Key> removed;
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = keys.find(handle);
+  if (found == keys.end())
+    return;
+  // Wiped when the last user lets go, outside the lock if that's us
+  removed = std::move(found->second);
+  keys.erase(found);
+}
+
+void keystore::clear()
+{
+  std::unordered_map<Handle, std::shared_ptr<const Key>> removed;
+  std::lock_guard<std::mutex> guard(lock);
+  removed.swap(keys);
+}
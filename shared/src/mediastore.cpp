@@ -0,0 +1,244 @@
+#include "mediastore.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <dirent.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <sys/stat.h>
+
+#include "aes256.hpp"
+#include "commonrand.hpp"
+#include "encoders.hpp"
+
+namespace
+{
+  bool has_suffix(const std::string &name, const std::string &suffix)
+  {
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  /// @brief Encrypt a file into the store, hashing both sides on the way
+  /// @return the size of the ciphertext
+  std::uint64_t encrypt_and_hash(const std::string &path_to_input, const std::string &path_to_output,
+                                 unsigned char *key, unsigned char *iv, aes256::FileDigests &digests)
+  {
+    std::ifstream in_stream(path_to_input, std::ios::binary);
+    if (!in_stream.is_open())
+      throw std::runtime_error("Could not open the file for the media store");
+    std::ofstream out_stream(path_to_output, std::ios::binary);
+    if (!out_stream.is_open())
+      throw std::runtime_error("Could not create a file in the media store");
+
+    std::uint64_t written = aes256::encrypt_file(in_stream, out_stream, key, iv, digests);
+    out_stream.close();
+    if (!out_stream)
+      throw std::runtime_error("Could not write to the media store");
+    return written;
+  }
+
+  std::mutex shared_lock;
+  std::unique_ptr<mediastore::Store> shared_store;
+  std::string shared_directory;
+}
+
+mediastore::Store::Store(const std::string &directory, std::uint64_t budget) : directory(directory), budget(budget)
+{
+  if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST)
+    throw std::runtime_error("Could not create the media store directory");
+  // Ciphertexts of a previous run are useless without their keys
+  DIR *dir = opendir(directory.c_str());
+  if (!dir)
+    throw std::runtime_error("Could not open the media store directory");
+  while (struct dirent *file = readdir(dir))
+  {
+    std::string name = file->d_name;
+    if (has_suffix(name, ".enc") || has_suffix(name, ".part"))
+      std::remove((directory + "/" + name).c_str());
+  }
+  closedir(dir);
+}
+
+mediastore::Store::~Store()
+{
+  clear();
+}
+
+mediastore::Store::Identity mediastore::Store::identify(const std::string &path)
+{
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0)
+    throw std::runtime_error("Could not open the file for the media store");
+#if defined(__APPLE__)
+  const struct timespec &modified = info.st_mtimespec;
+#else
+  const struct timespec &modified = info.st_mtim;
+#endif
+  return Identity(info.st_dev, info.st_ino, info.st_size, modified.tv_sec, modified.tv_nsec);
+}
+
+mediastore::Stored mediastore::Store::put(const std::string &path_to_input)
+{
+  Identity identity = identify(path_to_input);
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto known = identities.find(identity);
+    if (known != identities.end())
+    {
+      counters.hits++;
+      return pin(index.at(known->second), true);
+    }
+  }
+
+  // Encrypt outside the lock into a file of its own, other puts carry on meanwhile
+  unsigned char key[EVP_MAX_KEY_LENGTH];
+  unsigned char iv[EVP_MAX_IV_LENGTH];
+  aes256::generate_random_key(key);
+  aes256::generate_random_iv(iv);
+  std::string part_path = directory + "/" + commonrand::hex(8) + ".part";
+  aes256::FileDigests digests;
+  std::uint64_t size;
+  try
+  {
+    size = encrypt_and_hash(path_to_input, part_path, key, iv, digests);
+  }
+  catch (...)
+  {
+    std::remove(part_path.c_str());
+    OPENSSL_cleanse(key, sizeof(key));
+    throw;
+  }
+  std::string digest = encoders::binary_to_hex(digests.plaintext.data(), digests.plaintext.size());
+  std::string key_and_iv = aes256::combine_key_and_iv(key, iv);
+  OPENSSL_cleanse(key, sizeof(key));
+  // Only vouch for the identity if the file didn't change while it was read
+  bool unchanged = identify(path_to_input) == identity;
+
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = index.find(digest);
+  bool hit = found != index.end();
+  if (hit)
+  {
+    // The same content under another name, or a put that finished first
+    std::remove(part_path.c_str());
+    counters.hits++;
+  }
+  else
+  {
+    std::string path = directory + "/" + digest + ".enc";
+    if (std::rename(part_path.c_str(), path.c_str()) != 0)
+    {
+      std::remove(part_path.c_str());
+      throw std::runtime_error("Could not move the ciphertext into the media store");
+    }
+    entries.push_front(Entry{digest, path, key_and_iv, size, 0, {}});
+    found = index.emplace(digest, entries.begin()).first;
+    counters.bytes += size;
+    counters.misses++;
+  }
+  if (unchanged && !identities.count(identity))
+  {
+    identities[identity] = digest;
+    found->second->identities.push_back(identity);
+  }
+  Stored stored = pin(found->second, hit);
+  evict();
+  return stored;
+}
+
+mediastore::Stored mediastore::Store::pin(std::list<Entry>::iterator entry, bool hit)
+{
+  entries.splice(entries.begin(), entries, entry);
+  entry->pins++;
+  Stored stored;
+  stored.digest = entry->digest;
+  stored.path = entry->path;
+  stored.key_and_iv = entry->key_and_iv;
+  stored.hit = hit;
+  return stored;
+}
+
+void mediastore::Store::release(const std::string &digest)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = index.find(digest);
+  if (found == index.end() || found->second->pins == 0)
+    return;
+  found->second->pins--;
+  evict();
+}
+
+void mediastore::Store::set_budget(std::uint64_t new_budget)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  budget = new_budget;
+  evict();
+}
+
+void mediastore::Store::evict()
+{
+  // From the least recently used end, skipping whatever is pinned
+  auto entry = entries.end();
+  while (counters.bytes > budget && entry != entries.begin())
+  {
+    --entry;
+    if (entry->pins > 0)
+      continue;
+    auto evicted = entry++;
+    erase(evicted);
+    counters.evictions++;
+  }
+}
+
+void mediastore::Store::erase(std::list<Entry>::iterator entry)
+{
+  std::remove(entry->path.c_str());
+  OPENSSL_cleanse(&entry->key_and_iv[0], entry->key_and_iv.size());
+  for (const auto &identity : entry->identities)
+    identities.erase(identity);
+  counters.bytes -= entry->size;
+  index.erase(entry->digest);
+  entries.erase(entry);
+}
+
+void mediastore::Store::clear()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  while (!entries.empty())
+    erase(entries.begin());
+}
+
+mediastore::Stats mediastore::Store::stats()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Stats current = counters;
+  current.entries = entries.size();
+  current.budget = budget;
+  return current;
+}
+
+mediastore::Store &mediastore::open(const std::string &directory, std::uint64_t budget)
+{
+  std::lock_guard<std::mutex> guard(shared_lock);
+  if (!shared_store)
+  {
+    shared_store = std::make_unique<Store>(directory, budget);
+    shared_directory = directory;
+    return *shared_store;
+  }
+  if (directory != shared_directory)
+    throw std::runtime_error("The media store is already open in another directory");
+  shared_store->set_budget(budget);
+  return *shared_store;
+}
+
+mediastore::Store &mediastore::shared()
+{
+  std::lock_guard<std::mutex> guard(shared_lock);
+  if (!shared_store)
+    throw std::runtime_error("The media store has not been opened");
+  return *shared_store;
+}
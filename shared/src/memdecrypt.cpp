@@ -0,0 +1,97 @@
+#include "memdecrypt.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+#include "aes256.hpp"
+#include "chunkedfile.hpp"
+#include "decryption.hpp"
+#include "encoders.hpp"
+
+namespace
+{
+  /// @brief The binary form of aes256::combine_key_and_iv, wiped when it goes out of scope
+  struct FileKey
+  {
+    unsigned char iv[EVP_MAX_IV_LENGTH];
+    unsigned char key[EVP_MAX_KEY_LENGTH];
+    ~FileKey() { OPENSSL_cleanse(this, sizeof(*this)); }
+  };
+
+  void parse_key(const std::string &key_and_iv, FileKey &file_key)
+  {
+    static_assert(2 * sizeof(FileKey) == aes256::KEY_AND_IV_HEX_LENGTH, "FileKey must hold what combine_key_and_iv encodes");
+    if (key_and_iv.size() != aes256::KEY_AND_IV_HEX_LENGTH || !encoders::is_hex(key_and_iv.data(), key_and_iv.size()))
+      throw std::runtime_error(decryption::describe(decryption::Status::bad_key));
+    encoders::hex_to_binary(key_and_iv.data(), key_and_iv.size(), reinterpret_cast<unsigned char *>(&file_key));
+  }
+
+  std::vector<unsigned char> decrypt_v1(const std::string &path, const FileKey &file_key, std::size_t max_size)
+  {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+      throw std::runtime_error("Could not open input file for decryption");
+    std::streamoff end = in.tellg();
+    if (end < 0)
+      throw std::runtime_error("Could not read input file for decryption");
+    std::uint64_t size = static_cast<std::uint64_t>(end);
+    // Padding takes at most a block, anything longer certainly holds more than max_size bytes
+    if (size > aes256::IV_LENGTH && size - aes256::IV_LENGTH > max_size)
+      throw std::runtime_error("The file is too large to decrypt into memory");
+
+    // try_decrypt takes the IV in front of the ciphertext, like messages carry it
+    std::vector<unsigned char> iv_ciphertext(aes256::IV_LENGTH + size);
+    memcpy(iv_ciphertext.data(), file_key.iv, aes256::IV_LENGTH);
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char *>(iv_ciphertext.data() + aes256::IV_LENGTH), size))
+      throw std::runtime_error("Could not read input file for decryption");
+
+    std::vector<unsigned char> plaintext;
+    auto status = aes256::try_decrypt(iv_ciphertext.data(), iv_ciphertext.size(), file_key.key, plaintext);
+    if (status != decryption::Status::ok)
+      throw std::runtime_error(decryption::describe(status));
+    if (plaintext.size() > max_size)
+    {
+      OPENSSL_cleanse(plaintext.data(), plaintext.size());
+      throw std::runtime_error("The file is too large to decrypt into memory");
+    }
+    return plaintext;
+  }
+}
+
+std::vector<unsigned char> memdecrypt::decrypt_file(const std::string &path, const std::string &key_and_iv,
+                                                    std::size_t max_size, workpool::Lane lane)
+{
+  FileKey file_key;
+  parse_key(key_and_iv, file_key);
+  // Version 2 files announce themselves with a header, anything else is a version 1 CBC stream
+  if (!chunkedfile::is_chunked(path))
+    return decrypt_v1(path, file_key, max_size);
+
+  chunkedfile::Reader reader(path, file_key.key, file_key.iv);
+  // The header tells the plaintext size, so nothing is decrypted if it's over the cap
+  if (reader.size() > max_size)
+    throw std::runtime_error("The file is too large to decrypt into memory");
+  return reader.read(0, static_cast<std::size_t>(reader.size()), lane);
+}
+
+std::vector<memdecrypt::Decrypted> memdecrypt::decrypt_many(const std::vector<File> &files, std::size_t max_size,
+                                                            workpool::Lane lane)
+{
+  std::vector<Decrypted> results(files.size());
+  workpool::shared().parallel_for(lane, files.size(), [&](std::size_t i)
+                                  {
+    try
+    {
+      results[i].plaintext = decrypt_file(files[i].path, files[i].key_and_iv, max_size, lane);
+    }
+    catch (const std::exception &e)
+    {
+      results[i].error = e.what();
+    } });
+  return results;
+}
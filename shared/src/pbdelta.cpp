@@ -0,0 +1,451 @@
+#include "pbdelta.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <openssl/evp.h>
+#include <unistd.h>
+
+#include "commonrand.hpp"
+#include "pbencrypt.hpp"
+#include "workpool.hpp"
+
+#define MANIFEST_MAGIC "PORTMAN"
+#define DELTA_MAGIC "PORTDLT"
+// Groups are read this many at a time and hashed in parallel
+#define HASH_BATCH 64
+
+namespace
+{
+  struct ManifestHeader
+  {
+    char magic[8];
+    std::uint32_t group_size;
+    std::uint32_t reserved;
+    std::uint64_t database_size;
+    std::uint64_t sequence;
+    unsigned char chain[pbdelta::CHAIN_ID_LENGTH];
+  };
+  static_assert(sizeof(ManifestHeader) == 48, "The manifest header is written to disk as is and must not contain padding");
+
+  struct DeltaHeader
+  {
+    char magic[8];
+    std::uint32_t group_size;
+    std::uint32_t reserved;
+    std::uint64_t database_size;
+    std::uint64_t sequence;
+    unsigned char chain[pbdelta::CHAIN_ID_LENGTH];
+    std::uint64_t changed_groups;
+  };
+  static_assert(sizeof(DeltaHeader) == 56, "The delta header is written to disk as is and must not contain padding");
+
+  std::uint64_t group_count(std::uint64_t database_size, std::uint32_t group_size)
+  {
+    return (database_size + group_size - 1) / group_size;
+  }
+
+  std::size_t group_length(std::uint64_t database_size, std::uint32_t group_size, std::uint64_t index)
+  {
+    return std::min<std::uint64_t>(group_size, database_size - index * group_size);
+  }
+
+  void hash_group(const unsigned char *data, std::size_t length, pbdelta::GroupHash &hash)
+  {
+    unsigned int hash_length;
+    if (EVP_Digest(data, length, hash.data(), &hash_length, EVP_sha256(), nullptr) != 1)
+      throw std::runtime_error("Could not hash a page group");
+  }
+
+  std::uint64_t file_size(std::ifstream &in)
+  {
+    in.seekg(0, std::ios::end);
+    std::uint64_t size = in.tellg();
+    in.seekg(0);
+    return size;
+  }
+
+  /// @brief hash every group of the database, keeping the chain of the given manifest
+  void hash_database(const std::string &path_to_db, pbdelta::Manifest &manifest)
+  {
+    if (manifest.group_size == 0)
+      throw std::runtime_error("Invalid page group size");
+    std::ifstream db(path_to_db, std::ios::binary);
+    if (!db.is_open())
+      throw std::runtime_error("Could not open database file for hashing");
+    manifest.database_size = file_size(db);
+    const std::uint64_t count = group_count(manifest.database_size, manifest.group_size);
+    manifest.hashes.resize(count);
+
+    std::vector<unsigned char> batch(static_cast<std::size_t>(manifest.group_size) * HASH_BATCH);
+    for (std::uint64_t first = 0; first < count; first += HASH_BATCH)
+    {
+      std::size_t groups = std::min<std::uint64_t>(HASH_BATCH, count - first);
+      std::uint64_t start = first * manifest.group_size;
+      std::size_t length = std::min<std::uint64_t>(batch.size(), manifest.database_size - start);
+      if (!db.read(reinterpret_cast<char *>(batch.data()), length))
+        throw std::runtime_error("Could not read database file for hashing");
+      workpool::shared().parallel_for(workpool::Lane::bulk, groups, [&](std::size_t i)
+                                      { hash_group(batch.data() + i * manifest.group_size,
+                                                   group_length(manifest.database_size, manifest.group_size, first + i),
+                                                   manifest.hashes[first + i]); });
+    }
+  }
+
+  /// @brief Produces the plaintext of a delta: the header, then every changed group behind its index
+  class DeltaSource
+  {
+  public:
+    DeltaSource(const std::string &path_to_db, const DeltaHeader &header, std::vector<std::uint64_t> changed)
+        : db(path_to_db, std::ios::binary), header(header), changed(std::move(changed))
+    {
+      if (!db.is_open())
+        throw std::runtime_error("Could not open database file for pb encryption");
+      const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&header);
+      pending.assign(bytes, bytes + sizeof(header));
+    }
+
+    std::uint64_t size() const
+    {
+      std::uint64_t total = sizeof(DeltaHeader);
+      for (auto index : changed)
+        total += sizeof(index) + group_length(header.database_size, header.group_size, index);
+      return total;
+    }
+
+    std::size_t fill(unsigned char *buf, std::size_t capacity)
+    {
+      std::size_t filled = 0;
+      while (filled < capacity)
+      {
+        if (consumed == pending.size() && !next_group())
+          break;
+        std::size_t n = std::min(capacity - filled, pending.size() - consumed);
+        memcpy(buf + filled, pending.data() + consumed, n);
+        consumed += n;
+        filled += n;
+      }
+      return filled;
+    }
+
+  private:
+    std::ifstream db;
+    DeltaHeader header;
+    std::vector<std::uint64_t> changed;
+    std::size_t next = 0;
+    std::vector<unsigned char> pending;
+    std::size_t consumed = 0;
+
+    bool next_group()
+    {
+      if (next == changed.size())
+        return false;
+      std::uint64_t index = changed[next++];
+      std::size_t length = group_length(header.database_size, header.group_size, index);
+      pending.resize(sizeof(index) + length);
+      memcpy(pending.data(), &index, sizeof(index));
+      db.seekg(index * header.group_size);
+      if (!db.read(reinterpret_cast<char *>(pending.data() + sizeof(index)), length))
+        throw std::runtime_error("Could not read database file for pb encryption");
+      consumed = 0;
+      return true;
+    }
+  };
+
+  /// @brief Consumes the plaintext of a delta and writes every group into place
+  class DeltaSink
+  {
+  public:
+    /// @param expected_chain the chain the delta must belong to, or nullptr to accept any
+    DeltaSink(const std::string &path_to_db, std::uint64_t expected_sequence, const unsigned char *expected_chain)
+        : path(path_to_db),
+          db(path_to_db, std::ios::binary | std::ios::in | std::ios::out),
+          expected_sequence(expected_sequence),
+          expected_chain(expected_chain)
+    {
+      if (!db.is_open())
+        throw std::runtime_error("Could not open database file to apply a backup delta");
+    }
+
+    void consume(const unsigned char *data, std::size_t length)
+    {
+      while (length > 0)
+      {
+        std::size_t n = std::min(length, wanted - pending.size());
+        pending.insert(pending.end(), data, data + n);
+        data += n;
+        length -= n;
+        if (pending.size() == wanted)
+          advance();
+      }
+    }
+
+    /// @brief check that the whole delta arrived
+    const DeltaHeader &finish()
+    {
+      if (!has_header || state != State::index || !pending.empty() || applied != header.changed_groups)
+        throw std::runtime_error("Backup delta is truncated");
+      db.close();
+      if (db.fail())
+        throw std::runtime_error("Could not write to database file");
+      if (::truncate(path.c_str(), header.database_size) != 0)
+        throw std::runtime_error("Could not resize database file");
+      return header;
+    }
+
+  private:
+    enum class State
+    {
+      header,
+      index,
+      group,
+    };
+
+    std::string path;
+    std::fstream db;
+    std::uint64_t expected_sequence;
+    const unsigned char *expected_chain;
+    DeltaHeader header;
+    bool has_header = false;
+    State state = State::header;
+    std::size_t wanted = sizeof(DeltaHeader);
+    std::vector<unsigned char> pending;
+    std::uint64_t index = 0;
+    std::uint64_t applied = 0;
+
+    void advance()
+    {
+      switch (state)
+      {
+      case State::header:
+        memcpy(&header, pending.data(), sizeof(header));
+        if (memcmp(header.magic, DELTA_MAGIC, sizeof(header.magic)) != 0)
+          throw std::runtime_error("File is not a backup delta");
+        if (header.group_size == 0)
+          throw std::runtime_error("Backup delta has an invalid page group size");
+        if (expected_sequence != 0 && header.sequence != expected_sequence)
+          throw std::runtime_error("Backup delta is out of order");
+        if (expected_chain && memcmp(header.chain, expected_chain, sizeof(header.chain)) != 0)
+          throw std::runtime_error("Backup deltas belong to different backups");
+        has_header = true;
+        state = State::index;
+        wanted = sizeof(index);
+        break;
+      case State::index:
+        memcpy(&index, pending.data(), sizeof(index));
+        if (applied == header.changed_groups || index >= group_count(header.database_size, header.group_size))
+          throw std::runtime_error("Backup delta is corrupted");
+        state = State::group;
+        wanted = group_length(header.database_size, header.group_size, index);
+        break;
+      case State::group:
+        db.seekp(index * header.group_size);
+        if (!db.write(reinterpret_cast<const char *>(pending.data()), pending.size()))
+          throw std::runtime_error("Could not write to database file");
+        applied++;
+        state = State::index;
+        wanted = sizeof(index);
+        break;
+      }
+      pending.clear();
+    }
+  };
+
+  /// @brief copy a file next to where it will be moved back, eg. to patch it without touching the original
+  void copy_file(const std::string &from, const std::string &to)
+  {
+    std::ifstream in(from, std::ios::binary);
+    if (!in.is_open())
+      throw std::runtime_error("Could not open database file to apply a backup delta");
+    std::ofstream out(to, std::ios::binary);
+    if (!out.is_open())
+      throw std::runtime_error("Could not create a copy of the database file");
+    if (in.peek() != std::ifstream::traits_type::eof())
+      out << in.rdbuf();
+    out.close();
+    if (!out)
+      throw std::runtime_error("Could not copy the database file");
+  }
+
+  /// @brief move a finished database over its destination, or remove it if that fails
+  void replace_file(const std::string &temporary, const std::string &path)
+  {
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+      std::remove(temporary.c_str());
+      throw std::runtime_error("Could not replace the database file");
+    }
+  }
+
+  DeltaHeader apply_delta(std::string password, const std::string &path_to_delta, const std::string &path_to_db,
+                          std::uint64_t expected_sequence, const unsigned char *expected_chain,
+                          const pipeline::Progress &progress, std::string &metadata)
+  {
+    DeltaSink sink(path_to_db, expected_sequence, expected_chain);
+    metadata = pbencrypt::decrypt(
+        password, path_to_delta,
+        [&sink](const unsigned char *data, std::size_t length)
+        { sink.consume(data, length); },
+        progress);
+    return sink.finish();
+  }
+}
+
+pbdelta::Manifest pbdelta::create_manifest(const std::string &path_to_db, std::uint32_t group_size)
+{
+  Manifest manifest;
+  manifest.group_size = group_size;
+  commonrand::bytes(manifest.chain.data(), manifest.chain.size());
+  hash_database(path_to_db, manifest);
+  return manifest;
+}
+
+void pbdelta::save_manifest(const Manifest &manifest, const std::string &path)
+{
+  ManifestHeader header;
+  memcpy(header.magic, MANIFEST_MAGIC, sizeof(header.magic));
+  header.group_size = manifest.group_size;
+  header.reserved = 0;
+  header.database_size = manifest.database_size;
+  header.sequence = manifest.sequence;
+  memcpy(header.chain, manifest.chain.data(), sizeof(header.chain));
+
+  // Write next to the destination and move it over, so a crash never leaves half a manifest behind
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary);
+    if (!out.is_open())
+      throw std::runtime_error("Could not open manifest file for writing");
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(manifest.hashes.data()), manifest.hashes.size() * HASH_LENGTH);
+    if (!out.flush())
+      throw std::runtime_error("Could not write manifest file");
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("Could not replace manifest file");
+}
+
+pbdelta::Manifest pbdelta::load_manifest(const std::string &path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+    throw std::runtime_error("Could not open manifest file");
+  ManifestHeader header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      memcmp(header.magic, MANIFEST_MAGIC, sizeof(header.magic)) != 0 || header.group_size == 0)
+    throw std::runtime_error("File is not a backup manifest");
+
+  Manifest manifest;
+  manifest.group_size = header.group_size;
+  manifest.database_size = header.database_size;
+  manifest.sequence = header.sequence;
+  memcpy(manifest.chain.data(), header.chain, sizeof(header.chain));
+  manifest.hashes.resize(group_count(header.database_size, header.group_size));
+  if (!in.read(reinterpret_cast<char *>(manifest.hashes.data()), manifest.hashes.size() * HASH_LENGTH))
+    throw std::runtime_error("Backup manifest is truncated");
+  return manifest;
+}
+
+void pbdelta::encrypt_base(std::string password,
+                           std::string metadata,
+                           const std::string &path_to_db,
+                           const std::string &path_to_dest,
+                           const std::string &path_to_manifest,
+                           const pipeline::Progress &progress)
+{
+  Manifest manifest = create_manifest(path_to_db);
+  pbencrypt::encrypt_base(password, metadata, path_to_db, path_to_dest, manifest.chain.data(),
+                          pbencrypt::Compression::deflate, progress);
+  save_manifest(manifest, path_to_manifest);
+}
+
+std::size_t pbdelta::encrypt(std::string password,
+                             std::string metadata,
+                             const std::string &path_to_db,
+                             const std::string &path_to_previous_manifest,
+                             const std::string &path_to_dest,
+                             const std::string &path_to_next_manifest,
+                             const pipeline::Progress &progress)
+{
+  Manifest previous = load_manifest(path_to_previous_manifest);
+  Manifest next;
+  next.group_size = previous.group_size;
+  next.sequence = previous.sequence + 1;
+  next.chain = previous.chain;
+  hash_database(path_to_db, next);
+
+  std::vector<std::uint64_t> changed;
+  for (std::uint64_t i = 0; i < next.hashes.size(); i++)
+    if (i >= previous.hashes.size() || next.hashes[i] != previous.hashes[i])
+      changed.push_back(i);
+
+  DeltaHeader header;
+  memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+  header.group_size = next.group_size;
+  header.reserved = 0;
+  header.database_size = next.database_size;
+  header.sequence = next.sequence;
+  memcpy(header.chain, next.chain.data(), sizeof(header.chain));
+  header.changed_groups = changed.size();
+
+  DeltaSource source(path_to_db, header, changed);
+  pbencrypt::encrypt(password, metadata,
+                     [&source](unsigned char *buf, std::size_t capacity)
+                     { return source.fill(buf, capacity); },
+                     source.size(), path_to_dest, pbencrypt::Compression::deflate, progress);
+  save_manifest(next, path_to_next_manifest);
+  return changed.size();
+}
+
+std::string pbdelta::apply(std::string password,
+                           const std::string &path_to_delta,
+                           const std::string &path_to_db,
+                           std::uint64_t expected_sequence,
+                           const pipeline::Progress &progress)
+{
+  // Patch a copy, CBC padding is only checked once the whole delta went through
+  std::string temporary = path_to_db + ".applying";
+  std::string metadata;
+  try
+  {
+    copy_file(path_to_db, temporary);
+    apply_delta(password, path_to_delta, temporary, expected_sequence, nullptr, progress, metadata);
+  }
+  catch (...)
+  {
+    std::remove(temporary.c_str());
+    throw;
+  }
+  replace_file(temporary, path_to_db);
+  return metadata;
+}
+
+std::string pbdelta::restore(std::string password,
+                             const std::string &path_to_base,
+                             const std::vector<std::string> &paths_to_deltas,
+                             const std::string &path_to_db_destination)
+{
+  // Every delta has to continue the chain the base backup started
+  unsigned char chain[CHAIN_ID_LENGTH];
+  if (!pbencrypt::read_chain(path_to_base, chain) && !paths_to_deltas.empty())
+    throw std::runtime_error("The base backup doesn't start a chain of incremental backups");
+
+  // Replay into a temporary file, the destination is only replaced once every delta checked out
+  std::string temporary = path_to_db_destination + ".restoring";
+  std::string metadata;
+  try
+  {
+    metadata = pbencrypt::decrypt(password, path_to_base, temporary);
+    for (std::size_t i = 0; i < paths_to_deltas.size(); i++)
+      apply_delta(password, paths_to_deltas[i], temporary, i + 1, chain, nullptr, metadata);
+  }
+  catch (...)
+  {
+    std::remove(temporary.c_str());
+    throw;
+  }
+  replace_file(temporary, path_to_db_destination);
+  return metadata;
+}
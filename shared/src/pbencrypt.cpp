@@ -1,15 +1,32 @@
 #include "pbencrypt.hpp"
 
+#include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <openssl/evp.h>
 #include <vector>
+#include <zlib.h>
 
 #include "aes256.hpp"
+#include "cipherpool.hpp"
 #include "commonrand.hpp"
 #include "encoders.hpp"
+#include "pipeline.hpp"
 
 #define ITERATION_COUNT 2048
 #define KEY_LENGTH EVP_MAX_KEY_LENGTH
+#define COMPRESSION_LEVEL 6
+
+// Backups without flags start with "PORTBAK" and end the header before the flags field,
+// which keeps uncompressed backups readable by older versions of the app.
+#define MAGIC_LEGACY "PORTBAK"
+#define MAGIC_FLAGGED "PORTBK2"
+#define LEGACY_HEADER_SIZE offsetof(EncryptionMetadata, flags)
+
+#define FLAG_DEFLATE 0x1
+// The header is followed by the chain id of the incremental backups built on this one
+#define FLAG_CHAIN 0x2
+#define KNOWN_FLAGS (FLAG_DEFLATE | FLAG_CHAIN)
 
 typedef struct
 {
@@ -17,8 +34,183 @@ typedef struct
   char salt[PKCS5_SALT_LEN];
   char iv_database[EVP_MAX_IV_LENGTH];
   u_int32_t encrypted_metadata_size;
+  u_int32_t flags;
 } EncryptionMetadata;
 
+namespace
+{
+  /// @brief AES-256-CBC as a pipeline stage, in either direction
+  class CbcStage : public pipeline::Stage
+  {
+  public:
+    CbcStage(bool encrypting, const unsigned char *key, const unsigned char *iv) : ctx(EVP_CIPHER_CTX_new())
+    {
+      if (!ctx)
+        throw std::runtime_error("Could not create cipher context");
+      if (EVP_CipherInit_ex2(ctx, cipherpool::fetch(cipherpool::Cipher::aes_256_cbc), key, iv, encrypting ? 1 : 0, nullptr) != 1)
+      {
+        EVP_CIPHER_CTX_free(ctx);
+        throw std::runtime_error("Could not begin aes 256 encryption");
+      }
+    }
+    ~CbcStage() { EVP_CIPHER_CTX_free(ctx); }
+
+    void process(const unsigned char *data, std::size_t length, pipeline::Writer &out) override
+    {
+      while (length > 0)
+      {
+        // CBC may emit up to a block more than it is given, so leave room for that
+        std::size_t available;
+        unsigned char *space = out.reserve(EVP_MAX_BLOCK_LENGTH + 1, available);
+        std::size_t n = std::min(length, available - EVP_MAX_BLOCK_LENGTH);
+        int written;
+        if (EVP_CipherUpdate(ctx, space, &written, data, n) != 1)
+          throw std::runtime_error("Could not process a block of the backup");
+        out.commit(written);
+        data += n;
+        length -= n;
+      }
+    }
+
+    void finish(pipeline::Writer &out) override
+    {
+      std::size_t available;
+      unsigned char *space = out.reserve(EVP_MAX_BLOCK_LENGTH, available);
+      int written;
+      if (EVP_CipherFinal_ex(ctx, space, &written) != 1)
+        throw std::runtime_error("Could not finalize the backup");
+      out.commit(written);
+    }
+
+  private:
+    EVP_CIPHER_CTX *ctx;
+  };
+
+  /// @brief zlib deflate as a pipeline stage, run before encryption
+  class DeflateStage : public pipeline::Stage
+  {
+  public:
+    DeflateStage()
+    {
+      memset(&stream, 0, sizeof(stream));
+      if (deflateInit(&stream, COMPRESSION_LEVEL) != Z_OK)
+        throw std::runtime_error("Could not begin compressing the backup");
+    }
+    ~DeflateStage() { deflateEnd(&stream); }
+
+    void process(const unsigned char *data, std::size_t length, pipeline::Writer &out) override
+    {
+      stream.next_in = const_cast<unsigned char *>(data);
+      stream.avail_in = length;
+      do
+        drain(out, Z_NO_FLUSH);
+      while (stream.avail_out == 0);
+    }
+
+    void finish(pipeline::Writer &out) override
+    {
+      while (drain(out, Z_FINISH) != Z_STREAM_END)
+        ;
+    }
+
+  private:
+    z_stream stream;
+
+    int drain(pipeline::Writer &out, int flush)
+    {
+      std::size_t available;
+      stream.next_out = out.reserve(1, available);
+      stream.avail_out = available;
+      int result = deflate(&stream, flush);
+      if (result == Z_STREAM_ERROR)
+        throw std::runtime_error("Could not compress the backup");
+      out.commit(available - stream.avail_out);
+      return result;
+    }
+  };
+
+  /// @brief zlib inflate as a pipeline stage, run after decryption
+  class InflateStage : public pipeline::Stage
+  {
+  public:
+    InflateStage()
+    {
+      memset(&stream, 0, sizeof(stream));
+      if (inflateInit(&stream) != Z_OK)
+        throw std::runtime_error("Could not begin decompressing the backup");
+    }
+    ~InflateStage() { inflateEnd(&stream); }
+
+    void process(const unsigned char *data, std::size_t length, pipeline::Writer &out) override
+    {
+      stream.next_in = const_cast<unsigned char *>(data);
+      stream.avail_in = length;
+      while (stream.avail_in > 0)
+      {
+        if (ended)
+          throw std::runtime_error("Backup has trailing data after the compressed database");
+        drain(out);
+      }
+    }
+
+    void finish(pipeline::Writer &out) override
+    {
+      // inflate may still hold output it had no room for
+      while (!ended)
+        if (drain(out) == 0 && !ended)
+          throw std::runtime_error("Compressed backup is truncated");
+    }
+
+  private:
+    z_stream stream;
+    bool ended = false;
+
+    std::size_t drain(pipeline::Writer &out)
+    {
+      std::size_t available;
+      stream.next_out = out.reserve(1, available);
+      stream.avail_out = available;
+      int result = inflate(&stream, Z_NO_FLUSH);
+      std::size_t written = available - stream.avail_out;
+      out.commit(written);
+      if (result == Z_STREAM_END)
+        ended = true;
+      else if (result != Z_OK && result != Z_BUF_ERROR)
+        throw std::runtime_error("Could not decompress the backup");
+      return written;
+    }
+  };
+
+  pipeline::Source read_from(std::ifstream &in)
+  {
+    return [&in](unsigned char *buf, std::size_t capacity) -> std::size_t
+    {
+      in.read(reinterpret_cast<char *>(buf), capacity);
+      if (in.bad())
+        throw std::runtime_error("Could not read from the source file");
+      return in.gcount();
+    };
+  }
+
+  pipeline::Sink write_to(std::ofstream &out)
+  {
+    return [&out](const unsigned char *data, std::size_t length)
+    {
+      if (!out.write(reinterpret_cast<const char *>(data), length))
+        throw std::runtime_error("Could not write to the destination file");
+    };
+  }
+
+  std::uint64_t remaining_bytes(std::ifstream &in)
+  {
+    auto position = in.tellg();
+    in.seekg(0, std::ios::end);
+    auto end = in.tellg();
+    in.seekg(position);
+    return end - position;
+  }
+}
+
 std::vector<unsigned char> generate_key(std::string password, const char *salt)
 {
   auto key = std::vector<unsigned char>(KEY_LENGTH);
@@ -39,24 +231,78 @@ std::vector<unsigned char> generate_key(std::string password, const char *salt)
 
 namespace pbencrypt
 {
-  void encrypt(std::string password, std::string metadata, std::string path_to_db, std::string path_to_dest)
+  /// @param chain CHAIN_ID_LENGTH bytes to store in the header, or nullptr
+  static void encrypt_stream(std::string password, std::string metadata, const pipeline::Source &source, std::uint64_t size,
+                             std::string path_to_dest, Compression compression, const unsigned char *chain,
+                             const pipeline::Progress &progress);
+
+  /// @brief Read the header of a backup, up to the encrypted metadata
+  /// @param chain receives the chain id if the backup has one
+  static void read_header(std::ifstream &backup_stream, EncryptionMetadata &meta, unsigned char *chain)
+  {
+    // Only newer backups carry flags
+    backup_stream.read((char *)(&meta), LEGACY_HEADER_SIZE);
+    meta.flags = 0;
+    if (memcmp(meta.magic, MAGIC_FLAGGED, 8) == 0)
+      backup_stream.read((char *)(&meta.flags), sizeof(meta.flags));
+    if (meta.flags & FLAG_CHAIN)
+      backup_stream.read((char *)(chain), CHAIN_ID_LENGTH);
+    if (!backup_stream)
+      throw std::runtime_error("Backup is too short to contain its metadata");
+    if (meta.flags & ~KNOWN_FLAGS)
+      throw std::runtime_error("Backup was made by a newer version of the app");
+  }
+
+  void encrypt(std::string password, std::string metadata, std::string path_to_db, std::string path_to_dest, Compression compression, const pipeline::Progress &progress)
+  {
+    std::ifstream database_stream(path_to_db, std::ios::binary);
+    if (!database_stream.is_open())
+      throw std::runtime_error("Could not open database file for pb encryption");
+    encrypt(password, metadata, read_from(database_stream), remaining_bytes(database_stream), path_to_dest, compression, progress);
+    // Clean up
+    database_stream.close();
+  }
+
+  void encrypt_base(std::string password, std::string metadata, std::string path_to_db, std::string path_to_dest,
+                    const unsigned char *chain, Compression compression, const pipeline::Progress &progress)
   {
-    EncryptionMetadata head_data;
-    memcpy(head_data.magic, "PORTBAK", 8);
     std::ifstream database_stream(path_to_db, std::ios::binary);
     if (!database_stream.is_open())
       throw std::runtime_error("Could not open database file for pb encryption");
+    encrypt_stream(password, metadata, read_from(database_stream), remaining_bytes(database_stream), path_to_dest, compression, chain, progress);
+  }
 
+  bool read_chain(const std::string &path_to_backup, unsigned char *chain)
+  {
+    std::ifstream backup_stream(path_to_backup, std::ios::binary);
+    if (!backup_stream.is_open())
+      throw std::runtime_error("Could not open backup file for pb decryption");
+    EncryptionMetadata meta;
+    read_header(backup_stream, meta, chain);
+    return meta.flags & FLAG_CHAIN;
+  }
+
+  void encrypt(std::string password, std::string metadata, const pipeline::Source &source, std::uint64_t size, std::string path_to_dest, Compression compression, const pipeline::Progress &progress)
+  {
+    encrypt_stream(password, metadata, source, size, path_to_dest, compression, nullptr, progress);
+  }
+
+  static void encrypt_stream(std::string password, std::string metadata, const pipeline::Source &source, std::uint64_t size,
+                             std::string path_to_dest, Compression compression, const unsigned char *chain,
+                             const pipeline::Progress &progress)
+  {
+    EncryptionMetadata head_data;
+    head_data.flags = compression == Compression::deflate ? FLAG_DEFLATE : 0;
+    if (chain)
+      head_data.flags |= FLAG_CHAIN;
+    memcpy(head_data.magic, head_data.flags ? MAGIC_FLAGGED : MAGIC_LEGACY, 8);
     std::ofstream dest_stream(path_to_dest, std::ios::binary);
     if (!dest_stream.is_open())
-    {
-      database_stream.close();
       throw std::runtime_error("Could not open destination file for pb encryption");
-    }
 
     // Generate a salt and add it to the head data
-    auto salt = commonrand::hex(PKCS5_SALT_LEN);
-    std::vector<unsigned char> salt_bin = encoders::hex_to_binary(salt);
+    std::vector<unsigned char> salt_bin(PKCS5_SALT_LEN);
+    commonrand::bytes(salt_bin.data(), PKCS5_SALT_LEN);
     memcpy(&head_data.salt, salt_bin.data(), PKCS5_SALT_LEN);
     // Generate a key using the password and salt
     std::vector<unsigned char> key_vec = generate_key(password, (const char *)(salt_bin.data()));
@@ -68,32 +314,48 @@ namespace pbencrypt
     auto db_iv = std::vector<unsigned char>(EVP_MAX_IV_LENGTH);
     aes256::generate_random_iv(db_iv.data());
     memcpy(&head_data.iv_database, db_iv.data(), EVP_MAX_IV_LENGTH);
-    // Write the head data
-    dest_stream.write((const char *)(&head_data), sizeof(EncryptionMetadata));
+    // Write the head data, leaving out the flags when there are none
+    dest_stream.write((const char *)(&head_data), head_data.flags ? sizeof(EncryptionMetadata) : LEGACY_HEADER_SIZE);
+    if (chain)
+      dest_stream.write((const char *)(chain), CHAIN_ID_LENGTH);
     // Write the encrypted metadata
     dest_stream.write(encrypted_metadata.data(), encrypted_metadata.size());
-    // Encrypt the file and append it to the same stream
-    aes256::encrypt_file(database_stream, dest_stream, (unsigned char *)(key.data()), db_iv.data());
+    // Encrypt the database and append it to the same stream, reading, compressing, encrypting and writing all at once.
+    // The database key has always been the first 32 bytes of the hex encoded key, so existing backups
+    // stay readable.
+    CbcStage cipher(true, (unsigned char *)(key.data()), db_iv.data());
+    DeflateStage compressor;
+    std::vector<pipeline::Stage *> stages = {&cipher};
+    if (head_data.flags & FLAG_DEFLATE)
+      stages.insert(stages.begin(), &compressor);
+    pipeline::run(source, stages, write_to(dest_stream), size, progress);
     // Clean up
-    database_stream.close();
     dest_stream.close();
   }
 
-  std::string decrypt(std::string password, std::string path_to_backup, std::string database_snapshot_destination)
+  std::string decrypt(std::string password, std::string path_to_backup, std::string database_snapshot_destination, const pipeline::Progress &progress)
+  {
+    std::ofstream backup_destination_stream(database_snapshot_destination, std::ios::binary);
+    if (!backup_destination_stream.is_open())
+      throw std::runtime_error("Could not open database destination location");
+    std::string plaintext_metadata = decrypt(password, path_to_backup, write_to(backup_destination_stream), progress);
+    // Clean up
+    backup_destination_stream.close();
+
+    // The decrypted database is in the appropriate location, and we can return the plaintext metadata
+    return plaintext_metadata;
+  }
+
+  std::string decrypt(std::string password, std::string path_to_backup, const pipeline::Sink &sink, const pipeline::Progress &progress)
   {
     EncryptionMetadata meta;
     std::ifstream backup_stream(path_to_backup, std::ios::binary);
     if (!backup_stream.is_open())
       throw std::runtime_error("Could not open backup file for pb decryption");
-    std::ofstream backup_destination_stream(database_snapshot_destination, std::ios::binary);
-    if (!backup_destination_stream.is_open())
-    {
-      backup_stream.close();
-      throw std::runtime_error("Could not open database destination location");
-    }
 
     // Work with the saved metadata
-    backup_stream.read((char *)(&meta), sizeof(EncryptionMetadata));
+    unsigned char chain[CHAIN_ID_LENGTH];
+    read_header(backup_stream, meta, chain);
     // Get the salt use it with the password to generate a key
     std::vector<unsigned char> key_vec = generate_key(password, meta.salt);
     std::string key = encoders::binary_to_hex(key_vec.data(), KEY_LENGTH);
@@ -106,13 +368,15 @@ namespace pbencrypt
     // Decrypt the data
     std::string plaintext_metadata = aes256::decrypt(encrypted_metadata, key);
     // The remainder of the file is the encrypted database, so decrypt it
-    aes256::decrypt_file(backup_stream, backup_destination_stream, key, meta.iv_database);
+    CbcStage cipher(false, (unsigned char *)(key.data()), (unsigned char *)(meta.iv_database));
+    InflateStage decompressor;
+    std::vector<pipeline::Stage *> stages = {&cipher};
+    if (meta.flags & FLAG_DEFLATE)
+      stages.push_back(&decompressor);
+    pipeline::run(read_from(backup_stream), stages, sink, remaining_bytes(backup_stream), progress);
 
     // Clean up
     backup_stream.close();
-    backup_destination_stream.close();
-
-    // The decrypted database is in the appropriate location, and we can return the plaintext metadata
     return plaintext_metadata;
   }
 }
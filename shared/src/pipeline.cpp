@@ -0,0 +1,252 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+  const std::size_t BUFFER_ALIGNMENT = 4096;
+
+  /// @brief Thrown out of a step when another step failed and the pipeline is being torn down
+  struct Cancelled
+  {
+  };
+}
+
+pipeline::Ring::Ring(std::size_t slots, std::size_t buffer_size)
+{
+  buffers.reserve(slots);
+  for (std::size_t i = 0; i < slots; i++)
+  {
+    void *data = nullptr;
+    if (posix_memalign(&data, BUFFER_ALIGNMENT, buffer_size) != 0)
+      throw std::bad_alloc();
+    buffers.push_back({static_cast<unsigned char *>(data), buffer_size, 0});
+  }
+  for (auto &buffer : buffers)
+    empty.push_back(&buffer);
+}
+
+pipeline::Ring::~Ring()
+{
+  for (auto &buffer : buffers)
+    free(buffer.data);
+}
+
+pipeline::Buffer *pipeline::Ring::acquire()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this]
+               { return cancelled || !empty.empty(); });
+  if (cancelled)
+    return nullptr;
+  Buffer *buffer = empty.front();
+  empty.pop_front();
+  buffer->length = 0;
+  return buffer;
+}
+
+void pipeline::Ring::publish(Buffer *buffer)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    filled.push_back(buffer);
+  }
+  changed.notify_all();
+}
+
+void pipeline::Ring::close()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    closed = true;
+  }
+  changed.notify_all();
+}
+
+pipeline::Buffer *pipeline::Ring::consume()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this]
+               { return cancelled || closed || !filled.empty(); });
+  if (cancelled || filled.empty())
+    return nullptr;
+  Buffer *buffer = filled.front();
+  filled.pop_front();
+  return buffer;
+}
+
+void pipeline::Ring::release(Buffer *buffer)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    empty.push_back(buffer);
+  }
+  changed.notify_all();
+}
+
+void pipeline::Ring::cancel()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    cancelled = true;
+  }
+  changed.notify_all();
+}
+
+unsigned char *pipeline::Writer::reserve(std::size_t at_least, std::size_t &available)
+{
+  if (current && current->capacity - current->length < at_least)
+    flush();
+  if (!current)
+  {
+    current = ring.acquire();
+    if (!current)
+      throw Cancelled();
+  }
+  if (current->capacity < at_least)
+    throw std::logic_error("Pipeline buffers are too small for this stage");
+  available = current->capacity - current->length;
+  return current->data + current->length;
+}
+
+void pipeline::Writer::commit(std::size_t length)
+{
+  current->length += length;
+}
+
+void pipeline::Writer::write(const unsigned char *data, std::size_t length)
+{
+  while (length > 0)
+  {
+    std::size_t available;
+    unsigned char *space = reserve(1, available);
+    std::size_t n = std::min(available, length);
+    memcpy(space, data, n);
+    commit(n);
+    data += n;
+    length -= n;
+  }
+}
+
+void pipeline::Writer::flush()
+{
+  if (!current)
+    return;
+  if (current->length > 0)
+    ring.publish(current);
+  else
+    ring.release(current);
+  current = nullptr;
+}
+
+void pipeline::run(const Source &source,
+                   const std::vector<Stage *> &stages,
+                   const Sink &sink,
+                   std::uint64_t total,
+                   const Progress &progress,
+                   std::size_t buffer_size)
+{
+  // rings[i] feeds stage i, and the last ring feeds the sink
+  std::vector<std::unique_ptr<Ring>> rings;
+  for (std::size_t i = 0; i <= stages.size(); i++)
+    rings.push_back(std::make_unique<Ring>(DEFAULT_RING_SLOTS, buffer_size));
+
+  std::mutex error_lock;
+  std::exception_ptr error;
+  auto fail = [&](std::exception_ptr e)
+  {
+    {
+      std::lock_guard<std::mutex> guard(error_lock);
+      if (!error)
+        error = e;
+    }
+    for (auto &ring : rings)
+      ring->cancel();
+  };
+  auto guarded = [&](const std::function<void()> &step)
+  {
+    try
+    {
+      step();
+    }
+    catch (const Cancelled &)
+    {
+      // Somebody else failed and already recorded why
+    }
+    catch (...)
+    {
+      fail(std::current_exception());
+    }
+  };
+
+  std::uint64_t processed = 0;
+  std::vector<std::thread> threads;
+  threads.emplace_back([&]
+                       { guarded([&]
+                                 {
+    Ring &out = *rings.front();
+    std::uint64_t last_reported = 0;
+    while (Buffer *buffer = out.acquire())
+    {
+      buffer->length = source(buffer->data, buffer->capacity);
+      if (buffer->length == 0)
+      {
+        out.release(buffer);
+        out.close();
+        return;
+      }
+      out.publish(buffer);
+      processed += buffer->length;
+      if (progress && processed - last_reported >= PROGRESS_INTERVAL)
+      {
+        last_reported = processed;
+        progress(processed, total);
+      }
+    } }); });
+
+  for (std::size_t i = 0; i < stages.size(); i++)
+  {
+    threads.emplace_back([&, i]
+                         { guarded([&]
+                                   {
+      Ring &in = *rings[i];
+      Ring &next = *rings[i + 1];
+      Writer out(next);
+      while (Buffer *buffer = in.consume())
+      {
+        stages[i]->process(buffer->data, buffer->length, out);
+        in.release(buffer);
+      }
+      {
+        std::lock_guard<std::mutex> guard(error_lock);
+        if (error)
+          return;
+      }
+      stages[i]->finish(out);
+      out.flush();
+      next.close(); }); });
+  }
+
+  // The sink runs right here
+  guarded([&]
+          {
+    Ring &in = *rings.back();
+    while (Buffer *buffer = in.consume())
+    {
+      sink(buffer->data, buffer->length);
+      in.release(buffer);
+    } });
+
+  for (auto &thread : threads)
+    thread.join();
+  if (error)
+    std::rethrow_exception(error);
+  if (progress)
+    progress(processed, total);
+}
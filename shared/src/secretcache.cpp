@@ -0,0 +1,93 @@
+#include "secretcache.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+secretcache::Cache::Cache(std::size_t capacity) : capacity(capacity) {}
+
+secretcache::Cache::~Cache()
+{
+  clear();
+}
+
+std::size_t secretcache::Cache::DigestHash::operator()(const Digest &digest) const
+{
+  // The digest is already uniformly distributed
+  std::size_t value;
+  memcpy(&value, digest.data(), sizeof(value));
+  return value;
+}
+
+void secretcache::Cache::derive(const unsigned char *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf)
+{
+  Digest id;
+  unsigned char pair[x25519::PRIVATE_KEY_LENGTH + x25519::PUBLIC_KEY_LENGTH];
+  memcpy(pair, private_key, x25519::PRIVATE_KEY_LENGTH);
+  memcpy(pair + x25519::PRIVATE_KEY_LENGTH, peer_public_key, x25519::PUBLIC_KEY_LENGTH);
+  int hashed = EVP_Digest(pair, sizeof(pair), id.data(), nullptr, EVP_sha256(), nullptr);
+  OPENSSL_cleanse(pair, sizeof(pair));
+  if (hashed != 1)
+    throw std::runtime_error("Could not hash keys for the secret cache");
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = index.find(id);
+    if (found != index.end())
+    {
+      counters.hits++;
+      entries.splice(entries.begin(), entries, found->second);
+      memcpy(secret_buf, found->second->secret.data(), x25519::SECRET_LENGTH);
+      return;
+    }
+    counters.misses++;
+  }
+
+  // Derive outside the lock, at worst two threads compute the same secret
+  x25519::derive_secret(private_key, peer_public_key, secret_buf);
+  if (capacity == 0)
+    return;
+
+  std::lock_guard<std::mutex> guard(lock);
+  if (index.count(id))
+    return;
+  if (entries.size() >= capacity)
+    evict_last();
+  entries.push_front(Entry{id, {}});
+  memcpy(entries.front().secret.data(), secret_buf, x25519::SECRET_LENGTH);
+  index[id] = entries.begin();
+}
+
+void secretcache::Cache::clear()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto &entry : entries)
+    OPENSSL_cleanse(entry.secret.data(), entry.secret.size());
+  entries.clear();
+  index.clear();
+}
+
+secretcache::Stats secretcache::Cache::stats()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Stats current = counters;
+  current.size = entries.size();
+  current.capacity = capacity;
+  return current;
+}
+
+void secretcache::Cache::evict_last()
+{
+  auto &last = entries.back();
+  OPENSSL_cleanse(last.secret.data(), last.secret.size());
+  index.erase(last.id);
+  entries.pop_back();
+  counters.evictions++;
+}
+
+secretcache::Cache &secretcache::shared()
+{
+  static Cache cache;
+  return cache;
+}
@@ -0,0 +1,175 @@
+#include "workpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace
+{
+  std::size_t lane_index(workpool::Lane lane)
+  {
+    return static_cast<std::size_t>(lane);
+  }
+}
+
+workpool::WorkerPool::WorkerPool(std::size_t thread_count)
+{
+  if (thread_count == 0)
+    thread_count = std::max(2u, std::thread::hardware_concurrency());
+  // Keep one worker free for interactive work whenever there is more than one
+  max_bulk_running = thread_count > 1 ? thread_count - 1 : 1;
+  workers.reserve(thread_count);
+  for (std::size_t i = 0; i < thread_count; i++)
+    workers.emplace_back(&WorkerPool::run_worker, this);
+}
+
+workpool::WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void workpool::WorkerPool::submit(Lane lane, std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queues[lane_index(lane)].push_back({std::move(job), std::chrono::steady_clock::now()});
+    lane_stats[lane_index(lane)].queued++;
+  }
+  // Bulk workers may be parked on the bulk limit, so wake everyone and let them sort it out
+  wake.notify_all();
+}
+
+bool workpool::WorkerPool::take_job(Job &job, Lane &lane)
+{
+  auto &interactive = queues[lane_index(Lane::interactive)];
+  auto &bulk = queues[lane_index(Lane::bulk)];
+  if (!interactive.empty())
+  {
+    lane = Lane::interactive;
+    job = std::move(interactive.front());
+    interactive.pop_front();
+    return true;
+  }
+  // Once the pool is stopping there is no interactive work left to keep a worker free for
+  if (!bulk.empty() && (stopping || lane_stats[lane_index(Lane::bulk)].running < max_bulk_running))
+  {
+    lane = Lane::bulk;
+    job = std::move(bulk.front());
+    bulk.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void workpool::WorkerPool::run_worker()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true)
+  {
+    Job job;
+    Lane lane;
+    // Queued jobs still run when stopping, their owners may be waiting on them
+    wake.wait(guard, [&]
+              { return take_job(job, lane) || stopping; });
+    if (!job.work)
+      return; // Only reachable when stopping with both lanes empty
+
+    auto &stats = lane_stats[lane_index(lane)];
+    auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - job.submitted)
+                      .count();
+    stats.queued--;
+    stats.running++;
+    stats.total_wait_us += waited;
+    stats.max_wait_us = std::max<std::uint64_t>(stats.max_wait_us, waited);
+
+    guard.unlock();
+    job.work();
+    job.work = nullptr;
+    guard.lock();
+
+    stats.running--;
+    stats.completed++;
+    // A bulk slot may have opened up
+    if (lane == Lane::bulk)
+      wake.notify_one();
+  }
+}
+
+void workpool::WorkerPool::parallel_for(Lane lane, std::size_t count, const std::function<void(std::size_t)> &body)
+{
+  if (count == 0)
+    return;
+
+  // Helpers may only get scheduled after we return, so everything they touch is shared and owned
+  struct State
+  {
+    std::function<void(std::size_t)> body;
+    std::size_t count;
+    std::atomic<std::size_t> next{0};
+    std::mutex lock;
+    std::condition_variable done;
+    std::size_t finished = 0;
+    std::exception_ptr error;
+  };
+  auto state = std::make_shared<State>();
+  state->body = body;
+  state->count = count;
+
+  auto drain = [](const std::shared_ptr<State> &state)
+  {
+    std::size_t index;
+    while ((index = state->next.fetch_add(1)) < state->count)
+    {
+      std::exception_ptr error;
+      try
+      {
+        state->body(index);
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> guard(state->lock);
+      if (error && !state->error)
+        state->error = error;
+      if (++state->finished == state->count)
+        state->done.notify_all();
+    }
+  };
+
+  std::size_t helpers = std::min(count - 1, workers.size());
+  for (std::size_t i = 0; i < helpers; i++)
+    submit(lane, [state, drain]()
+           { drain(state); });
+
+  drain(state);
+  std::unique_lock<std::mutex> guard(state->lock);
+  state->done.wait(guard, [&]
+                   { return state->finished == state->count; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+workpool::Stats workpool::WorkerPool::stats()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Stats snapshot;
+  snapshot.threads = workers.size();
+  snapshot.interactive = lane_stats[lane_index(Lane::interactive)];
+  snapshot.bulk = lane_stats[lane_index(Lane::bulk)];
+  return snapshot;
+}
+
+workpool::WorkerPool &workpool::shared()
+{
+  static WorkerPool pool;
+  return pool;
+}
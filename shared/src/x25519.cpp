@@ -1,5 +1,6 @@
 #include "x25519.hpp"
 
+#include <stdexcept>
 #include <vector>
 #include <memory>
 #include <openssl/evp.h>
@@ -7,93 +8,115 @@
 #include "x25519.hpp"
 
 std::shared_ptr<x25519::KeyPair> x25519::generate_keypair()
+{
+  fixed_key private_key, public_key;
+  generate_keypair(private_key, public_key);
+
+  // The keys were generated, now put them into a KeyPair
+  auto keypair = std::make_shared<KeyPair>();
+  keypair->private_key.assign(private_key.begin(), private_key.end());
+  keypair->public_key.assign(public_key.begin(), public_key.end());
+  std::fill(private_key.begin(), private_key.end(), 0);
+  return keypair;
+}
+
+void x25519::generate_keypair(fixed_key &private_key, fixed_key &public_key)
 {
   EVP_PKEY *pkey = nullptr;
   EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, nullptr);
+  if (!pctx)
+    throw std::runtime_error("Failed x25519 keygen init");
   int errcode;
-  if (1 != (errcode = EVP_PKEY_keygen_init(pctx)))
-    throw std::runtime_error("Failed x25519 keygen init " + std::to_string(errcode));
-  if (1 != (errcode = EVP_PKEY_keygen(pctx, &pkey)))
+  if (1 != (errcode = EVP_PKEY_keygen_init(pctx)) || 1 != (errcode = EVP_PKEY_keygen(pctx, &pkey)))
+  {
+    EVP_PKEY_CTX_free(pctx);
     throw std::runtime_error("Failed x25519 keygen " + std::to_string(errcode));
-
-  // The keys were generated, not put them into a KeyPair
-  auto keypair = std::make_shared<KeyPair>();
-  size_t private_key_len = 0;
-  // Fill in the private key
-  EVP_PKEY_get_raw_private_key(pkey, nullptr, &private_key_len);
-  keypair->private_key.resize(private_key_len);
-  if (1 != (errcode = EVP_PKEY_get_raw_private_key(pkey, keypair->private_key.data(), &private_key_len)))
-    throw std::runtime_error("Could not extract x25519 private key " + std::to_string(errcode));
-
-  // Fill in the public key
-  size_t public_key_len = 0;
-  EVP_PKEY_get_raw_public_key(pkey, nullptr, &public_key_len);
-  keypair->public_key.resize(public_key_len);
-  if (1 != (errcode = EVP_PKEY_get_raw_public_key(pkey, keypair->public_key.data(), &public_key_len)))
-    throw std::runtime_error("Could not extract x25519 public key " + std::to_string(errcode));
-
-  EVP_PKEY_free(pkey);
+  }
   EVP_PKEY_CTX_free(pctx);
 
-  return keypair;
+  // Fill in the private and public key
+  size_t private_key_len = private_key.size();
+  size_t public_key_len = public_key.size();
+  int private_ok = EVP_PKEY_get_raw_private_key(pkey, private_key.data(), &private_key_len);
+  int public_ok = EVP_PKEY_get_raw_public_key(pkey, public_key.data(), &public_key_len);
+  EVP_PKEY_free(pkey);
+  if (1 != private_ok || private_key_len != PRIVATE_KEY_LENGTH)
+    throw std::runtime_error("Could not extract x25519 private key");
+  if (1 != public_ok || public_key_len != PUBLIC_KEY_LENGTH)
+    throw std::runtime_error("Could not extract x25519 public key");
 }
 
 x25519::key x25519::derive_secret(x25519::key &private_key_bin, x25519::key &peer_public_key_bin)
 {
-  // Create and set up the context for the key derivation
-  EVP_PKEY_CTX *ctx;
-  size_t shared_secret_len = 0;
-  EVP_PKEY *local_private_key = NULL, *peer_public_key = NULL;
+  if (private_key_bin.size() != PRIVATE_KEY_LENGTH || peer_public_key_bin.size() != PUBLIC_KEY_LENGTH)
+    throw std::runtime_error("Error creating keys for shared secret derivation.");
+  auto shared_secret = std::vector<unsigned char>(SECRET_LENGTH);
+  derive_secret(private_key_bin.data(), peer_public_key_bin.data(), shared_secret.data());
+  return shared_secret;
+}
 
-  // Convert the binary keys to EVP_PKEY structures
-  local_private_key = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, NULL, reinterpret_cast<const unsigned char *>(private_key_bin.data()), private_key_bin.size());
-  peer_public_key = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, NULL, reinterpret_cast<const unsigned char *>(peer_public_key_bin.data()), peer_public_key_bin.size());
+void x25519::derive_secret(const unsigned char *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf)
+{
+  if (!try_derive_secret(private_key, peer_public_key, secret_buf))
+    throw std::runtime_error("Error deriving shared secret.");
+}
 
-  if (!local_private_key || !peer_public_key)
-  {
-    throw std::runtime_error("Error creating keys for shared secret derivation.");
-  }
+void x25519::derive_secret(EVP_PKEY *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf)
+{
+  if (!try_derive_secret(private_key, peer_public_key, secret_buf))
+    throw std::runtime_error("Error deriving shared secret.");
+}
 
-  // Initialize the context
-  ctx = EVP_PKEY_CTX_new(local_private_key, NULL);
-  if (!ctx)
+bool x25519::try_derive_secret(const unsigned char *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf)
+{
+  // Convert the binary key to an EVP_PKEY structure
+  EVP_PKEY *local_private_key = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, NULL, private_key, PRIVATE_KEY_LENGTH);
+  if (!local_private_key)
+    throw std::runtime_error("Error creating keys for shared secret derivation.");
+  bool derived;
+  try
   {
-    throw std::runtime_error("Error creating context for shared secret derivation.");
+    derived = try_derive_secret(local_private_key, peer_public_key, secret_buf);
   }
-
-  // Initialize the key derivation
-  if (EVP_PKEY_derive_init(ctx) <= 0)
+  catch (...)
   {
-    throw std::runtime_error("Error initializing shared secret derivation.");
+    EVP_PKEY_free(local_private_key);
+    throw;
   }
+  EVP_PKEY_free(local_private_key);
+  return derived;
+}
 
-  // Provide the peer public key
-  if (EVP_PKEY_derive_set_peer(ctx, peer_public_key) <= 0)
+bool x25519::try_derive_secret(EVP_PKEY *private_key, const unsigned char *peer_public_key, unsigned char *secret_buf)
+{
+  EVP_PKEY *peer_key = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, NULL, peer_public_key, PUBLIC_KEY_LENGTH);
+  EVP_PKEY_CTX *ctx = peer_key ? EVP_PKEY_CTX_new(private_key, NULL) : nullptr;
+  auto clean_up = [&]
   {
-    throw std::runtime_error("Error setting peer key for shared secret derivation.");
-  }
+    EVP_PKEY_free(peer_key);
+    EVP_PKEY_CTX_free(ctx);
+  };
 
-  // Determine buffer length for shared secret
-  if (EVP_PKEY_derive(ctx, NULL, &shared_secret_len) <= 0)
+  if (!peer_key)
+    throw std::runtime_error("Error creating keys for shared secret derivation.");
+  if (!ctx)
   {
-    throw std::runtime_error("Error determining length of shared secret.");
+    clean_up();
+    throw std::runtime_error("Error creating context for shared secret derivation.");
   }
-
-  // Allocate memory for the shared secret
-  auto shared_secret = std::vector<unsigned char>(shared_secret_len);
-
-  // Derive the shared secret
-  if (EVP_PKEY_derive(ctx, shared_secret.data(), &shared_secret_len) <= 0)
+  if (EVP_PKEY_derive_init(ctx) <= 0)
   {
-    throw std::runtime_error("Error deriving shared secret.");
+    clean_up();
+    throw std::runtime_error("Error initializing shared secret derivation.");
   }
 
-  // Clean up
-  EVP_PKEY_free(local_private_key);
-  EVP_PKEY_free(peer_public_key);
-  EVP_PKEY_CTX_free(ctx);
-
-  return shared_secret;
+  // Provide the peer public key and derive the shared secret. Both refuse low order public keys.
+  size_t shared_secret_len = SECRET_LENGTH;
+  bool derived = EVP_PKEY_derive_set_peer(ctx, peer_key) > 0 &&
+                 EVP_PKEY_derive(ctx, secret_buf, &shared_secret_len) > 0 &&
+                 shared_secret_len == SECRET_LENGTH;
+  clean_up();
+  return derived;
 }
 
 std::string x25519::KeyPair::to_json()
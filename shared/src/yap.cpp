@@ -1,66 +1,210 @@
 #include "yap.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 #include "x25519.hpp"
 #include "aesgcm.hpp"
+#include "encoders.hpp"
 #include "key_complications.hpp"
+#include "keypool.hpp"
 
 /**
  * TODO: consider putting public key, IV and tag into a struct.
  * It can be private to this file.
  */
 
-std::vector<unsigned char> yap::v1::encrypt(
-    std::vector<unsigned char> shared_secret,
-    std::vector<unsigned char> peer_public_key,
-    std::vector<unsigned char> plaintext)
+namespace
 {
-  // Generate the ephemeral x25519 keypair
-  std::shared_ptr<x25519::KeyPair> keypair_e = x25519::generate_keypair();
-  auto secret_e = x25519::derive_secret(keypair_e->private_key, peer_public_key);
-  // Combine the ephemeral secret with the shared secret to create an ephemeral key
-  auto key_e = key_complications::exclusive_or(shared_secret, secret_e);
-  // Encrypt the file using aes-gcm
-  std::vector<unsigned char> encapsulated_ciphertext(
-      x25519::PUBLIC_KEY_LENGTH +
-          aesgcm::IV_LENGTH +
-          aesgcm::TAG_LENGTH +
-          plaintext.size(),
-      0);
-  // encapsulate the public key
-  memcpy(encapsulated_ciphertext.data(), keypair_e->public_key.data(), x25519::PUBLIC_KEY_LENGTH);
-  // Set up all the buffers
-  unsigned char *iv_buf = encapsulated_ciphertext.data() + x25519::PUBLIC_KEY_LENGTH;
-  unsigned char *tag_buf = iv_buf + aesgcm::IV_LENGTH;
-  unsigned char *ciphertext_buf = tag_buf + aesgcm::TAG_LENGTH;
-  aesgcm::encrypt(key_e, plaintext, iv_buf, tag_buf, ciphertext_buf);
+  x25519::fixed_key to_fixed(const std::vector<unsigned char> &key, const char *what)
+  {
+    x25519::fixed_key fixed;
+    if (key.size() != fixed.size())
+      throw std::runtime_error(std::string(what) + " must be 32 bytes long");
+    memcpy(fixed.data(), key.data(), fixed.size());
+    return fixed;
+  }
+
+  /// @brief decode a hex key of exactly 32 bytes, without throwing on bad input
+  bool fixed_from_hex(const std::string &hex, x25519::fixed_key &fixed)
+  {
+    if (hex.size() != encoders::hex_encoded_length(fixed.size()) || !encoders::is_hex(hex.data(), hex.size()))
+      return false;
+    encoders::hex_to_binary(hex.data(), hex.size(), fixed.data());
+    return true;
+  }
+
+  /// @brief decrypt a message, with derive agreeing on the ephemeral secret with whatever form the private key is in
+  template <typename Derive>
+  decryption::Status open_message(const x25519::fixed_key &shared_secret,
+                                  const unsigned char *ciphertext, std::size_t length,
+                                  unsigned char *out, Derive derive)
+  {
+    if (length < yap::v1::OVERHEAD)
+      return decryption::Status::malformed;
+    const unsigned char *public_key_e = ciphertext;
+    const unsigned char *nonce = public_key_e + x25519::PUBLIC_KEY_LENGTH;
+    const unsigned char *tag = nonce + aesgcm::IV_LENGTH;
+    const unsigned char *ciphertext_buffer = tag + aesgcm::TAG_LENGTH;
+    std::size_t ciphertext_length = length - yap::v1::OVERHEAD;
+
+    // Compute the decryption key
+    aesgcm::fixed_key key_e;
+    if (!derive(public_key_e, key_e.data()))
+      return decryption::Status::bad_peer_key;
+    key_complications::exclusive_or(shared_secret.data(), key_e.data(), key_e.size(), key_e.data());
+
+    // Attempt AEAD decryption, then clear out the ephemeral key either way
+    decryption::Status status;
+    try
+    {
+      status = aesgcm::try_decrypt(key_e, nonce, tag, ciphertext_buffer, ciphertext_length, out);
+    }
+    catch (...)
+    {
+      std::fill(key_e.begin(), key_e.end(), 0);
+      throw;
+    }
+    std::fill(key_e.begin(), key_e.end(), 0);
+    return status;
+  }
+}
 
-  // Format of returned value is ephermeral_public_key(32) | nonce(12) | tag(16) | ciphertext(k)
+std::vector<unsigned char> yap::v1::encrypt(
+    const std::vector<unsigned char> &shared_secret,
+    const std::vector<unsigned char> &peer_public_key,
+    const std::vector<unsigned char> &plaintext)
+{
+  auto ss = to_fixed(shared_secret, "YAP shared secret");
+  std::vector<unsigned char> encapsulated_ciphertext(OVERHEAD + plaintext.size());
+  encrypt(ss, to_fixed(peer_public_key, "YAP peer public key"), plaintext.data(), plaintext.size(),
+          encapsulated_ciphertext.data());
+  std::fill(ss.begin(), ss.end(), 0);
   return encapsulated_ciphertext;
 }
 
 std::vector<unsigned char> yap::v1::decrypt(
-    std::vector<u_int8_t> shared_secret,
-    std::vector<u_int8_t> private_key,
-    std::vector<u_int8_t> ciphertext)
+    const std::vector<unsigned char> &shared_secret,
+    const std::vector<unsigned char> &private_key,
+    const std::vector<unsigned char> &ciphertext)
 {
-  unsigned char *public_key_e = ciphertext.data();
-  unsigned char *nonce = public_key_e + x25519::PUBLIC_KEY_LENGTH;
-  unsigned char *tag = nonce + aesgcm::IV_LENGTH;
-  unsigned char *ciphertext_buffer = tag + aesgcm::TAG_LENGTH;
-  unsigned int ciphertext_length = ciphertext.size() -
-                                   x25519::PUBLIC_KEY_LENGTH -
-                                   aesgcm::IV_LENGTH -
-                                   aesgcm::TAG_LENGTH;
-  // Compute the decryption key
-  x25519::key peer_public_key_e(public_key_e, public_key_e + x25519::PUBLIC_KEY_LENGTH);
-  aesgcm::key ss_e = x25519::derive_secret(private_key, peer_public_key_e);
-  aesgcm::key key_e = key_complications::exclusive_or(shared_secret, ss_e);
-
-  // Attempt AEAD decryption
-  aesgcm::data plaintext = aesgcm::decrypt(key_e, nonce, tag, ciphertext_buffer, ciphertext_length);
-
-  // clear out ephemeral shared secret and key
-  std::fill(ss_e.begin(), ss_e.end(), 0);
+  if (ciphertext.size() < OVERHEAD)
+    throw std::runtime_error("YAP ciphertext is too short to contain its header");
+  auto ss = to_fixed(shared_secret, "YAP shared secret");
+  auto sk = to_fixed(private_key, "X25519 private key");
+  std::vector<unsigned char> plaintext(ciphertext.size() - OVERHEAD);
+  try
+  {
+    decrypt(ss, sk, ciphertext.data(), ciphertext.size(), plaintext.data());
+  }
+  catch (...)
+  {
+    std::fill(ss.begin(), ss.end(), 0);
+    std::fill(sk.begin(), sk.end(), 0);
+    throw;
+  }
+  std::fill(ss.begin(), ss.end(), 0);
+  std::fill(sk.begin(), sk.end(), 0);
+  return plaintext;
+}
+
+void yap::v1::encrypt(const x25519::fixed_key &shared_secret,
+                      const x25519::fixed_key &peer_public_key,
+                      const unsigned char *plaintext, std::size_t length,
+                      unsigned char *out)
+{
+  // Format of the output is ephermeral_public_key(32) | nonce(12) | tag(16) | ciphertext(k)
+  unsigned char *public_key_e = out;
+  unsigned char *iv_buf = public_key_e + x25519::PUBLIC_KEY_LENGTH;
+  unsigned char *tag_buf = iv_buf + aesgcm::IV_LENGTH;
+  unsigned char *ciphertext_buf = tag_buf + aesgcm::TAG_LENGTH;
+
+  // Pick up a fresh ephemeral x25519 keypair and encapsulate its public key
+  x25519::fixed_key private_key_e, public_key_e_bin;
+  keypool::shared().take(private_key_e, public_key_e_bin);
+  memcpy(public_key_e, public_key_e_bin.data(), x25519::PUBLIC_KEY_LENGTH);
+
+  // Combine the ephemeral secret with the shared secret to create an ephemeral key
+  aesgcm::fixed_key key_e;
+  x25519::derive_secret(private_key_e.data(), peer_public_key.data(), key_e.data());
+  std::fill(private_key_e.begin(), private_key_e.end(), 0);
+  key_complications::exclusive_or(shared_secret.data(), key_e.data(), key_e.size(), key_e.data());
+
+  aesgcm::encrypt(key_e, plaintext, length, iv_buf, tag_buf, ciphertext_buf);
   std::fill(key_e.begin(), key_e.end(), 0);
+}
 
-  return plaintext;
+std::size_t yap::v1::decrypt(const x25519::fixed_key &shared_secret,
+                             const x25519::fixed_key &private_key,
+                             const unsigned char *ciphertext, std::size_t length,
+                             unsigned char *out)
+{
+  auto status = try_decrypt(shared_secret, private_key, ciphertext, length, out);
+  if (status != decryption::Status::ok)
+    throw std::runtime_error(decryption::describe(status));
+  return length - OVERHEAD;
+}
+
+std::size_t yap::v1::decrypt(const x25519::fixed_key &shared_secret,
+                             EVP_PKEY *private_key,
+                             const unsigned char *ciphertext, std::size_t length,
+                             unsigned char *out)
+{
+  auto status = try_decrypt(shared_secret, private_key, ciphertext, length, out);
+  if (status != decryption::Status::ok)
+    throw std::runtime_error(decryption::describe(status));
+  return length - OVERHEAD;
+}
+
+decryption::Status yap::v1::try_decrypt(const x25519::fixed_key &shared_secret,
+                                        const x25519::fixed_key &private_key,
+                                        const unsigned char *ciphertext, std::size_t length,
+                                        unsigned char *out)
+{
+  return open_message(shared_secret, ciphertext, length, out, [&](const unsigned char *public_key_e, unsigned char *secret_e)
+                      { return x25519::try_derive_secret(private_key.data(), public_key_e, secret_e); });
+}
+
+decryption::Status yap::v1::try_decrypt(const x25519::fixed_key &shared_secret,
+                                        EVP_PKEY *private_key,
+                                        const unsigned char *ciphertext, std::size_t length,
+                                        unsigned char *out)
+{
+  return open_message(shared_secret, ciphertext, length, out, [&](const unsigned char *public_key_e, unsigned char *secret_e)
+                      { return x25519::try_derive_secret(private_key, public_key_e, secret_e); });
+}
+
+std::vector<yap::v1::Opened> yap::v1::decrypt_many(const std::vector<EncodedMessage> &messages, workpool::Lane lane)
+{
+  std::vector<Opened> results(messages.size());
+  auto decrypt_one = [&](std::size_t i)
+  {
+    auto &result = results[i];
+    x25519::fixed_key ss, sk;
+    if (!fixed_from_hex(messages[i].shared_secret_hex, ss) || !fixed_from_hex(messages[i].private_key_hex, sk))
+    {
+      result.status = decryption::Status::bad_key;
+    }
+    else
+    {
+      auto ciphertext = encoders::base64_decode(messages[i].ciphertext_b64);
+      if (ciphertext.size() < OVERHEAD)
+        result.status = decryption::Status::malformed;
+      else
+      {
+        result.plaintext.resize(ciphertext.size() - OVERHEAD);
+        result.status = try_decrypt(ss, sk, ciphertext.data(), ciphertext.size(), reinterpret_cast<unsigned char *>(&result.plaintext[0]));
+      }
+    }
+    std::fill(ss.begin(), ss.end(), 0);
+    std::fill(sk.begin(), sk.end(), 0);
+    if (result.status != decryption::Status::ok)
+    {
+      result.plaintext.clear();
+      result.error = decryption::describe(result.status);
+    }
+  };
+  // Every message costs a key agreement, which is worth handing to another thread even for a handful
+  workpool::shared().parallel_for(lane, messages.size(), decrypt_one);
+  return results;
 }
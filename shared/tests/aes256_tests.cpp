@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "vectorcmp.hpp"
+#include "aes256.hpp"
+#include "commonhash.hpp"
+#include "commonrand.hpp"
+#include "encoders.hpp"
+
+/**
+ * Tests for AES-256-CBC message encryption
+ */
+
+// Binary round trip with an odd sized plaintext
+TEST(AES256Tests, BinaryRoundTrip)
+{
+  auto key = encoders::hex_to_binary(commonrand::hex(aes256::KEY_LENGTH));
+  auto plaintext = encoders::hex_to_binary(commonrand::hex(1050));
+  auto ciphertext = aes256::encrypt(plaintext.data(), plaintext.size(), key.data());
+  // IV plus the plaintext padded to the next block
+  EXPECT_EQ(aes256::IV_LENGTH + 1056, ciphertext.size());
+  auto decrypted = aes256::decrypt(ciphertext.data(), ciphertext.size(), key.data());
+  ASSERT_VEC_EQ(plaintext, decrypted);
+}
+
+// The string API and the binary API produce the same wire format
+TEST(AES256Tests, StringAndBinaryInteroperate)
+{
+  std::string key_hex = commonrand::hex(aes256::KEY_LENGTH);
+  auto key = encoders::hex_to_binary(key_hex);
+  std::string plaintext = "Abhi's magic human readable string to test AES";
+
+  std::string ciphertext_b64 = aes256::encrypt(plaintext, key_hex);
+  auto ciphertext = encoders::base64_decode(ciphertext_b64);
+  auto decrypted = aes256::decrypt(ciphertext.data(), ciphertext.size(), key.data());
+  EXPECT_EQ(plaintext, std::string(decrypted.begin(), decrypted.end()));
+
+  auto binary_ciphertext = aes256::encrypt(
+      reinterpret_cast<const unsigned char *>(plaintext.data()), plaintext.size(), key.data());
+  std::string binary_ciphertext_b64 = encoders::base64_encode(binary_ciphertext);
+  EXPECT_EQ(plaintext, aes256::decrypt(binary_ciphertext_b64, key_hex));
+}
+
+// Truncated input is rejected rather than read out of bounds
+TEST(AES256Tests, TooShort)
+{
+  auto key = encoders::hex_to_binary(commonrand::hex(aes256::KEY_LENGTH));
+  std::vector<unsigned char> ciphertext(aes256::IV_LENGTH - 1, 0);
+  ASSERT_ANY_THROW(aes256::decrypt(ciphertext.data(), ciphertext.size(), key.data()));
+  std::string key_hex = encoders::binary_to_hex(key.data(), key.size());
+  std::string ciphertext_b64 = encoders::base64_encode(ciphertext);
+  EXPECT_EQ("error", aes256::decrypt(ciphertext_b64, key_hex));
+}
+
+// Expected failures are reported by status, telling a wrong shape from a wrong padding
+TEST(AES256Tests, TryDecryptStatuses)
+{
+  auto key = encoders::hex_to_binary(commonrand::hex(aes256::KEY_LENGTH));
+  std::vector<unsigned char> plaintext(aes256::IV_LENGTH, 'a');
+  auto ciphertext = aes256::encrypt(plaintext.data(), plaintext.size(), key.data());
+  ASSERT_EQ(3 * aes256::IV_LENGTH, ciphertext.size());
+
+  std::vector<unsigned char> decrypted;
+  EXPECT_EQ(decryption::Status::ok, aes256::try_decrypt(ciphertext.data(), ciphertext.size(), key.data(), decrypted));
+  EXPECT_TRUE(plaintext == decrypted);
+  EXPECT_EQ(decryption::Status::malformed, aes256::try_decrypt(ciphertext.data(), aes256::IV_LENGTH, key.data(), decrypted));
+  EXPECT_EQ(decryption::Status::malformed, aes256::try_decrypt(ciphertext.data(), ciphertext.size() - 1, key.data(), decrypted));
+
+  // The last block is all padding, 0x10 in every byte. Turn its last byte into 0 through the block before it.
+  ciphertext[2 * aes256::IV_LENGTH - 1] ^= 0x10;
+  EXPECT_EQ(decryption::Status::bad_padding, aes256::try_decrypt(ciphertext.data(), ciphertext.size(), key.data(), decrypted));
+  EXPECT_TRUE(decrypted.empty());
+
+  std::string decrypted_string;
+  std::string ciphertext_b64 = encoders::base64_encode(ciphertext);
+  EXPECT_EQ(decryption::Status::bad_key, aes256::try_decrypt(ciphertext_b64, "abcd", decrypted_string));
+  std::string not_hex(64, 'x');
+  EXPECT_EQ(decryption::Status::bad_key, aes256::try_decrypt(ciphertext_b64, not_hex, decrypted_string));
+  EXPECT_EQ("error", aes256::decrypt(ciphertext_b64, not_hex));
+}
+
+// Every recipient of a fan-out gets a ciphertext only their key opens, both below and above the parallel cutoff
+TEST(AES256Tests, EncryptMany)
+{
+  for (std::size_t recipients : {3, 200})
+  {
+    std::string plaintext = commonrand::hex(300);
+    std::vector<std::string> keys_hex;
+    for (std::size_t i = 0; i < recipients; i++)
+      keys_hex.push_back(commonrand::hex(aes256::KEY_LENGTH));
+
+    auto ciphertexts = aes256::encrypt_many(plaintext, keys_hex);
+    ASSERT_EQ(recipients, ciphertexts.size());
+    for (std::size_t i = 0; i < recipients; i++)
+      EXPECT_EQ(plaintext, aes256::decrypt(ciphertexts[i], keys_hex[i]));
+    EXPECT_NE(plaintext, aes256::decrypt(ciphertexts[0], keys_hex[1]));
+  }
+
+  std::vector<std::string> bad_keys = {commonrand::hex(aes256::KEY_LENGTH), "abcd"};
+  ASSERT_ANY_THROW(aes256::encrypt_many("hello", bad_keys));
+}
+
+// The digests from the single pass match hashing both files afterwards, and the ciphertext is the usual one
+TEST(AES256Tests, EncryptFileWithDigests)
+{
+  std::string plain_path = testing::TempDir() + "aes256_plain";
+  std::string cipher_path = testing::TempDir() + "aes256_cipher";
+  std::string reference_path = testing::TempDir() + "aes256_reference";
+  unsigned char key[EVP_MAX_KEY_LENGTH], iv[EVP_MAX_IV_LENGTH];
+  aes256::generate_random_key(key);
+  aes256::generate_random_iv(iv);
+
+  // Empty, and several reads with a short last one
+  for (std::size_t length : {0, 200000})
+  {
+    {
+      std::vector<unsigned char> plaintext(length);
+      commonrand::bytes(plaintext.data(), plaintext.size());
+      std::ofstream out(plain_path, std::ios::binary);
+      out.write(reinterpret_cast<const char *>(plaintext.data()), plaintext.size());
+    }
+    aes256::FileDigests digests;
+    std::uint64_t written;
+    {
+      std::ifstream in(plain_path, std::ios::binary);
+      std::ofstream out(cipher_path, std::ios::binary);
+      written = aes256::encrypt_file(in, out, key, iv, digests);
+    }
+    {
+      std::ifstream in(plain_path, std::ios::binary);
+      std::ofstream out(reference_path, std::ios::binary);
+      aes256::encrypt_file(in, out, key, iv);
+    }
+
+    std::ifstream cipher_in(cipher_path, std::ios::binary), reference_in(reference_path, std::ios::binary);
+    std::vector<unsigned char> ciphertext((std::istreambuf_iterator<char>(cipher_in)), std::istreambuf_iterator<char>());
+    std::vector<unsigned char> reference((std::istreambuf_iterator<char>(reference_in)), std::istreambuf_iterator<char>());
+    ASSERT_VEC_EQ(reference, ciphertext);
+    EXPECT_EQ(ciphertext.size(), written);
+    EXPECT_EQ((length / 16 + 1) * 16, written);
+    EXPECT_EQ(hash::hash_file(plain_path), encoders::binary_to_hex(digests.plaintext.data(), digests.plaintext.size()));
+    EXPECT_EQ(hash::hash_file(cipher_path), encoders::binary_to_hex(digests.ciphertext.data(), digests.ciphertext.size()));
+  }
+}
+
+// File keys from outside are checked before anything is copied out of them
+TEST(AES256Tests, SplitKeyAndIV)
+{
+  unsigned char key[EVP_MAX_KEY_LENGTH], iv[EVP_MAX_IV_LENGTH];
+  aes256::generate_random_key(key);
+  aes256::generate_random_iv(iv);
+  std::string key_and_iv = aes256::combine_key_and_iv(key, iv);
+  ASSERT_EQ(aes256::KEY_AND_IV_HEX_LENGTH, key_and_iv.size());
+
+  std::string key_buf, iv_buf;
+  aes256::split_key_and_iv(key_and_iv, key_buf, iv_buf);
+  EXPECT_EQ(std::string(reinterpret_cast<char *>(key), sizeof(key)), key_buf);
+  EXPECT_EQ(std::string(reinterpret_cast<char *>(iv), sizeof(iv)), iv_buf);
+
+  ASSERT_ANY_THROW(aes256::split_key_and_iv("", key_buf, iv_buf));
+  ASSERT_ANY_THROW(aes256::split_key_and_iv(key_and_iv.substr(0, 96), key_buf, iv_buf));
+  ASSERT_ANY_THROW(aes256::split_key_and_iv(key_and_iv + "00", key_buf, iv_buf));
+  ASSERT_ANY_THROW(aes256::split_key_and_iv("zz" + key_and_iv.substr(2), key_buf, iv_buf));
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "tempfiles.hpp"
+#include "vectorcmp.hpp"
+#include "aes256.hpp"
+#include "chunkedfile.hpp"
+#include "commonrand.hpp"
+#include "encoders.hpp"
+
+/**
+ * Tests for the chunked (version 2) file encryption format
+ */
+
+namespace
+{
+  std::string temp_path(const std::string &name)
+  {
+    return tempfiles::path("chunkedfile", name);
+  }
+
+  struct Keys
+  {
+    std::vector<unsigned char> key = encoders::hex_to_binary(commonrand::hex(aes256::KEY_LENGTH));
+    std::vector<unsigned char> iv = encoders::hex_to_binary(commonrand::hex(aes256::IV_LENGTH));
+  };
+}
+
+// Many chunks with a short trailing chunk
+TEST(ChunkedFileTests, RoundTrip)
+{
+  Keys keys;
+  auto plaintext = encoders::hex_to_binary(commonrand::hex(10500));
+  tempfiles::write_file(temp_path("plain"), plaintext);
+
+  chunkedfile::encrypt_file(temp_path("plain"), temp_path("enc"), keys.key.data(), keys.iv.data(), 1000);
+  EXPECT_TRUE(chunkedfile::is_chunked(temp_path("enc")));
+  EXPECT_FALSE(chunkedfile::is_chunked(temp_path("plain")));
+  // Header plus a tag for each of the 11 chunks
+  EXPECT_EQ(sizeof(chunkedfile::Header) + 10500 + 11 * 16, tempfiles::read_file(temp_path("enc")).size());
+
+  chunkedfile::decrypt_file(temp_path("enc"), temp_path("dec"), keys.key.data(), keys.iv.data());
+  ASSERT_VEC_EQ(plaintext, tempfiles::read_file(temp_path("dec")));
+}
+
+// Empty files still carry an authenticated chunk
+TEST(ChunkedFileTests, EmptyFile)
+{
+  Keys keys;
+  tempfiles::write_file(temp_path("empty"), {});
+  chunkedfile::encrypt_file(temp_path("empty"), temp_path("empty_enc"), keys.key.data(), keys.iv.data());
+  chunkedfile::decrypt_file(temp_path("empty_enc"), temp_path("empty_dec"), keys.key.data(), keys.iv.data());
+  EXPECT_EQ(0, tempfiles::read_file(temp_path("empty_dec")).size());
+
+  Keys other;
+  ASSERT_ANY_THROW(chunkedfile::decrypt_file(temp_path("empty_enc"), temp_path("empty_dec"), other.key.data(), keys.iv.data()));
+}
+
+// Flipping a bit in any chunk, or in the header, fails decryption
+TEST(ChunkedFileTests, Tampering)
+{
+  Keys keys;
+  tempfiles::write_file(temp_path("tamper_plain"), encoders::hex_to_binary(commonrand::hex(5000)));
+  chunkedfile::encrypt_file(temp_path("tamper_plain"), temp_path("tamper_enc"), keys.key.data(), keys.iv.data(), 1024);
+  auto ciphertext = tempfiles::read_file(temp_path("tamper_enc"));
+
+  for (std::size_t pos : {std::size_t(12), std::size_t(30), ciphertext.size() - 1})
+  {
+    auto corrupted = ciphertext;
+    corrupted[pos] ^= 0x1;
+    tempfiles::write_file(temp_path("tamper_bad"), corrupted);
+    ASSERT_ANY_THROW(chunkedfile::decrypt_file(temp_path("tamper_bad"), temp_path("tamper_dec"), keys.key.data(), keys.iv.data()))
+        << "flipped byte " << pos;
+  }
+}
+
+// Dropping the last chunk is detected even though every remaining chunk is intact
+TEST(ChunkedFileTests, Truncation)
+{
+  Keys keys;
+  tempfiles::write_file(temp_path("trunc_plain"), encoders::hex_to_binary(commonrand::hex(5000)));
+  chunkedfile::encrypt_file(temp_path("trunc_plain"), temp_path("trunc_enc"), keys.key.data(), keys.iv.data(), 1024);
+  auto ciphertext = tempfiles::read_file(temp_path("trunc_enc"));
+  ciphertext.resize(sizeof(chunkedfile::Header) + 4 * (1024 + 16));
+  tempfiles::write_file(temp_path("trunc_bad"), ciphertext);
+  ASSERT_ANY_THROW(chunkedfile::decrypt_file(temp_path("trunc_bad"), temp_path("trunc_dec"), keys.key.data(), keys.iv.data()));
+}
+
+// Ranges within a chunk, across chunk boundaries and past the end all match the plaintext
+TEST(ChunkedFileTests, ReaderRanges)
+{
+  Keys keys;
+  auto plaintext = encoders::hex_to_binary(commonrand::hex(10500));
+  tempfiles::write_file(temp_path("range_plain"), plaintext);
+  chunkedfile::encrypt_file(temp_path("range_plain"), temp_path("range_enc"), keys.key.data(), keys.iv.data(), 1000);
+
+  chunkedfile::Reader reader(temp_path("range_enc"), keys.key.data(), keys.iv.data());
+  EXPECT_EQ(10500, reader.size());
+  struct Range
+  {
+    std::uint64_t offset;
+    std::size_t length;
+  };
+  for (auto range : {Range{0, 10}, Range{990, 20}, Range{1000, 1000}, Range{1500, 7000}, Range{10400, 500}, Range{0, 10500}})
+  {
+    auto bytes = reader.read(range.offset, range.length);
+    std::size_t expected_length = std::min<std::size_t>(range.length, plaintext.size() - range.offset);
+    std::vector<unsigned char> expected(plaintext.begin() + range.offset, plaintext.begin() + range.offset + expected_length);
+    ASSERT_VEC_EQ(expected, bytes);
+  }
+  EXPECT_EQ(0, reader.read(10500, 10).size());
+}
+
+// Only chunks overlapping the range are authenticated, so damage elsewhere doesn't matter
+TEST(ChunkedFileTests, ReaderOnlyTouchesRange)
+{
+  Keys keys;
+  tempfiles::write_file(temp_path("range_tamper_plain"), encoders::hex_to_binary(commonrand::hex(5000)));
+  chunkedfile::encrypt_file(temp_path("range_tamper_plain"), temp_path("range_tamper_enc"), keys.key.data(), keys.iv.data(), 1000);
+  auto ciphertext = tempfiles::read_file(temp_path("range_tamper_enc"));
+  // Corrupt the fourth chunk
+  ciphertext[sizeof(chunkedfile::Header) + 3 * 1016 + 5] ^= 0x1;
+  tempfiles::write_file(temp_path("range_tamper_enc"), ciphertext);
+
+  chunkedfile::Reader reader(temp_path("range_tamper_enc"), keys.key.data(), keys.iv.data());
+  EXPECT_EQ(100, reader.read(100, 100).size());
+  ASSERT_ANY_THROW(reader.read(2900, 200));
+}
@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "aes256.hpp"
+#include "aesgcm.hpp"
+#include "cipherpool.hpp"
+#include "commonrand.hpp"
+#include "encoders.hpp"
+
+/**
+ * Tests for reused cipher contexts
+ */
+
+// Contexts handed back to the cache forget the previous key and IV
+TEST(CipherPoolTests, ReusedContextsStartOver)
+{
+  for (int i = 0; i < 20; i++)
+  {
+    auto key = encoders::hex_to_binary(commonrand::hex(aes256::KEY_LENGTH));
+    auto plaintext = encoders::hex_to_binary(commonrand::hex(i * 7));
+    auto ciphertext = aes256::encrypt(plaintext.data(), plaintext.size(), key.data());
+    EXPECT_TRUE(plaintext == aes256::decrypt(ciphertext.data(), ciphertext.size(), key.data()));
+  }
+}
+
+// A failed decryption, by exception or by a bad tag, doesn't spoil the next message
+TEST(CipherPoolTests, FailureDoesNotLeak)
+{
+  auto key = encoders::hex_to_binary(commonrand::hex(aes256::KEY_LENGTH));
+  auto plaintext = encoders::hex_to_binary(commonrand::hex(100));
+  auto ciphertext = aes256::encrypt(plaintext.data(), plaintext.size(), key.data());
+  auto truncated = ciphertext;
+  truncated.resize(truncated.size() - 5);
+  ASSERT_ANY_THROW(aes256::decrypt(truncated.data(), truncated.size(), key.data()));
+  EXPECT_TRUE(plaintext == aes256::decrypt(ciphertext.data(), ciphertext.size(), key.data()));
+
+  auto gcm_key = encoders::hex_to_binary(commonrand::hex(aesgcm::KEY_LENGTH));
+  unsigned char iv[aesgcm::IV_LENGTH] = {}, tag[aesgcm::TAG_LENGTH];
+  std::vector<unsigned char> sealed(plaintext.size()), opened(plaintext.size());
+  aesgcm::seal(gcm_key.data(), iv, nullptr, 0, plaintext.data(), plaintext.size(), sealed.data(), tag);
+  tag[0] ^= 1;
+  EXPECT_FALSE(aesgcm::open(gcm_key.data(), iv, nullptr, 0, sealed.data(), sealed.size(), tag, opened.data()));
+  tag[0] ^= 1;
+  EXPECT_TRUE(aesgcm::open(gcm_key.data(), iv, nullptr, 0, sealed.data(), sealed.size(), tag, opened.data()));
+  EXPECT_TRUE(plaintext == opened);
+}
+
+// The algorithm is looked up once
+TEST(CipherPoolTests, FetchOnce)
+{
+  EXPECT_EQ(cipherpool::fetch(cipherpool::Cipher::aes_256_gcm), cipherpool::fetch(cipherpool::Cipher::aes_256_gcm));
+  EXPECT_NE(cipherpool::fetch(cipherpool::Cipher::aes_256_cbc), cipherpool::fetch(cipherpool::Cipher::aes_256_gcm));
+}
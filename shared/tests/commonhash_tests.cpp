@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "commonhash.hpp"
+#include "commonrand.hpp"
+
+/**
+ * Tests for SHA-256 hashing
+ */
+
+// Known answers from FIPS 180-2
+TEST(HashTests, KnownAnswers)
+{
+  EXPECT_EQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", hash::hashSHA256(""));
+  EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", hash::hashSHA256("abc"));
+}
+
+// Hashing in pieces gives the same digest, and the hasher can be reused
+TEST(HashTests, Incremental)
+{
+  std::string input = commonrand::hex(10000);
+  hash::Sha256 hasher;
+  for (std::size_t i = 0; i < input.size(); i += 777)
+    hasher.update(input.substr(i, 777));
+  EXPECT_EQ(hash::hashSHA256(input), hasher.final_hex());
+  hasher.update("abc");
+  EXPECT_EQ(hash::hashSHA256("abc"), hasher.final_hex());
+}
+
+// Files are hashed like their contents
+TEST(HashTests, File)
+{
+  std::string contents = commonrand::hex(3 * 1024 * 1024 + 5);
+  std::string path = testing::TempDir() + "hash_file";
+  std::ofstream(path, std::ios::binary) << contents;
+  EXPECT_EQ(hash::hashSHA256(contents), hash::hash_file(path));
+  ASSERT_ANY_THROW(hash::hash_file(testing::TempDir() + "does_not_exist"));
+}
+
+// A batch large enough to be spread out matches hashing one at a time
+TEST(HashTests, Many)
+{
+  std::vector<std::string> inputs;
+  for (int i = 0; i < 1000; i++)
+    inputs.push_back("identifier " + std::to_string(i));
+  auto digests = hash::hash_many(inputs);
+  ASSERT_EQ(inputs.size(), digests.size());
+  for (std::size_t i = 0; i < inputs.size(); i++)
+    EXPECT_EQ(hash::hashSHA256(inputs[i]), digests[i]);
+  EXPECT_TRUE(hash::hash_many({}).empty());
+}
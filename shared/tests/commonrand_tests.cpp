@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "commonrand.hpp"
+
+/**
+ * Tests for the buffered random byte source
+ */
+
+// Draws never repeat, also across refills of the per-thread buffer
+TEST(CommonRandTests, DrawsAreDistinct)
+{
+  std::set<std::vector<unsigned char>> seen;
+  for (int i = 0; i < 2000; i++)
+  {
+    std::vector<unsigned char> draw(12);
+    commonrand::bytes(draw.data(), draw.size());
+    EXPECT_TRUE(seen.insert(draw).second);
+  }
+}
+
+// Sizes around the buffer and direct paths are filled completely, and nothing past the end is touched
+TEST(CommonRandTests, FillsWholeBuffer)
+{
+  const unsigned char sentinel = 0xa5;
+  for (std::size_t length : {1, 16, 1023, 1024, 1025, 4096, 5000})
+  {
+    // A random byte matches the sentinel one time in 256, so a byte that was written
+    // shows up as changed in at least one of a few draws
+    std::vector<bool> written(length, false);
+    for (int draw = 0; draw < 4; draw++)
+    {
+      std::vector<unsigned char> buf(length + 1, sentinel);
+      commonrand::bytes(buf.data(), length);
+      EXPECT_EQ(sentinel, buf[length]);
+      for (std::size_t i = 0; i < length; i++)
+        written[i] = written[i] || buf[i] != sentinel;
+    }
+    for (std::size_t i = 0; i < length; i++)
+    {
+      ASSERT_TRUE(written[i]) << "byte " << i << " of " << length << " was never written";
+    }
+  }
+}
+
+TEST(CommonRandTests, ZeroLength)
+{
+  unsigned char byte = 7;
+  commonrand::bytes(&byte, 0);
+  EXPECT_EQ(byte, 7);
+}
+
+TEST(CommonRandTests, HexKeepsItsFormat)
+{
+  auto random_hex = commonrand::hex(32);
+  EXPECT_EQ(random_hex.size(), 64);
+  EXPECT_EQ(random_hex.find_first_not_of("0123456789abcdef"), std::string::npos);
+  EXPECT_NE(random_hex, commonrand::hex(32));
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "ed25519.hpp"
+
+/**
+ * Tests for Ed25519 signatures
+ */
+
+namespace
+{
+  std::string json_field(const std::string &json, const std::string &field)
+  {
+    auto start = json.find("\"" + field + "\":\"") + field.size() + 4;
+    return json.substr(start, json.find('"', start) - start);
+  }
+}
+
+// Signatures verify against the signing key only, and only for the signed message
+TEST(Ed25519Tests, SignAndVerify)
+{
+  auto keys = ed25519::generate_keys_json();
+  auto other_keys = ed25519::generate_keys_json();
+  auto signature = ed25519::sign_message("invite from alice", json_field(keys, "privateKey"));
+
+  EXPECT_TRUE(ed25519::verify("invite from alice", signature, json_field(keys, "publicKey")));
+  EXPECT_FALSE(ed25519::verify("invite from mallory", signature, json_field(keys, "publicKey")));
+  EXPECT_FALSE(ed25519::verify("invite from alice", signature, json_field(other_keys, "publicKey")));
+  EXPECT_FALSE(ed25519::verify("invite from alice", signature.substr(0, 20), json_field(keys, "publicKey")));
+  EXPECT_FALSE(ed25519::verify("invite from alice", signature, "not a key"));
+}
+
+// A batch reports every message on its own
+TEST(Ed25519Tests, VerifyMany)
+{
+  auto keys = ed25519::generate_keys_json();
+  std::vector<ed25519::SignedMessage> messages;
+  for (int i = 0; i < 50; i++)
+  {
+    std::string message = "handshake " + std::to_string(i);
+    messages.push_back({message, ed25519::sign_message(message, json_field(keys, "privateKey")), json_field(keys, "publicKey")});
+  }
+  messages[13].message += "!";
+  messages[31].signature_b64 = messages[30].signature_b64;
+
+  auto valid = ed25519::verify_many(messages);
+  ASSERT_EQ(messages.size(), valid.size());
+  for (std::size_t i = 0; i < valid.size(); i++)
+    EXPECT_EQ(i != 13 && i != 31, valid[i]) << i;
+}
+
+// A signer produces the same signatures as sign_message, Ed25519 being deterministic
+TEST(Ed25519Tests, SignerMatchesSignMessage)
+{
+  auto keys = ed25519::generate_keys_json();
+  auto private_key = json_field(keys, "privateKey");
+  std::vector<std::string> messages;
+  for (int i = 0; i < 40; i++)
+    messages.push_back("ticket " + std::to_string(i));
+
+  ed25519::Signer signer(private_key);
+  auto signatures = signer.sign_many(messages);
+  ASSERT_EQ(messages.size(), signatures.size());
+  for (std::size_t i = 0; i < messages.size(); i++)
+  {
+    EXPECT_EQ(ed25519::sign_message(messages[i], private_key), signatures[i]);
+    EXPECT_TRUE(ed25519::verify(messages[i], signatures[i], json_field(keys, "publicKey")));
+  }
+
+  ASSERT_ANY_THROW(ed25519::Signer("c2hvcnQ="));
+  EXPECT_EQ("error", ed25519::sign_message("hello", "c2hvcnQ="));
+}
@@ -1,4 +1,8 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 #include "vectorcmp.hpp"
 #include "encoders.hpp"
@@ -17,4 +21,90 @@ TEST(EncoderTests, EncodeHexToBinary)
   auto converted = encoders::hex_to_binary(hex);
   std::vector<unsigned char> a = {0x0, 0x1, 0x4, 0xa, 0xf};
   ASSERT_VEC_EQ(converted, a);
-}
\ No newline at end of file
+}
+// Upper case digits and an odd trailing digit decode like they always have
+TEST(EncoderTests, HexToBinaryEdgeCases)
+{
+  std::vector<unsigned char> expected = {0xab, 0xcd, 0x0e};
+  auto converted = encoders::hex_to_binary("ABcDe");
+  ASSERT_VEC_EQ(converted, expected);
+  ASSERT_THROW(encoders::hex_to_binary("0g"), std::invalid_argument);
+  // A bad digit deep inside a vectorised block is still caught
+  ASSERT_THROW(encoders::hex_to_binary(std::string(40, 'a') + "x" + std::string(23, 'a')), std::invalid_argument);
+}
+
+// Every length around the vector block sizes round trips, in both APIs
+TEST(EncoderTests, HexRoundTripAllLengths)
+{
+  std::vector<unsigned char> data(100);
+  for (std::size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<unsigned char>(i * 37 + 11);
+  for (std::size_t length = 0; length <= data.size(); length++)
+  {
+    std::string hex = encoders::binary_to_hex(data.data(), length);
+    ASSERT_EQ(2 * length, hex.size());
+    auto decoded = encoders::hex_to_binary(hex);
+    ASSERT_TRUE(std::equal(decoded.begin(), decoded.end(), data.begin()) && decoded.size() == length);
+
+    std::vector<unsigned char> out(encoders::hex_decoded_length(hex.size()));
+    ASSERT_EQ(length, encoders::hex_to_binary(hex.data(), hex.size(), out.data()));
+    ASSERT_TRUE(std::equal(out.begin(), out.end(), data.begin()));
+  }
+}
+
+// Known url safe base64 vectors, including padding and the - and _ characters
+TEST(EncoderTests, Base64Vectors)
+{
+  std::vector<std::pair<std::string, std::string>> vectors = {
+      {"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"}, {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"}, {"\xfb\xff\xbf", "-_-_"}};
+  for (auto &[plain, encoded] : vectors)
+  {
+    std::vector<unsigned char> bytes(plain.begin(), plain.end());
+    EXPECT_EQ(encoded, encoders::base64_encode(bytes));
+    auto decoded = encoders::base64_decode(encoded);
+    EXPECT_EQ(plain, std::string(decoded.begin(), decoded.end()));
+  }
+  // Decoding stops at the first character outside the alphabet
+  auto decoded = encoders::base64_decode("Zm9v+YmFy");
+  EXPECT_EQ("foo", std::string(decoded.begin(), decoded.end()));
+}
+
+// Every length around the vector block sizes (12 and 48 bytes in, 16 and 64 characters out), every byte value
+TEST(EncoderTests, Base64RoundTrip)
+{
+  std::vector<unsigned char> data(300);
+  for (std::size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<unsigned char>(i * 37 + 11);
+  for (std::size_t length = 0; length <= data.size(); length++)
+  {
+    std::vector<unsigned char> bytes(data.begin(), data.begin() + length);
+    std::string encoded = encoders::base64_encode(bytes);
+    ASSERT_EQ(encoders::base64_encoded_length(length), encoded.size());
+    for (std::size_t i = 0; i < length / 3 * 4; i++)
+      ASSERT_NE('=', encoded[i]) << "at " << i << " of " << length;
+    ASSERT_TRUE(encoders::base64_decode(encoded) == bytes) << "length " << length;
+  }
+}
+
+// The whole alphabet in one string long enough for the vector kernels, then a bad character at every position
+TEST(EncoderTests, Base64DecodeStopsAnywhere)
+{
+  std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  std::string encoded = alphabet + alphabet;
+  auto decoded = encoders::base64_decode(encoded);
+  ASSERT_EQ(96, decoded.size());
+  ASSERT_EQ(encoded, encoders::base64_encode(decoded));
+
+  for (char bad : {'=', '+', '/', '.', '\0', '\x80', '\xff'})
+  {
+    for (std::size_t at = 0; at < encoded.size(); at++)
+    {
+      std::string broken = encoded;
+      broken[at] = bad;
+      auto prefix = encoders::base64_decode(broken);
+      // Only the whole bytes before the bad character are decoded
+      ASSERT_EQ(at * 6 / 8, prefix.size()) << "bad character at " << at;
+      ASSERT_TRUE(std::equal(prefix.begin(), prefix.end(), decoded.begin())) << "bad character at " << at;
+    }
+  }
+}
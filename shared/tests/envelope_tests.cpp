@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "commonrand.hpp"
+#include "encoders.hpp"
+#include "envelope.hpp"
+
+/**
+ * Tests for multi-recipient envelopes
+ */
+
+// Every member can open the envelope with their own wrapped key, and the payload is only stored once
+TEST(EnvelopeTests, EveryMemberOpens)
+{
+  std::string plaintext = "A long caption for a picture in a very large group " + commonrand::hex(500);
+  std::vector<std::string> secrets;
+  for (int i = 0; i < 50; i++)
+    secrets.push_back(commonrand::hex(32));
+
+  std::vector<std::string> wrapped_keys;
+  std::string payload = envelope::seal(plaintext, secrets, wrapped_keys);
+  ASSERT_EQ(secrets.size(), wrapped_keys.size());
+  EXPECT_EQ(envelope::PAYLOAD_OVERHEAD + plaintext.size(), encoders::base64_decode(payload).size());
+  for (std::size_t i = 0; i < secrets.size(); i++)
+  {
+    EXPECT_EQ(envelope::WRAPPED_KEY_LENGTH, encoders::base64_decode(wrapped_keys[i]).size());
+    EXPECT_EQ(plaintext, envelope::open(payload, wrapped_keys[i], secrets[i]));
+  }
+}
+
+// A wrapped key only opens with its own secret and only for its own payload
+TEST(EnvelopeTests, KeysAreBound)
+{
+  std::vector<std::string> secrets = {commonrand::hex(32), commonrand::hex(32)};
+  std::vector<std::string> wrapped_keys, other_wrapped_keys;
+  std::string payload = envelope::seal("hello", secrets, wrapped_keys);
+  std::string other_payload = envelope::seal("hello", secrets, other_wrapped_keys);
+
+  EXPECT_EQ("error", envelope::open(payload, wrapped_keys[0], secrets[1]));
+  EXPECT_EQ("error", envelope::open(payload, other_wrapped_keys[0], secrets[0]));
+
+  auto tampered = encoders::base64_decode(payload);
+  tampered.back() ^= 1;
+  EXPECT_EQ("error", envelope::open(encoders::base64_encode(tampered), wrapped_keys[0], secrets[0]));
+  EXPECT_EQ("hello", envelope::open(payload, wrapped_keys[0], secrets[0]));
+}
+
+// Why an envelope didn't open is reported by status
+TEST(EnvelopeTests, TryOpenStatuses)
+{
+  std::vector<std::string> secrets = {commonrand::hex(32), commonrand::hex(32)};
+  std::vector<std::string> wrapped_keys;
+  std::string payload = envelope::seal("hello", secrets, wrapped_keys);
+
+  std::string plaintext;
+  EXPECT_EQ(decryption::Status::ok, envelope::try_open(payload, wrapped_keys[1], secrets[1], plaintext));
+  EXPECT_EQ("hello", plaintext);
+  EXPECT_EQ(decryption::Status::bad_tag, envelope::try_open(payload, wrapped_keys[0], secrets[1], plaintext));
+  EXPECT_EQ(decryption::Status::malformed, envelope::try_open(payload.substr(0, 8), wrapped_keys[0], secrets[0], plaintext));
+  EXPECT_EQ(decryption::Status::bad_key, envelope::try_open(payload, wrapped_keys[0], "abcd", plaintext));
+  EXPECT_EQ(decryption::Status::bad_key, envelope::try_open(payload, wrapped_keys[0], "not hex", plaintext));
+
+  auto future = encoders::base64_decode(payload);
+  future[0] = envelope::VERSION + 1;
+  EXPECT_EQ(decryption::Status::unsupported_version,
+            envelope::try_open(encoders::base64_encode(future), wrapped_keys[0], secrets[0], plaintext));
+}
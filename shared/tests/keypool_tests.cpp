@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <future>
+#include <set>
+#include "keypool.hpp"
+#include "workpool.hpp"
+#include "x25519.hpp"
+
+/**
+ * Tests for the pool of ephemeral X25519 keypairs
+ */
+
+// Every keypair is handed out once, and belongs together
+TEST(KeyPoolTests, SingleUse)
+{
+  workpool::WorkerPool workers(2);
+  keypool::EphemeralPool pool(16, 4, workers);
+  pool.fill();
+  EXPECT_EQ(16, pool.available());
+
+  std::set<x25519::fixed_key> private_keys;
+  for (int i = 0; i < 40; i++)
+  {
+    x25519::fixed_key private_key, public_key, secret1, secret2;
+    pool.take(private_key, public_key);
+    EXPECT_TRUE(private_keys.insert(private_key).second);
+
+    // The public key matches the private key
+    x25519::fixed_key other_private, other_public;
+    x25519::generate_keypair(other_private, other_public);
+    x25519::derive_secret(private_key.data(), other_public.data(), secret1.data());
+    x25519::derive_secret(other_private.data(), public_key.data(), secret2.data());
+    EXPECT_TRUE(secret1 == secret2);
+  }
+}
+
+// Dropping under the low watermark refills the pool in the background
+TEST(KeyPoolTests, RefillsAtLowWatermark)
+{
+  workpool::WorkerPool workers(2);
+  keypool::EphemeralPool pool(8, 4, workers);
+  pool.fill();
+  x25519::fixed_key private_key, public_key;
+  for (int i = 0; i < 4; i++)
+    pool.take(private_key, public_key);
+  EXPECT_EQ(4, pool.available());
+  pool.take(private_key, public_key);
+
+  for (int i = 0; i < 500 && pool.available() < 8; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  EXPECT_EQ(8, pool.available());
+
+  pool.configure(2, 0);
+  EXPECT_EQ(2, pool.available());
+  ASSERT_ANY_THROW(pool.configure(2, 3));
+}
+
+// A backup filling the bulk lane doesn't hold up refills
+TEST(KeyPoolTests, RefillsWhileBulkIsBusy)
+{
+  workpool::WorkerPool workers(2);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  workers.submit(workpool::Lane::bulk, [released]()
+                 { released.wait(); });
+  {
+    keypool::EphemeralPool pool(8, 4, workers);
+    x25519::fixed_key private_key, public_key;
+    pool.take(private_key, public_key);
+    for (int i = 0; i < 500 && pool.available() < 8; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    EXPECT_EQ(8, pool.available());
+  }
+  release.set_value();
+}
+
+// An empty pool still hands out keypairs
+TEST(KeyPoolTests, Empty)
+{
+  workpool::WorkerPool workers(1);
+  keypool::EphemeralPool pool(0, 0, workers);
+  x25519::fixed_key private_key{}, public_key{};
+  pool.take(private_key, public_key);
+  EXPECT_FALSE(public_key == x25519::fixed_key{});
+  EXPECT_EQ(0, pool.available());
+}
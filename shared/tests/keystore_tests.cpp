@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "aes256.hpp"
+#include "commonrand.hpp"
+#include "encoders.hpp"
+#include "keystore.hpp"
+#include "x25519.hpp"
+#include "yap.hpp"
+
+/**
+ * Tests for the session keystore
+ */
+
+// Keys in the store agree with the same keys used directly
+TEST(KeystoreTests, X25519AgreesWithRawKeys)
+{
+  auto alice = x25519::generate_keypair();
+  auto bob = x25519::generate_keypair();
+  auto expected = x25519::derive_secret(alice->private_key, bob->public_key);
+
+  auto alice_handle = keystore::add_x25519_private_key(alice->private_key.data());
+  auto alice_key = keystore::get(alice_handle, keystore::Kind::x25519_private_key);
+  EXPECT_TRUE(std::vector<unsigned char>(alice_key->public_key().begin(), alice_key->public_key().end()) == alice->public_key);
+
+  auto secret_handle = keystore::derive_x25519_secret(alice_handle, bob->public_key.data());
+  auto secret = keystore::get(secret_handle, keystore::Kind::secret);
+  EXPECT_TRUE(std::vector<unsigned char>(secret->data(), secret->data() + secret->size()) == expected);
+
+  // A private key that never left the store decrypts YAP messages sent to it
+  x25519::fixed_key public_key, ss;
+  auto generated = keystore::generate_x25519(public_key);
+  std::copy(expected.begin(), expected.end(), ss.begin());
+  std::string plaintext = "keep me out of the JS heap";
+  std::vector<unsigned char> ciphertext(yap::v1::OVERHEAD + plaintext.size()), decrypted(plaintext.size());
+  yap::v1::encrypt(ss, public_key, reinterpret_cast<const unsigned char *>(plaintext.data()), plaintext.size(), ciphertext.data());
+  yap::v1::decrypt(ss, keystore::get(generated, keystore::Kind::x25519_private_key)->pkey(),
+                   ciphertext.data(), ciphertext.size(), decrypted.data());
+  EXPECT_EQ(plaintext, std::string(decrypted.begin(), decrypted.end()));
+}
+
+// Removed handles stay invalid, but keys in use survive until they're let go
+TEST(KeystoreTests, Remove)
+{
+  auto bytes = encoders::hex_to_binary(commonrand::hex(aes256::KEY_LENGTH));
+  auto handle = keystore::add_secret(bytes.data(), bytes.size());
+  auto in_use = keystore::get(handle, keystore::Kind::secret);
+  ASSERT_ANY_THROW(keystore::get(handle, keystore::Kind::x25519_private_key));
+
+  keystore::remove(handle);
+  ASSERT_ANY_THROW(keystore::get(handle, keystore::Kind::secret));
+  EXPECT_TRUE(std::vector<unsigned char>(in_use->data(), in_use->data() + in_use->size()) == bytes);
+  keystore::remove(handle);
+
+  auto next = keystore::add_secret(bytes.data(), bytes.size());
+  EXPECT_NE(handle, next);
+  keystore::clear();
+  ASSERT_ANY_THROW(keystore::get(next, keystore::Kind::secret));
+  ASSERT_ANY_THROW(keystore::get(0, keystore::Kind::secret));
+}
+
+// Private keys have to be the right size
+TEST(KeystoreTests, BadPrivateKey)
+{
+  unsigned char short_key[16] = {};
+  ASSERT_ANY_THROW(keystore::get(keystore::add_secret(short_key, sizeof(short_key)), keystore::Kind::x25519_private_key));
+  ASSERT_ANY_THROW(keystore::derive_x25519_secret(keystore::add_secret(short_key, sizeof(short_key)), short_key));
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "tempfiles.hpp"
+#include "vectorcmp.hpp"
+#include "aes256.hpp"
+#include "commonhash.hpp"
+#include "commonrand.hpp"
+#include "encoders.hpp"
+#include "mediastore.hpp"
+
+/**
+ * Tests for the content-addressed store of encrypted media
+ */
+
+namespace
+{
+  std::string temp_path(const std::string &name)
+  {
+    return tempfiles::path("mediastore", name);
+  }
+
+  bool exists(const std::string &path)
+  {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+  }
+
+  std::vector<unsigned char> decrypt(const mediastore::Stored &stored)
+  {
+    std::string key, iv;
+    aes256::split_key_and_iv(stored.key_and_iv, key, iv);
+    std::ifstream in(stored.path, std::ios::binary);
+    std::ofstream out(temp_path("decrypted"), std::ios::binary);
+    aes256::decrypt_file(in, out, key, iv);
+    out.close();
+    return tempfiles::read_file(temp_path("decrypted"));
+  }
+}
+
+// The second put of a file finds the first copy, and both decrypt to the file
+TEST(MediaStoreTests, PutTwice)
+{
+  mediastore::Store store(temp_path("store_twice"));
+  auto plaintext = encoders::hex_to_binary(commonrand::hex(200 * 1024 + 5));
+  tempfiles::write_file(temp_path("video"), plaintext);
+
+  auto first = store.put(temp_path("video"));
+  EXPECT_FALSE(first.hit);
+  EXPECT_EQ(hash::hash_file(temp_path("video")), first.digest);
+  EXPECT_EQ(160, first.key_and_iv.size());
+  EXPECT_TRUE(plaintext == decrypt(first));
+
+  auto second = store.put(temp_path("video"));
+  EXPECT_TRUE(second.hit);
+  EXPECT_EQ(first.path, second.path);
+  EXPECT_EQ(first.key_and_iv, second.key_and_iv);
+
+  // The same content under another name is stored once too
+  tempfiles::write_file(temp_path("forwarded"), plaintext);
+  auto third = store.put(temp_path("forwarded"));
+  EXPECT_TRUE(third.hit);
+  EXPECT_EQ(first.key_and_iv, third.key_and_iv);
+
+  auto stats = store.stats();
+  EXPECT_EQ(2, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(1, stats.entries);
+  EXPECT_EQ(std::uint64_t((plaintext.size() / 16 + 1) * 16), stats.bytes);
+}
+
+// A file that was rewritten isn't mistaken for its old content
+TEST(MediaStoreTests, ChangedFile)
+{
+  mediastore::Store store(temp_path("store_changed"));
+  tempfiles::write_file(temp_path("changing"), encoders::hex_to_binary(commonrand::hex(1000)));
+  auto before = store.put(temp_path("changing"));
+  auto plaintext = encoders::hex_to_binary(commonrand::hex(1000));
+  tempfiles::write_file(temp_path("changing"), plaintext);
+  auto after = store.put(temp_path("changing"));
+  EXPECT_FALSE(after.hit);
+  EXPECT_NE(before.digest, after.digest);
+  EXPECT_TRUE(plaintext == decrypt(after));
+}
+
+// Least recently used entries go first once over budget, but never while pinned
+TEST(MediaStoreTests, Eviction)
+{
+  mediastore::Store store(temp_path("store_evict"), 25 * 1024);
+  std::vector<mediastore::Stored> stored;
+  for (int i = 0; i < 3; i++)
+  {
+    tempfiles::write_file(temp_path("photo" + std::to_string(i)), encoders::hex_to_binary(commonrand::hex(10 * 1024)));
+    stored.push_back(store.put(temp_path("photo" + std::to_string(i))));
+  }
+  // Everything is pinned, so the store stays over budget for now
+  EXPECT_EQ(3, store.stats().entries);
+
+  store.release(stored[1].digest);
+  store.release(stored[0].digest);
+  EXPECT_EQ(2, store.stats().entries);
+  EXPECT_EQ(1, store.stats().evictions);
+  EXPECT_FALSE(exists(stored[1].path));
+  EXPECT_TRUE(exists(stored[0].path));
+  EXPECT_FALSE(store.put(temp_path("photo1")).hit);
+
+  store.set_budget(0);
+  EXPECT_EQ(2, store.stats().entries);
+  store.clear();
+  EXPECT_EQ(0, store.stats().entries);
+  EXPECT_EQ(0, store.stats().bytes);
+  EXPECT_FALSE(exists(stored[2].path));
+}
+
+// Ciphertexts of a previous run can't be opened anymore, so they are cleaned up
+TEST(MediaStoreTests, LeftoversRemoved)
+{
+  std::string path;
+  {
+    mediastore::Store store(temp_path("store_leftovers"));
+    tempfiles::write_file(temp_path("left"), encoders::hex_to_binary(commonrand::hex(100)));
+    path = store.put(temp_path("left")).path;
+    tempfiles::write_file(temp_path("store_leftovers/stale.part"), {1, 2, 3});
+    tempfiles::write_file(temp_path("store_leftovers/keep.txt"), {1, 2, 3});
+    EXPECT_TRUE(exists(path));
+  }
+  EXPECT_FALSE(exists(path));
+  mediastore::Store store(temp_path("store_leftovers"));
+  EXPECT_FALSE(exists(temp_path("store_leftovers/stale.part")));
+  EXPECT_TRUE(exists(temp_path("store_leftovers/keep.txt")));
+  std::remove(temp_path("store_leftovers/keep.txt").c_str());
+}
+
+TEST(MediaStoreTests, MissingFile)
+{
+  mediastore::Store store(temp_path("store_missing"));
+  ASSERT_ANY_THROW(store.put(temp_path("does_not_exist")));
+  EXPECT_EQ(0, store.stats().entries);
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "tempfiles.hpp"
+#include "vectorcmp.hpp"
+#include "aes256.hpp"
+#include "chunkedfile.hpp"
+#include "commonrand.hpp"
+#include "memdecrypt.hpp"
+
+/**
+ * Tests for decrypting files into memory
+ */
+
+namespace
+{
+  std::string temp_path(const std::string &name)
+  {
+    return tempfiles::path("memdecrypt", name);
+  }
+
+  std::vector<unsigned char> random_plaintext(std::size_t length)
+  {
+    std::vector<unsigned char> plaintext(length);
+    commonrand::bytes(plaintext.data(), plaintext.size());
+    return plaintext;
+  }
+
+  /// @brief encrypt plaintext into a version 1 or 2 file
+  /// @return the key and iv string for it
+  std::string encrypt(const std::string &name, const std::vector<unsigned char> &plaintext, bool chunked)
+  {
+    unsigned char key[EVP_MAX_KEY_LENGTH], iv[EVP_MAX_IV_LENGTH];
+    aes256::generate_random_key(key);
+    aes256::generate_random_iv(iv);
+    tempfiles::write_file(temp_path(name + "_plain"), plaintext);
+    if (chunked)
+    {
+      chunkedfile::encrypt_file(temp_path(name + "_plain"), temp_path(name), key, iv, 1000);
+    }
+    else
+    {
+      std::ifstream in(temp_path(name + "_plain"), std::ios::binary);
+      std::ofstream out(temp_path(name), std::ios::binary);
+      aes256::encrypt_file(in, out, key, iv);
+    }
+    return aes256::combine_key_and_iv(key, iv);
+  }
+}
+
+// Both formats, empty and with a few chunks, come back as they went in
+TEST(MemDecryptTests, RoundTrip)
+{
+  for (bool chunked : {false, true})
+  {
+    for (std::size_t length : {0, 1, 4500})
+    {
+      auto plaintext = random_plaintext(length);
+      auto key = encrypt("roundtrip", plaintext, chunked);
+      ASSERT_VEC_EQ(plaintext, memdecrypt::decrypt_file(temp_path("roundtrip"), key));
+    }
+  }
+}
+
+// A plaintext of exactly the cap is fine, one byte more is refused
+TEST(MemDecryptTests, SizeCap)
+{
+  for (bool chunked : {false, true})
+  {
+    for (std::size_t length : {32, 40})
+    {
+      auto plaintext = random_plaintext(length);
+      auto key = encrypt("cap", plaintext, chunked);
+      ASSERT_VEC_EQ(plaintext, memdecrypt::decrypt_file(temp_path("cap"), key, length));
+      ASSERT_ANY_THROW(memdecrypt::decrypt_file(temp_path("cap"), key, length - 1));
+      ASSERT_ANY_THROW(memdecrypt::decrypt_file(temp_path("cap"), key, length - 20));
+    }
+  }
+}
+
+TEST(MemDecryptTests, BadInput)
+{
+  auto key = encrypt("bad", random_plaintext(100), false);
+  auto other_key = encrypt("bad_other", random_plaintext(100), false);
+  ASSERT_ANY_THROW(memdecrypt::decrypt_file(temp_path("missing"), key));
+  ASSERT_ANY_THROW(memdecrypt::decrypt_file(temp_path("bad"), key.substr(2)));
+  ASSERT_ANY_THROW(memdecrypt::decrypt_file(temp_path("bad"), "zz" + key.substr(2)));
+  // The plaintext isn't whole blocks, so it can't be a version 1 file
+  ASSERT_ANY_THROW(memdecrypt::decrypt_file(temp_path("bad_plain"), key));
+  auto chunked_key = encrypt("bad_chunked", random_plaintext(100), true);
+  ASSERT_NO_THROW(memdecrypt::decrypt_file(temp_path("bad_chunked"), chunked_key));
+  ASSERT_ANY_THROW(memdecrypt::decrypt_file(temp_path("bad_chunked"), other_key));
+}
+
+// Every file gets its own result, failures don't spill over
+TEST(MemDecryptTests, DecryptMany)
+{
+  std::vector<memdecrypt::File> files;
+  std::vector<std::vector<unsigned char>> plaintexts;
+  for (std::size_t i = 0; i < 20; i++)
+  {
+    std::string name = "many_" + std::to_string(i);
+    plaintexts.push_back(random_plaintext(100 * i));
+    files.push_back({temp_path(name), encrypt(name, plaintexts.back(), i % 2 == 0)});
+  }
+  files.push_back({temp_path("many_missing"), files[0].key_and_iv});
+  files.push_back({files[1].path, files[3].key_and_iv});
+
+  auto results = memdecrypt::decrypt_many(files, 1000);
+  ASSERT_EQ(files.size(), results.size());
+  for (std::size_t i = 0; i < 11; i++)
+  {
+    EXPECT_EQ("", results[i].error);
+    ASSERT_VEC_EQ(plaintexts[i], results[i].plaintext);
+  }
+  for (std::size_t i = 11; i < 20; i++)
+    EXPECT_NE("", results[i].error);
+  EXPECT_NE("", results[20].error);
+  EXPECT_NE("", results[21].error);
+  EXPECT_EQ(0, results[21].plaintext.size());
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "tempfiles.hpp"
+#include "commonrand.hpp"
+#include "encoders.hpp"
+#include "pbdelta.hpp"
+#include "pbencrypt.hpp"
+
+/**
+ * Tests for incremental backups
+ */
+
+namespace
+{
+  std::string temp_path(const std::string &name)
+  {
+    return tempfiles::path("pbdelta", name);
+  }
+}
+
+// A base backup plus two deltas restores the latest database, and deltas only carry what changed
+TEST(PBDeltaTests, ChainRoundTrip)
+{
+  auto database = encoders::hex_to_binary(commonrand::hex(20 * pbdelta::DEFAULT_GROUP_SIZE + 100));
+  tempfiles::write_file(temp_path("db"), database);
+  pbdelta::encrypt_base("hunter2", "{\"version\":0}", temp_path("db"), temp_path("base"), temp_path("manifest"));
+
+  // Touch two groups
+  database[5] ^= 1;
+  database[12 * pbdelta::DEFAULT_GROUP_SIZE + 7] ^= 1;
+  tempfiles::write_file(temp_path("db"), database);
+  EXPECT_EQ(2, pbdelta::encrypt("hunter2", "{\"version\":1}", temp_path("db"), temp_path("manifest"),
+                                temp_path("delta1"), temp_path("manifest_next")));
+  EXPECT_LT(tempfiles::read_file(temp_path("delta1")).size(), 3 * pbdelta::DEFAULT_GROUP_SIZE);
+  std::rename(temp_path("manifest_next").c_str(), temp_path("manifest").c_str());
+
+  // Grow the database, which changes the old last group and adds new ones
+  auto extra = encoders::hex_to_binary(commonrand::hex(pbdelta::DEFAULT_GROUP_SIZE));
+  database.insert(database.end(), extra.begin(), extra.end());
+  tempfiles::write_file(temp_path("db"), database);
+  EXPECT_EQ(2, pbdelta::encrypt("hunter2", "{\"version\":2}", temp_path("db"), temp_path("manifest"),
+                                temp_path("delta2"), temp_path("manifest_next")));
+
+  auto metadata = pbdelta::restore("hunter2", temp_path("base"), {temp_path("delta1"), temp_path("delta2")},
+                                   temp_path("restored"));
+  EXPECT_EQ("{\"version\":2}", metadata);
+  EXPECT_TRUE(database == tempfiles::read_file(temp_path("restored")));
+}
+
+// A database that shrank is cut down to its new size
+TEST(PBDeltaTests, Shrink)
+{
+  auto database = encoders::hex_to_binary(commonrand::hex(5 * pbdelta::DEFAULT_GROUP_SIZE));
+  tempfiles::write_file(temp_path("db_shrink"), database);
+  pbdelta::encrypt_base("hunter2", "{}", temp_path("db_shrink"), temp_path("base_shrink"), temp_path("manifest_shrink"));
+
+  database.resize(2 * pbdelta::DEFAULT_GROUP_SIZE + 10);
+  tempfiles::write_file(temp_path("db_shrink"), database);
+  EXPECT_EQ(1, pbdelta::encrypt("hunter2", "{}", temp_path("db_shrink"), temp_path("manifest_shrink"),
+                                temp_path("delta_shrink"), temp_path("manifest_shrink_next")));
+
+  pbdelta::restore("hunter2", temp_path("base_shrink"), {temp_path("delta_shrink")}, temp_path("restored_shrink"));
+  EXPECT_TRUE(database == tempfiles::read_file(temp_path("restored_shrink")));
+}
+
+// Deltas have to be replayed in order
+TEST(PBDeltaTests, OutOfOrder)
+{
+  auto database = encoders::hex_to_binary(commonrand::hex(3 * pbdelta::DEFAULT_GROUP_SIZE));
+  tempfiles::write_file(temp_path("db_order"), database);
+  pbdelta::encrypt_base("hunter2", "{}", temp_path("db_order"), temp_path("base_order"), temp_path("manifest_order"));
+
+  for (int i = 1; i <= 2; i++)
+  {
+    database[i] ^= 1;
+    tempfiles::write_file(temp_path("db_order"), database);
+    pbdelta::encrypt("hunter2", "{}", temp_path("db_order"), temp_path("manifest_order"),
+                     temp_path("delta_order" + std::to_string(i)), temp_path("manifest_order"));
+  }
+
+  ASSERT_ANY_THROW(pbdelta::restore("hunter2", temp_path("base_order"), {temp_path("delta_order2")}, temp_path("restored_order")));
+  ASSERT_ANY_THROW(pbdelta::restore("hunter2", temp_path("base_order"),
+                                    {temp_path("delta_order2"), temp_path("delta_order1")}, temp_path("restored_order")));
+  pbdelta::restore("hunter2", temp_path("base_order"),
+                   {temp_path("delta_order1"), temp_path("delta_order2")}, temp_path("restored_order"));
+  EXPECT_TRUE(database == tempfiles::read_file(temp_path("restored_order")));
+}
+
+// Deltas only restore on top of the base backup of their own chain
+TEST(PBDeltaTests, OtherChain)
+{
+  auto database = encoders::hex_to_binary(commonrand::hex(3 * pbdelta::DEFAULT_GROUP_SIZE));
+  tempfiles::write_file(temp_path("db_chain"), database);
+  pbdelta::encrypt_base("hunter2", "{}", temp_path("db_chain"), temp_path("base_chain_a"), temp_path("manifest_chain_a"));
+  pbdelta::encrypt_base("hunter2", "{}", temp_path("db_chain"), temp_path("base_chain_b"), temp_path("manifest_chain_b"));
+  pbencrypt::encrypt("hunter2", "{}", temp_path("db_chain"), temp_path("base_chain_plain"));
+  database[1] ^= 1;
+  tempfiles::write_file(temp_path("db_chain"), database);
+  pbdelta::encrypt("hunter2", "{}", temp_path("db_chain"), temp_path("manifest_chain_b"),
+                   temp_path("delta_chain_b"), temp_path("manifest_chain_b"));
+
+  std::remove(temp_path("restored_chain").c_str());
+  ASSERT_ANY_THROW(pbdelta::restore("hunter2", temp_path("base_chain_a"), {temp_path("delta_chain_b")}, temp_path("restored_chain")));
+  ASSERT_ANY_THROW(pbdelta::restore("hunter2", temp_path("base_chain_plain"), {temp_path("delta_chain_b")}, temp_path("restored_chain")));
+  EXPECT_FALSE(std::ifstream(temp_path("restored_chain")).is_open());
+
+  pbdelta::restore("hunter2", temp_path("base_chain_b"), {temp_path("delta_chain_b")}, temp_path("restored_chain"));
+  EXPECT_TRUE(database == tempfiles::read_file(temp_path("restored_chain")));
+  // Full backups without a chain still restore on their own
+  pbdelta::restore("hunter2", temp_path("base_chain_plain"), {}, temp_path("restored_chain"));
+  EXPECT_EQ(3 * pbdelta::DEFAULT_GROUP_SIZE, tempfiles::read_file(temp_path("restored_chain")).size());
+}
+
+// A delta cut short is only noticed at its end, by then nothing may have been written yet
+TEST(PBDeltaTests, DamagedDeltaLeavesDatabaseAlone)
+{
+  auto database = encoders::hex_to_binary(commonrand::hex(3 * pbdelta::DEFAULT_GROUP_SIZE));
+  tempfiles::write_file(temp_path("db_damaged"), database);
+  pbdelta::encrypt_base("hunter2", "{}", temp_path("db_damaged"), temp_path("base_damaged"), temp_path("manifest_damaged"));
+  auto original = database;
+  for (std::size_t group = 0; group < 3; group++)
+    database[group * pbdelta::DEFAULT_GROUP_SIZE] ^= 1;
+  tempfiles::write_file(temp_path("db_damaged"), database);
+  pbdelta::encrypt("hunter2", "{}", temp_path("db_damaged"), temp_path("manifest_damaged"),
+                   temp_path("delta_damaged"), temp_path("manifest_damaged_next"));
+  auto delta = tempfiles::read_file(temp_path("delta_damaged"));
+  delta.resize(delta.size() - 16);
+  tempfiles::write_file(temp_path("delta_damaged"), delta);
+
+  tempfiles::write_file(temp_path("applied_damaged"), original);
+  ASSERT_ANY_THROW(pbdelta::apply("hunter2", temp_path("delta_damaged"), temp_path("applied_damaged"), 1));
+  EXPECT_TRUE(original == tempfiles::read_file(temp_path("applied_damaged")));
+
+  std::vector<unsigned char> previous = {1, 2, 3};
+  tempfiles::write_file(temp_path("restored_damaged"), previous);
+  ASSERT_ANY_THROW(pbdelta::restore("hunter2", temp_path("base_damaged"), {temp_path("delta_damaged")}, temp_path("restored_damaged")));
+  EXPECT_TRUE(previous == tempfiles::read_file(temp_path("restored_damaged")));
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "tempfiles.hpp"
+#include "commonrand.hpp"
+#include "encoders.hpp"
+#include "pbencrypt.hpp"
+
+/**
+ * Tests for password based backups
+ */
+
+namespace
+{
+  std::string temp_path(const std::string &name)
+  {
+    return tempfiles::path("pbencrypt", name);
+  }
+}
+
+// A backup bigger than one pipeline buffer restores to the same database and metadata
+TEST(PBEncryptTests, RoundTrip)
+{
+  auto database = encoders::hex_to_binary(commonrand::hex(3 * 1024 * 1024 + 17));
+  tempfiles::write_file(temp_path("db"), database);
+
+  std::uint64_t last_progress = 0;
+  pbencrypt::encrypt("hunter2", "{\"version\":1}", temp_path("db"), temp_path("backup"), pbencrypt::Compression::none,
+                     [&](std::uint64_t processed, std::uint64_t total)
+                     {
+                       EXPECT_EQ(database.size(), total);
+                       last_progress = processed;
+                     });
+  EXPECT_EQ(database.size(), last_progress);
+
+  auto metadata = pbencrypt::decrypt("hunter2", temp_path("backup"), temp_path("restored"));
+  EXPECT_EQ("{\"version\":1}", metadata);
+  // Too big to compare byte by byte with ASSERT_VEC_EQ
+  EXPECT_TRUE(database == tempfiles::read_file(temp_path("restored")));
+}
+
+// The wrong password can't restore the database
+TEST(PBEncryptTests, WrongPassword)
+{
+  tempfiles::write_file(temp_path("db_wrong"), encoders::hex_to_binary(commonrand::hex(5000)));
+  pbencrypt::encrypt("hunter2", "{}", temp_path("db_wrong"), temp_path("backup_wrong"));
+  ASSERT_ANY_THROW(pbencrypt::decrypt("hunter3", temp_path("backup_wrong"), temp_path("restored_wrong")));
+}
+
+// Compressed backups restore to the same database and are smaller than the database itself
+TEST(PBEncryptTests, CompressedRoundTrip)
+{
+  // Repetitive, like a database full of chat text
+  std::string row = "{\"sender\":\"" + commonrand::hex(8) + "\",\"text\":\"see you tomorrow\"}";
+  std::vector<unsigned char> database;
+  while (database.size() < 2 * 1024 * 1024)
+    database.insert(database.end(), row.begin(), row.end());
+  tempfiles::write_file(temp_path("db_compressed"), database);
+
+  pbencrypt::encrypt("hunter2", "{\"version\":2}", temp_path("db_compressed"), temp_path("backup_compressed"),
+                     pbencrypt::Compression::deflate);
+  EXPECT_LT(tempfiles::read_file(temp_path("backup_compressed")).size(), database.size() / 4);
+
+  auto metadata = pbencrypt::decrypt("hunter2", temp_path("backup_compressed"), temp_path("restored_compressed"));
+  EXPECT_EQ("{\"version\":2}", metadata);
+  EXPECT_TRUE(database == tempfiles::read_file(temp_path("restored_compressed")));
+}
+
+// Uncompressed backups keep the original header so older versions can still restore them
+TEST(PBEncryptTests, UncompressedKeepsLegacyHeader)
+{
+  tempfiles::write_file(temp_path("db_legacy"), encoders::hex_to_binary(commonrand::hex(100)));
+  pbencrypt::encrypt("hunter2", "{}", temp_path("db_legacy"), temp_path("backup_legacy"));
+  auto backup = tempfiles::read_file(temp_path("backup_legacy"));
+  EXPECT_EQ("PORTBAK", std::string(reinterpret_cast<const char *>(backup.data())));
+
+  tempfiles::write_file(temp_path("db_flagged"), encoders::hex_to_binary(commonrand::hex(100)));
+  pbencrypt::encrypt("hunter2", "{}", temp_path("db_flagged"), temp_path("backup_flagged"), pbencrypt::Compression::deflate);
+  backup = tempfiles::read_file(temp_path("backup_flagged"));
+  EXPECT_EQ("PORTBK2", std::string(reinterpret_cast<const char *>(backup.data())));
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "vectorcmp.hpp"
+#include "pipeline.hpp"
+
+/**
+ * Tests for the streaming pipeline
+ */
+
+namespace
+{
+  pipeline::Source read_vector(const std::vector<unsigned char> &in)
+  {
+    auto position = std::make_shared<std::size_t>(0);
+    return [&in, position](unsigned char *buf, std::size_t capacity) -> std::size_t
+    {
+      std::size_t n = std::min(capacity, in.size() - *position);
+      std::copy(in.begin() + *position, in.begin() + *position + n, buf);
+      *position += n;
+      return n;
+    };
+  }
+
+  /// @brief Adds one to every byte and appends a trailer when finished
+  class AddOne : public pipeline::Stage
+  {
+  public:
+    void process(const unsigned char *data, std::size_t length, pipeline::Writer &out) override
+    {
+      for (std::size_t i = 0; i < length; i++)
+      {
+        unsigned char byte = data[i] + 1;
+        out.write(&byte, 1);
+      }
+    }
+    void finish(pipeline::Writer &out) override
+    {
+      unsigned char trailer = 0xff;
+      out.write(&trailer, 1);
+    }
+  };
+
+  class Explode : public pipeline::Stage
+  {
+  public:
+    void process(const unsigned char *, std::size_t, pipeline::Writer &) override
+    {
+      throw std::runtime_error("boom");
+    }
+  };
+}
+
+// Data passes through every stage in order, across many small buffers
+TEST(PipelineTests, StagesRunInOrder)
+{
+  std::vector<unsigned char> input(10000);
+  for (std::size_t i = 0; i < input.size(); i++)
+    input[i] = i % 200;
+
+  AddOne first, second;
+  std::vector<unsigned char> output;
+  std::vector<std::uint64_t> reports;
+  pipeline::run(
+      read_vector(input), {&first, &second},
+      [&](const unsigned char *data, std::size_t length)
+      { output.insert(output.end(), data, data + length); },
+      input.size(),
+      [&](std::uint64_t processed, std::uint64_t total)
+      { reports.push_back(processed); EXPECT_EQ(10000, total); },
+      256);
+
+  std::vector<unsigned char> expected;
+  for (auto byte : input)
+    expected.push_back(byte + 2);
+  expected.push_back(0x00); // the first trailer, plus one
+  expected.push_back(0xff);
+  ASSERT_VEC_EQ(expected, output);
+  ASSERT_FALSE(reports.empty());
+  EXPECT_EQ(10000, reports.back());
+}
+
+// A failing stage stops everything and the error reaches the caller
+TEST(PipelineTests, ErrorsPropagate)
+{
+  std::vector<unsigned char> input(100000, 7);
+  AddOne before;
+  Explode explode;
+  ASSERT_THROW(pipeline::run(read_vector(input), {&before, &explode}, [](const unsigned char *, std::size_t) {}, 0, nullptr, 512),
+               std::runtime_error);
+}
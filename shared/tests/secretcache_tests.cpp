@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "secretcache.hpp"
+#include "x25519.hpp"
+
+/**
+ * Tests for the cache of derived X25519 secrets
+ */
+
+// Cached secrets are the same as freshly derived ones, and repeats are hits
+TEST(SecretCacheTests, HitsAndMisses)
+{
+  secretcache::Cache cache(4);
+  auto ours = x25519::generate_keypair();
+  auto theirs = x25519::generate_keypair();
+  auto expected = x25519::derive_secret(ours->private_key, theirs->public_key);
+
+  for (int i = 0; i < 3; i++)
+  {
+    x25519::fixed_key secret;
+    cache.derive(ours->private_key.data(), theirs->public_key.data(), secret.data());
+    EXPECT_TRUE(std::vector<unsigned char>(secret.begin(), secret.end()) == expected);
+  }
+  auto stats = cache.stats();
+  EXPECT_EQ(2, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(1, stats.size);
+
+  // The other direction is a different pair of keys
+  x25519::fixed_key secret;
+  cache.derive(theirs->private_key.data(), ours->public_key.data(), secret.data());
+  EXPECT_TRUE(std::vector<unsigned char>(secret.begin(), secret.end()) == expected);
+  EXPECT_EQ(2, cache.stats().misses);
+}
+
+// The least recently used secret goes first
+TEST(SecretCacheTests, EvictsLeastRecentlyUsed)
+{
+  secretcache::Cache cache(2);
+  auto ours = x25519::generate_keypair();
+  std::vector<std::shared_ptr<x25519::KeyPair>> peers;
+  for (int i = 0; i < 3; i++)
+    peers.push_back(x25519::generate_keypair());
+  x25519::fixed_key secret;
+
+  cache.derive(ours->private_key.data(), peers[0]->public_key.data(), secret.data());
+  cache.derive(ours->private_key.data(), peers[1]->public_key.data(), secret.data());
+  // Touch the first peer so the second one is the oldest
+  cache.derive(ours->private_key.data(), peers[0]->public_key.data(), secret.data());
+  cache.derive(ours->private_key.data(), peers[2]->public_key.data(), secret.data());
+  EXPECT_EQ(1, cache.stats().evictions);
+  EXPECT_EQ(2, cache.stats().size);
+
+  auto hits = cache.stats().hits;
+  cache.derive(ours->private_key.data(), peers[0]->public_key.data(), secret.data());
+  EXPECT_EQ(hits + 1, cache.stats().hits);
+  cache.derive(ours->private_key.data(), peers[1]->public_key.data(), secret.data());
+  EXPECT_EQ(hits + 1, cache.stats().hits);
+
+  cache.clear();
+  EXPECT_EQ(0, cache.stats().size);
+}
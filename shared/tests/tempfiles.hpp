@@ -0,0 +1,31 @@
+#pragma once
+/**
+ * Helpers for tests that work on files in GoogleTest's temp directory
+ */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace tempfiles
+{
+  /// @brief a path in the temp directory, prefix keeps the files of each suite apart
+  inline std::string path(const std::string &prefix, const std::string &name)
+  {
+    return testing::TempDir() + prefix + "_" + name;
+  }
+
+  inline void write_file(const std::string &path, const std::vector<unsigned char> &contents)
+  {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+  }
+
+  inline std::vector<unsigned char> read_file(const std::string &path)
+  {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+#include "workpool.hpp"
+
+/**
+ * Tests for the native worker pool
+ */
+
+// Every index is visited exactly once
+TEST(WorkpoolTests, ParallelForCoversEveryIndex)
+{
+  workpool::WorkerPool pool(4);
+  std::vector<std::atomic<int>> visits(1000);
+  pool.parallel_for(workpool::Lane::bulk, visits.size(), [&](std::size_t i)
+                    { visits[i]++; });
+  for (auto &count : visits)
+    EXPECT_EQ(1, count.load());
+}
+
+// Exceptions thrown by the body are surfaced to the caller
+TEST(WorkpoolTests, ParallelForRethrows)
+{
+  workpool::WorkerPool pool(2);
+  ASSERT_THROW(pool.parallel_for(workpool::Lane::interactive, 16, [](std::size_t i)
+                                 { if (i == 7) throw std::runtime_error("boom"); }),
+               std::runtime_error);
+}
+
+// parallel_for from inside a job can't deadlock, even when every worker is busy doing it
+TEST(WorkpoolTests, NestedParallelFor)
+{
+  workpool::WorkerPool pool(2);
+  std::atomic<int> total{0};
+  std::vector<std::promise<void>> finished(4);
+  for (auto &done : finished)
+  {
+    pool.submit(workpool::Lane::interactive, [&pool, &total, &done]()
+                {
+      pool.parallel_for(workpool::Lane::interactive, 50, [&](std::size_t)
+                        { total++; });
+      done.set_value(); });
+  }
+  for (auto &done : finished)
+    done.get_future().wait();
+  EXPECT_EQ(200, total.load());
+}
+
+// Interactive work gets a worker even while bulk work fills the rest of the pool
+TEST(WorkpoolTests, InteractiveJumpsAheadOfBulk)
+{
+  workpool::WorkerPool pool(2);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> bulk_started{0};
+  for (int i = 0; i < 4; i++)
+    pool.submit(workpool::Lane::bulk, [&, released]()
+                { bulk_started++; released.wait(); });
+  while (bulk_started.load() == 0)
+    std::this_thread::yield();
+
+  std::promise<void> interactive_ran;
+  pool.submit(workpool::Lane::interactive, [&]()
+              { interactive_ran.set_value(); });
+  // Only one of the two workers may run bulk work, so this finishes while bulk is still blocked
+  ASSERT_EQ(std::future_status::ready,
+            interactive_ran.get_future().wait_for(std::chrono::seconds(5)));
+  EXPECT_EQ(1, bulk_started.load());
+
+  auto stats = pool.stats();
+  EXPECT_EQ(2, stats.threads);
+  EXPECT_EQ(1, stats.bulk.running);
+  EXPECT_EQ(3, stats.bulk.queued);
+  release.set_value();
+}
+
+// Jobs still queued when the pool goes away run before it's gone, bulk ones past the bulk limit too
+TEST(WorkpoolTests, DestructorDrainsQueuedJobs)
+{
+  std::atomic<int> ran{0};
+  {
+    workpool::WorkerPool pool(2);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    pool.submit(workpool::Lane::bulk, [released]()
+                { released.wait(); });
+    for (int i = 0; i < 20; i++)
+    {
+      pool.submit(workpool::Lane::bulk, [&ran]()
+                  { ran++; });
+      pool.submit(workpool::Lane::interactive, [&ran]()
+                  { ran++; });
+    }
+    release.set_value();
+  }
+  EXPECT_EQ(40, ran.load());
+}
@@ -1,4 +1,8 @@
 #include <gtest/gtest.h>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <new>
 #include "vectorcmp.hpp"
 #include "encoders.hpp"
 #include "commonrand.hpp"
@@ -10,6 +14,26 @@
  * End-to-end tests for encryption using YAP.
  */
 
+/**
+ * Count heap allocations made through operator new, to check that the
+ * buffer based API doesn't make any. OpenSSL allocates with malloc and
+ * isn't counted.
+ */
+namespace
+{
+  std::atomic<std::size_t> allocations{0};
+}
+
+void *operator new(std::size_t size)
+{
+  allocations++;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
 /**
  * Throughout this file I've claimed to have flipped the k'th bit.
  * I know I'm off by 7 bits. Fuck  off.
@@ -172,3 +196,111 @@ TEST(YAPTests, BadCiphertextMid)
   ciphertext_from_alice[pos_to_flip] = 0x1 ^ ciphertext_from_alice[pos_to_flip];
   ASSERT_ANY_THROW(yap::v1::decrypt(shared_secret, bob_keypair->private_key, ciphertext_from_alice));
 }
+
+// The buffer based API round trips without touching the heap once warmed up
+TEST(YAPTests, BuffersNoAllocations)
+{
+  x25519::fixed_key alice_private, alice_public, bob_private, bob_public, shared_secret;
+  x25519::generate_keypair(alice_private, alice_public);
+  x25519::generate_keypair(bob_private, bob_public);
+  x25519::derive_secret(alice_private.data(), bob_public.data(), shared_secret.data());
+
+  unsigned char plaintext[333], ciphertext[yap::v1::OVERHEAD + sizeof(plaintext)], decrypted[sizeof(plaintext)];
+  for (std::size_t i = 0; i < sizeof(plaintext); i++)
+    plaintext[i] = static_cast<unsigned char>(i);
+
+  // The first round trip on a thread sets up its cipher context cache
+  yap::v1::encrypt(shared_secret, bob_public, plaintext, sizeof(plaintext), ciphertext);
+  yap::v1::decrypt(shared_secret, bob_private, ciphertext, sizeof(ciphertext), decrypted);
+
+  auto before = allocations.load();
+  yap::v1::encrypt(shared_secret, bob_public, plaintext, sizeof(plaintext), ciphertext);
+  EXPECT_EQ(sizeof(plaintext), yap::v1::decrypt(shared_secret, bob_private, ciphertext, sizeof(ciphertext), decrypted));
+  EXPECT_EQ(before, allocations.load());
+  EXPECT_EQ(0, memcmp(plaintext, decrypted, sizeof(plaintext)));
+
+  // Both APIs produce the same format
+  std::vector<unsigned char> ss_vec(shared_secret.begin(), shared_secret.end());
+  std::vector<unsigned char> sk_vec(bob_private.begin(), bob_private.end());
+  std::vector<unsigned char> ct_vec(ciphertext, ciphertext + sizeof(ciphertext));
+  auto pt_vec = yap::v1::decrypt(ss_vec, sk_vec, ct_vec);
+  EXPECT_TRUE(pt_vec == std::vector<unsigned char>(plaintext, plaintext + sizeof(plaintext)));
+
+  // Corrupted messages still throw
+  ciphertext[sizeof(ciphertext) - 1] ^= 1;
+  ASSERT_ANY_THROW(yap::v1::decrypt(shared_secret, bob_private, ciphertext, sizeof(ciphertext), decrypted));
+  ASSERT_ANY_THROW(yap::v1::decrypt(shared_secret, bob_private, ciphertext, yap::v1::OVERHEAD - 1, decrypted));
+}
+
+// A batch decrypts every message it can and reports the rest one by one
+TEST(YAPTests, DecryptMany)
+{
+  auto bob_keypair = x25519::generate_keypair();
+  std::vector<yap::v1::EncodedMessage> messages;
+  std::vector<std::string> plaintexts;
+  for (int i = 0; i < 20; i++)
+  {
+    auto alice_keypair = x25519::generate_keypair();
+    auto shared_secret = x25519::derive_secret(alice_keypair->private_key, bob_keypair->public_key);
+    std::string plaintext = "message " + std::to_string(i);
+    auto ciphertext = yap::v1::encrypt(shared_secret, bob_keypair->public_key,
+                                       std::vector<unsigned char>(plaintext.begin(), plaintext.end()));
+    messages.push_back({encoders::binary_to_hex(shared_secret.data(), shared_secret.size()),
+                        encoders::binary_to_hex(bob_keypair->private_key.data(), bob_keypair->private_key.size()),
+                        encoders::base64_encode(ciphertext)});
+    plaintexts.push_back(plaintext);
+  }
+  // Corrupt one message, truncate another and give a third a bad key
+  messages[3].ciphertext_b64[70] = messages[3].ciphertext_b64[70] == 'A' ? 'B' : 'A';
+  messages[7].ciphertext_b64 = messages[7].ciphertext_b64.substr(0, 40);
+  messages[11].shared_secret_hex = "abcd";
+
+  auto opened = yap::v1::decrypt_many(messages);
+  ASSERT_EQ(messages.size(), opened.size());
+  for (std::size_t i = 0; i < opened.size(); i++)
+  {
+    if (i == 3 || i == 7 || i == 11)
+    {
+      EXPECT_FALSE(opened[i].error.empty()) << i;
+      EXPECT_TRUE(opened[i].plaintext.empty()) << i;
+    }
+    else
+    {
+      EXPECT_EQ(decryption::Status::ok, opened[i].status) << i;
+      EXPECT_TRUE(opened[i].error.empty()) << opened[i].error;
+      EXPECT_EQ(plaintexts[i], opened[i].plaintext);
+    }
+  }
+  EXPECT_EQ(decryption::Status::bad_tag, opened[3].status);
+  EXPECT_EQ(decryption::Status::malformed, opened[7].status);
+  EXPECT_EQ(decryption::Status::bad_key, opened[11].status);
+  EXPECT_TRUE(yap::v1::decrypt_many({}).empty());
+}
+
+// Rejections are reported by status, without throwing
+TEST(YAPTests, TryDecryptStatuses)
+{
+  x25519::fixed_key alice_private_key, alice_public_key, bob_private_key, bob_public_key, shared_secret;
+  x25519::generate_keypair(alice_private_key, alice_public_key);
+  x25519::generate_keypair(bob_private_key, bob_public_key);
+  x25519::derive_secret(alice_private_key.data(), bob_public_key.data(), shared_secret.data());
+
+  const char plaintext[] = "stale message";
+  std::vector<unsigned char> ciphertext(yap::v1::OVERHEAD + sizeof(plaintext));
+  yap::v1::encrypt(shared_secret, bob_public_key, reinterpret_cast<const unsigned char *>(plaintext), sizeof(plaintext), ciphertext.data());
+  std::vector<unsigned char> out(sizeof(plaintext));
+  EXPECT_EQ(decryption::Status::ok, yap::v1::try_decrypt(shared_secret, bob_private_key, ciphertext.data(), ciphertext.size(), out.data()));
+  EXPECT_EQ(0, memcmp(plaintext, out.data(), sizeof(plaintext)));
+
+  EXPECT_EQ(decryption::Status::malformed, yap::v1::try_decrypt(shared_secret, bob_private_key, ciphertext.data(), yap::v1::OVERHEAD - 1, out.data()));
+
+  auto tampered = ciphertext;
+  tampered[x25519::PUBLIC_KEY_LENGTH + aesgcm::IV_LENGTH] ^= 1;
+  EXPECT_EQ(decryption::Status::bad_tag, yap::v1::try_decrypt(shared_secret, bob_private_key, tampered.data(), tampered.size(), out.data()));
+
+  // A low order ephemeral public key leaves nothing to agree on
+  tampered = ciphertext;
+  std::fill(tampered.begin(), tampered.begin() + x25519::PUBLIC_KEY_LENGTH, 0);
+  EXPECT_EQ(decryption::Status::bad_peer_key, yap::v1::try_decrypt(shared_secret, bob_private_key, tampered.data(), tampered.size(), out.data()));
+  ASSERT_ANY_THROW(yap::v1::decrypt(shared_secret, bob_private_key, tampered.data(), tampered.size(), out.data()));
+}
@@ -70,6 +70,8 @@ export const DEFAULT_GROUP_PROFILE_AVATAR_INFO: FileAttributes = {
 export const MAX_PERMISSION_PRESETS = 5;
 export const SHARED_FILE_SIZE_LIMIT_IN_BYTES = 256 * 1024 * 1024; //256MB limit
 export const FILE_ENCRYPTION_KEY_LENGTH = 160;
+export const ENCRYPTED_MEDIA_STORE_BUDGET_IN_BYTES = 512 * 1024 * 1024; //512MB of encrypted copies kept for forwarding
+export const IN_MEMORY_DECRYPTION_LIMIT_IN_BYTES = 8 * 1024 * 1024; //8MB limit for files decrypted without touching disk
 
 export const RECENT_CREATED_SUPERPORT_TIME_LIMIT = 15 * 60 * 1000; //time limit in miliseconds (15 minutes)
 
@@ -3,9 +3,34 @@ import {TurboModule, TurboModuleRegistry} from 'react-native';
 export interface Spec extends TurboModule {
   readonly reverseString: (input: string) => string;
   readonly hashSHA256: (input: string) => string;
+  /** Hash many strings in one call. Returns hex digests, in order. */
+  readonly hashSHA256Many: (inputs: Array<string>) => Array<string>;
+  /** Hash a file natively, without loading it into JS. Resolves to the hex digest. */
+  readonly hashSHA256File: (pathToFile: string) => Promise<string>;
   readonly randHex: (input: number) => string;
   readonly generateEd25519Keypair: () => string;
   readonly ed25519SignMessage: (message: string, key: string) => string;
+  /**
+   * Sign many messages with one key, parsing the key once.
+   * @returns a signature per message, in order
+   */
+  readonly ed25519SignMany: (messages: Array<string>, key: string) => Array<string>;
+  /**
+   * Check an ed25519SignMessage signature. Malformed input doesn't verify.
+   */
+  readonly ed25519VerifyMessage: (
+    message: string,
+    signature: string,
+    publicKey: string,
+  ) => boolean;
+  /**
+   * Check many signatures across the worker threads.
+   * @param messages list of [message, signature, publicKey]
+   * @returns whether each one verified, in order
+   */
+  readonly ed25519VerifyMany: (
+    messages: Array<Array<string>>,
+  ) => Promise<Array<boolean>>;
   readonly generateX25519Keypair: () => string;
   readonly deriveX25519Secret: (
     privateKey: string,
@@ -13,36 +38,258 @@ export interface Spec extends TurboModule {
   ) => string;
   readonly aes256Encrypt: (plaintext: string, secret: string) => string;
   readonly aes256Decrypt: (ciphertext: string, secret: string) => string;
+  /**
+   * Decrypt like aes256Decrypt, reporting why it failed instead of returning 'error'.
+   * @returns {plaintext: string} or {error: string, code: string}. code is one of
+   * 'malformed', 'unsupported_version', 'bad_key', 'bad_peer_key', 'bad_tag' or 'bad_padding'.
+   */
+  readonly aes256DecryptResult: (ciphertext: string, secret: string) => Object;
+  /**
+   * Encrypt one plaintext with many secrets in a single call.
+   * @param taggedSecrets list of [tag, secret] pairs
+   * @returns an object mapping every tag to its aes256Encrypt style ciphertext
+   */
+  readonly aes256EncryptMulti: (
+    plaintext: string,
+    taggedSecrets: Array<Array<string>>,
+  ) => Object;
+  /**
+   * Encrypt a large payload once and wrap only its key for every member.
+   * @param taggedSecrets list of [tag, secret] pairs
+   * @returns {payload: string, keys: {[tag]: string}}, all base64
+   */
+  readonly envelopeSeal: (
+    plaintext: string,
+    taggedSecrets: Array<Array<string>>,
+  ) => Object;
+  /**
+   * Open an envelope with the wrapped key addressed to us.
+   * Returns 'error' if it can't be decrypted.
+   */
+  readonly envelopeOpen: (
+    payload: string,
+    wrappedKey: string,
+    secret: string,
+  ) => string;
+  /**
+   * Open an envelope like envelopeOpen.
+   * @returns {plaintext: string} or {error: string, code: string}, see aes256DecryptResult
+   */
+  readonly envelopeOpenResult: (
+    payload: string,
+    wrappedKey: string,
+    secret: string,
+  ) => Object;
+  /**
+   * Encrypt a file. The plaintext and the ciphertext are hashed in the same
+   * pass, so integrity checks and dedup don't need to read the file again.
+   * Resolves to {key: string, plaintextDigest: string, ciphertextDigest: string},
+   * the digests are hex SHA-256.
+   */
   readonly aes256FileEncrypt: (
     pathToInput: string,
     pathToOutput: string,
+  ) => Promise<Object>;
+  readonly aes256FileEncryptV2: (
+    pathToInput: string,
+    pathToOutput: string,
   ) => Promise<string>;
+  /**
+   * Decrypt a byte range of a file made by aes256FileEncryptV2. offset and
+   * length must be integers, and length at most 16 MiB; read longer stretches
+   * in several calls. Resolves to {bytes: ArrayBuffer, totalSize: number}.
+   */
+  readonly aes256FileReadRange: (
+    pathToInput: string,
+    keyAndIV: string,
+    offset: number,
+    length: number,
+  ) => Promise<Object>;
   readonly aes256FileDecrypt: (
     pathToInput: string,
     pathToOutput: string,
     keyAndIV: string,
   ) => Promise<void>;
+  /**
+   * Decrypt a file made by aes256FileEncrypt or aes256FileEncryptV2 into
+   * memory, for thumbnails and other small media. Nothing is written to disk.
+   * Files with a plaintext longer than maxBytes (8 MB if not given) are refused.
+   * Resolves to an ArrayBuffer.
+   */
+  readonly aes256FileDecryptToMemory: (
+    pathToInput: string,
+    keyAndIV: string,
+    maxBytes?: number,
+  ) => Promise<Object>;
+  /**
+   * Decrypt many files into memory in one call, eg. the thumbnails of a gallery.
+   * @param files [pathToInput, keyAndIV] pairs
+   * @returns one {bytes: ArrayBuffer} or {error: string} per file, in order
+   */
+  readonly aes256FileDecryptManyToMemory: (
+    files: Array<Array<string>>,
+    maxBytes?: number,
+  ) => Promise<Array<Object>>;
   readonly pbEncrypt: (
     password: string,
     metadata: string,
     pathToDatabase: string,
     pathToDestination: string,
+    compress?: boolean,
+    onProgress?: (processed: number, total: number) => void,
   ) => Promise<void>;
   readonly pbDecrypt: (
     password: string,
     pathToEncryptedFile: string,
     pathToDestination: string,
+    onProgress?: (processed: number, total: number) => void,
+  ) => Promise<string>;
+  /**
+   * Make a full backup that starts a chain of incremental backups, and keep
+   * the manifest it writes on the device. The backup is compressed and
+   * records the chain, so only deltas of this chain restore on top of it.
+   */
+  readonly pbEncryptBase: (
+    password: string,
+    metadata: string,
+    pathToDatabase: string,
+    pathToDestination: string,
+    pathToManifest: string,
+    onProgress?: (processed: number, total: number) => void,
+  ) => Promise<void>;
+  /**
+   * Back up only the page groups that changed since the manifest. The manifest
+   * for the following delta is written to pathToNextManifest; move it over the
+   * old one once the delta has been stored. Resolves to the number of changed groups.
+   */
+  readonly pbEncryptDelta: (
+    password: string,
+    metadata: string,
+    pathToDatabase: string,
+    pathToManifest: string,
+    pathToDestination: string,
+    pathToNextManifest: string,
+  ) => Promise<number>;
+  /**
+   * Restore a base backup from pbEncryptBase and then replay its deltas, oldest
+   * first. The destination is only replaced once every delta checked out.
+   * Resolves to the metadata of the newest backup.
+   */
+  readonly pbRestoreIncremental: (
+    password: string,
+    pathToBase: string,
+    pathsToDeltas: Array<string>,
+    pathToDestination: string,
   ) => Promise<string>;
   readonly yapV1Encrypt: (
     sharedSecretHex: string,
     peerPublicKeyHex: string,
     plaintext: string,
   ) => string;
+  /**
+   * Decrypt a yapV1Encrypt ciphertext. Returns 'error' if it can't be decrypted.
+   */
   readonly yapV1Decrypt: (
     sharedSecretHex: string,
     privateKeyHex: string,
+    ciphertext: string,
+  ) => string;
+  /**
+   * Decrypt like yapV1Decrypt.
+   * @returns {plaintext: string} or {error: string, code: string}, see aes256DecryptResult
+   */
+  readonly yapV1DecryptResult: (
+    sharedSecretHex: string,
+    privateKeyHex: string,
+    ciphertext: string,
+  ) => Object;
+  /**
+   * Decrypt a batch of yapV1Encrypt ciphertexts across the worker threads.
+   * @param messages list of [sharedSecretHex, privateKeyHex, ciphertext]
+   * @returns one {plaintext: string} or {error: string, code: string} per message, in order
+   */
+  readonly yapV1DecryptMany: (
+    messages: Array<Array<string>>,
+  ) => Promise<Array<Object>>;
+  /**
+   * Binary variants. Every Object argument is an ArrayBuffer or a Uint8Array and every
+   * Object returned is an ArrayBuffer. Codegen has no ArrayBuffer type, hence Object.
+   */
+  readonly deriveX25519SecretBytes: (
+    privateKey: Object,
+    publicKey: Object,
+  ) => Object;
+  readonly aes256EncryptBytes: (plaintext: Object, secret: Object) => Object;
+  readonly aes256DecryptBytes: (ciphertext: Object, secret: Object) => Object;
+  readonly yapV1EncryptBytes: (
+    sharedSecret: Object,
+    peerPublicKey: Object,
+    plaintext: Object,
+  ) => Object;
+  readonly yapV1DecryptBytes: (
+    sharedSecret: Object,
+    privateKey: Object,
+    ciphertext: Object,
+  ) => Object;
+  /**
+   * Session keystore. Keys are parsed once and kept in native memory, JS only
+   * holds the numeric handles. Handles are never reused; using a removed one throws.
+   */
+  readonly keystoreAddSecret: (secretHex: string) => number;
+  readonly keystoreAddX25519PrivateKey: (privateKeyHex: string) => number;
+  /**
+   * Generate an X25519 keypair whose private key never reaches JS.
+   * @returns {handle: number, publicKey: string}
+   */
+  readonly keystoreGenerateX25519: () => Object;
+  /**
+   * Agree on a secret with a peer and keep it in the keystore.
+   * @returns the handle of the shared secret
+   */
+  readonly keystoreDeriveX25519Secret: (
+    privateKey: number,
+    peerPublicKeyHex: string,
+  ) => number;
+  readonly keystoreRemove: (handle: number) => void;
+  readonly keystoreClear: () => void;
+  readonly aes256EncryptWithKey: (plaintext: string, secret: number) => string;
+  readonly aes256DecryptWithKey: (ciphertext: string, secret: number) => string;
+  readonly yapV1EncryptWithKey: (
+    sharedSecret: number,
+    peerPublicKeyHex: string,
     plaintext: string,
   ) => string;
+  readonly yapV1DecryptWithKey: (
+    sharedSecret: number,
+    privateKey: number,
+    ciphertext: string,
+  ) => string;
+  /**
+   * deriveX25519Secret remembers recently derived secrets.
+   * @returns {hits, misses, evictions, size, capacity}
+   */
+  readonly secretCacheStats: () => Object;
+  /** Wipe every cached secret, eg. on logout */
+  readonly secretCacheClear: () => void;
+  /**
+   * Content-addressed store of encrypted media. A file put twice, or the same
+   * content under another path, is encrypted and kept on disk only once.
+   * Open it before the first put. Opening it again only changes the budget.
+   */
+  readonly mediaStoreOpen: (directory: string, budgetBytes: number) => void;
+  /**
+   * Encrypt a file into the store, or find the copy it already has.
+   * The key is interchangeable with the one from aes256FileEncrypt.
+   * The entry isn't evicted until it is released with its digest.
+   * @returns {key: string, path: string, digest: string, hit: boolean}
+   */
+  readonly mediaStorePut: (pathToInput: string) => Promise<Object>;
+  readonly mediaStoreRelease: (digest: string) => void;
+  /** @returns {hits, misses, evictions, entries, bytes, budget} */
+  readonly mediaStoreStats: () => Object;
+  /** Delete every stored ciphertext, eg. on logout */
+  readonly mediaStoreClear: () => void;
+  readonly workerPoolStats: () => Object;
 }
 
 export default TurboModuleRegistry.getEnforcing<Spec>('NativeCryptoModule');
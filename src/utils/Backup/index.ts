@@ -52,6 +52,8 @@ async function createBackup(password: string): Promise<string> {
     metadata,
     databaseSnapshot,
     backupDest,
+    // Chat databases compress well, so deflate them before encrypting
+    true,
   );
 
   // Remove the snapshot from the cached directory
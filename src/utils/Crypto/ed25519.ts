@@ -7,3 +7,32 @@ export function generateKeys() {
 export function signMessage(message: string, privateKey: string) {
   return NativeCryptoModule.ed25519SignMessage(message, privateKey);
 }
+
+/**
+ * Sign many messages with the same key in one call
+ * @returns a signature per message, in order
+ */
+export function signMessages(
+  messages: Array<string>,
+  privateKey: string,
+): Array<string> {
+  return NativeCryptoModule.ed25519SignMany(messages, privateKey);
+}
+
+export function verifyMessage(
+  message: string,
+  signature: string,
+  publicKey: string,
+): boolean {
+  return NativeCryptoModule.ed25519VerifyMessage(message, signature, publicKey);
+}
+
+/**
+ * Verify [message, signature, publicKey] triples in parallel
+ * @returns whether each signature is valid, in order
+ */
+export function verifyMessages(
+  messages: Array<[string, string, string]>,
+): Promise<Array<boolean>> {
+  return NativeCryptoModule.ed25519VerifyMany(messages);
+}
@@ -9,3 +9,21 @@ import NativeCryptoModule from '@specs/NativeCryptoModule';
 export function hash(toHash: string) {
   return  NativeCryptoModule.hashSHA256(toHash);
 }
+
+/**
+ * hashes many strings in one native call
+ * @param toHash - strings to hash
+ * @returns hex encoded hashes, in order
+ */
+export function hashMany(toHash: string[]): string[] {
+  return NativeCryptoModule.hashSHA256Many(toHash);
+}
+
+/**
+ * hashes a file natively, without reading it into JS
+ * @param path - path to the file
+ * @returns 64 character hex encoded hash
+ */
+export function hashFile(path: string): Promise<string> {
+  return NativeCryptoModule.hashSHA256File(path);
+}
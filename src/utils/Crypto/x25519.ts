@@ -52,9 +52,13 @@ export function encrypt(plaintext: string, sharedSecret: string): string {
  * @returns - plaintext as a string
  */
 export function decrypt(ciphertext: string, sharedSecret: string): string {
-  const plaintext = NativeCryptoModule.aes256Decrypt(ciphertext, sharedSecret);
-  if (plaintext === 'error') {
-    throw new Error('Error decrypting ciphertext');
+  // A plaintext of 'error' is a valid message, so ask for the result object
+  const result = NativeCryptoModule.aes256DecryptResult(
+    ciphertext,
+    sharedSecret,
+  ) as {plaintext?: string; code?: string};
+  if (result.plaintext === undefined) {
+    throw new Error(`Error decrypting ciphertext: ${result.code}`);
   }
-  return plaintext;
+  return result.plaintext;
 }
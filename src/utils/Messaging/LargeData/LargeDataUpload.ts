@@ -5,6 +5,7 @@ import {
   deleteFile,
   encryptFile,
   getSafeAbsoluteURI,
+  releaseEncryptedFile,
 } from '@utils/Storage/StorageRNFS/sharedFileHandlers';
 
 import * as API from './APICalls';
@@ -19,6 +20,8 @@ class LargeDataUpload {
   private key: string | null;
   private mediaId: string | null;
   private encryptedTempFilePath: string | null;
+  //set when the encrypted file is shared through the encrypted media store
+  private encryptedFileDigest: string | null = null;
   constructor(
     fileUri: string,
     fileName: string,
@@ -87,6 +90,7 @@ class LargeDataUpload {
       encryptedFileParams.encryptedFilePath,
     );
     this.key = encryptedFileParams.key;
+    this.encryptedFileDigest = encryptedFileParams.digest;
   }
 
   private checkEncryptedTempFileNotNull() {
@@ -97,7 +101,12 @@ class LargeDataUpload {
   }
 
   private async cleanUpEncryptedTempFile() {
-    if (this.encryptedTempFilePath) {
+    if (this.encryptedFileDigest) {
+      //other sends of the same content may still use the encrypted file
+      releaseEncryptedFile(this.encryptedFileDigest);
+      this.encryptedFileDigest = null;
+      this.encryptedTempFilePath = null;
+    } else if (this.encryptedTempFilePath) {
       await deleteFile(this.encryptedTempFilePath);
       this.encryptedTempFilePath = null;
     }
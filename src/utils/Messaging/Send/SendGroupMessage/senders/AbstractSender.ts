@@ -150,13 +150,13 @@ export abstract class SendGroupMessage<T extends ContentType> {
     taggedSecrets: string[][],
   ) {
     const results: any = {};
-    let tag: string;
-    let secret: string;
-    for (let i = 0; i < taggedSecrets.length; i++) {
-      tag = taggedSecrets[i][0];
-      secret = taggedSecrets[i][1];
+    const ciphertexts = NativeCryptoModule.aes256EncryptMulti(
+      plaintext,
+      taggedSecrets,
+    ) as Record<string, string>;
+    for (const tag in ciphertexts) {
       results[tag] = {
-        encryptedContent: NativeCryptoModule.aes256Encrypt(plaintext, secret),
+        encryptedContent: ciphertexts[tag],
       };
     }
     return results;
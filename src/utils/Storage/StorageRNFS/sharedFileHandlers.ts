@@ -1,7 +1,9 @@
 import RNFS from 'react-native-fs';
 
 import {
+  ENCRYPTED_MEDIA_STORE_BUDGET_IN_BYTES,
   FILE_ENCRYPTION_KEY_LENGTH,
+  IN_MEMORY_DECRYPTION_LIMIT_IN_BYTES,
   SHARED_FILE_SIZE_LIMIT_IN_BYTES,
 } from '@configs/constants';
 import {conversationsDir, filesDir, mediaDir} from '@configs/paths';
@@ -220,33 +222,71 @@ export async function initialiseEncryptedTempFile(): Promise<string> {
 export interface EncryptedFileProperties {
   key: string;
   encryptedFilePath: string;
+  /**
+   * The encrypted file belongs to the encrypted media store and is shared with
+   * every other send of the same content. Release it with releaseEncryptedFile
+   * instead of deleting it.
+   */
+  digest: string;
+}
+
+let encryptedMediaStoreOpen = false;
+
+/**
+ * Opens the native store of encrypted media, once per app run.
+ */
+function openEncryptedMediaStore() {
+  if (!encryptedMediaStoreOpen) {
+    NativeCryptoModule.mediaStoreOpen(
+      RNFS.CachesDirectoryPath + '/encrypted-media',
+      ENCRYPTED_MEDIA_STORE_BUDGET_IN_BYTES,
+    );
+    encryptedMediaStoreOpen = true;
+  }
 }
 
 /**
  * Encrypt a file using AES scheme.
+ * Files with content that was encrypted before, like forwarded media,
+ * get the same key and encrypted file back without being encrypted again.
  * @param inputFilePath - file being encrypted.
  * @returns
  */
 export async function encryptFile(
   inputFilePath: string,
 ): Promise<EncryptedFileProperties> {
-  const encryptedFilePath = await initialiseEncryptedTempFile();
   try {
-    const key = await NativeCryptoModule.aes256FileEncrypt(
+    openEncryptedMediaStore();
+    const stored = (await NativeCryptoModule.mediaStorePut(
       removeFilePrefix(inputFilePath),
-      encryptedFilePath,
-    );
-    if (key.length !== FILE_ENCRYPTION_KEY_LENGTH) {
-      throw new Error(key);
+    )) as {key: string; path: string; digest: string};
+    if (stored.key.length !== FILE_ENCRYPTION_KEY_LENGTH) {
+      throw new Error('Unexpected key length');
     }
-    return {key: key, encryptedFilePath: encryptedFilePath};
+    return {
+      key: stored.key,
+      encryptedFilePath: stored.path,
+      digest: stored.digest,
+    };
   } catch (error) {
     console.log('Error encrypting file: ', error);
-    await deleteFile(encryptedFilePath);
     throw new Error('FileEncryptionError');
   }
 }
 
+/**
+ * Lets go of an encrypted file from encryptFile once it has been uploaded.
+ * The store may then evict it when it needs the space.
+ * @param digest - digest returned by encryptFile
+ */
+export function releaseEncryptedFile(digest: string) {
+  try {
+    NativeCryptoModule.mediaStoreRelease(digest);
+  } catch (error) {
+    console.log('Error releasing encrypted file: ', error);
+  }
+}
+
 /**
  * Decrypt a file encrypted using AES scheme.
  * @param encryptedFilePath
@@ -259,20 +299,69 @@ export async function decryptFile(
   key: string,
 ) {
   try {
-    await RNFS.writeFile(decryptedFilePath, '');
-    console.log('initial file created');
     await NativeCryptoModule.aes256FileDecrypt(
       encryptedFilePath,
       decryptedFilePath,
       key,
     );
   } catch (error) {
-    await RNFS.unlink(decryptedFilePath);
+    if (await RNFS.exists(decryptedFilePath)) {
+      await RNFS.unlink(decryptedFilePath);
+    }
     console.log('Error decrypting file: ', error);
     throw new Error('Error decrypting file');
   }
 }
 
+/**
+ * Decrypt a small encrypted file, like a thumbnail, into memory.
+ * Nothing is written to disk.
+ * @param encryptedFilePath
+ * @param key
+ * @param maxBytes - larger files are refused
+ * @returns the decrypted bytes
+ */
+export async function decryptFileToMemory(
+  encryptedFilePath: string,
+  key: string,
+  maxBytes: number = IN_MEMORY_DECRYPTION_LIMIT_IN_BYTES,
+): Promise<ArrayBuffer> {
+  try {
+    return (await NativeCryptoModule.aes256FileDecryptToMemory(
+      encryptedFilePath,
+      key,
+      maxBytes,
+    )) as ArrayBuffer;
+  } catch (error) {
+    console.log('Error decrypting file to memory: ', error);
+    throw new Error('Error decrypting file');
+  }
+}
+
+/**
+ * Decrypt many small encrypted files into memory in one go,
+ * eg. the thumbnails of a media gallery.
+ * @param files - encrypted file paths with their keys
+ * @param maxBytes - larger files are refused
+ * @returns the decrypted bytes of every file in order, or null for files that failed
+ */
+export async function decryptFilesToMemory(
+  files: {encryptedFilePath: string; key: string}[],
+  maxBytes: number = IN_MEMORY_DECRYPTION_LIMIT_IN_BYTES,
+): Promise<(ArrayBuffer | null)[]> {
+  const results = (await NativeCryptoModule.aes256FileDecryptManyToMemory(
+    files.map(file => [file.encryptedFilePath, file.key]),
+    maxBytes,
+  )) as {bytes?: ArrayBuffer; error?: string}[];
+  return results.map(result => {
+    if (result.error !== undefined) {
+      console.log('Error decrypting file to memory: ', result.error);
+      return null;
+    }
+    return result.bytes as ArrayBuffer;
+  });
+}
+
 /**
  * Deletes a file given its uri
  * @param fileUri - can be relative or absolute uri